@@ -18,7 +18,7 @@
 ---@alias FontStyle "normal" | "italics"
 ---@alias TextDecoration "none" | "underline" | "strike-through"
 ---@alias TextAlign "left" | "center" | "right"
----@alias NodeType "vbox" | "hbox" | "text" | "image"
+---@alias NodeType "vbox" | "hbox" | "text" | "image" | "component"
 
 -------------------------------------------------------------------------------
 -- ENGINE GLOBALS (Lifecycle Hooks)
@@ -56,7 +56,9 @@ function on_render() end
 ---@return number|string|boolean
 function useState(key, defaultVal) end
 
---- Sets a value in the global state store and triggers a tree reconciliation.
+--- Sets a value in the global state store. Writing the current value is a no-op;
+--- otherwise only the components that read `key` re-render (App() re-runs when
+--- it read the key itself, or when nobody did).
 ---@param key string
 ---@param val number|string|boolean
 function setState(key, val) end
@@ -125,6 +127,9 @@ local FontHandle = {}
 ---@field src? string Image source path/URL (only valid if type is "image").
 ---@field style? VulpisStyle Visual properties and flexbox layout.
 ---@field children? VulpisNode[] Array of nested child nodes.
+---@field render? fun(props: table): VulpisNode Render function of a "component" node.
+---@field props? table Props passed to `render` (only valid if type is "component").
+---@field memo? any Value or array of dependencies. When it fingerprints the same as on the previous pass the whole subtree (callbacks included) is reused without being patched, so list everything the subtree depends on.
 ---@field focusable? boolean Can this node receive keyboard focus?
 ---@field isFocused? boolean Is this node currently focused?
 ---@field draggable? boolean Can this node be dragged by the mouse?
@@ -154,7 +159,7 @@ vulpis = {}
 ---@return boolean success
 function vulpis.clearCache() end
 
---- Forces the layout and paint to redraw instantly.
+--- Forces a full App() re-render, layout and paint.
 function vulpis.markDirty() end
 
 --- Updates an existing font configuration or registers a new alias.
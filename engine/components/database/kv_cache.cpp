@@ -4,6 +4,8 @@
 #include <iostream>
 #include <leveldb/options.h>
 #include <leveldb/status.h>
+#include <leveldb/iterator.h>
+#include <leveldb/write_batch.h>
 #include "../../scripting/regsitry.h"
 #include "../../components/system/pathUtils.h"
 
@@ -51,6 +53,16 @@ bool KVCache::Delete(const std::string& key) {
     return db->Delete(leveldb::WriteOptions(), key).ok();
 }
 
+void KVCache::DeletePrefix(const std::string& prefix) {
+  if (!db) return;
+  leveldb::WriteBatch batch;
+  std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+  for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+    batch.Delete(it->key());
+  }
+  db->Write(leveldb::WriteOptions(), &batch);
+}
+
 
 // LUA BINDING
 int l_kvSet(lua_State* L) {
@@ -13,6 +13,8 @@ class KVCache {
     static bool Set(const std::string& key, const std::string& value);
     static std::string Get(const std::string& key, bool& success);
     static bool Delete(const std::string& key);
+    // deletes every key starting with `prefix`
+    static void DeletePrefix(const std::string& prefix);
 
   private:
     static std::unique_ptr<leveldb::DB> db;
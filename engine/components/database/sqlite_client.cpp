@@ -14,6 +14,7 @@
 #include <utility>
 #include "../../scripting/regsitry.h"
 #include "../../components/system/pathUtils.h"
+#include "../../components/system/timers.h"
 
 sqlite3* SqliteClient::db = nullptr;
 std::atomic<bool> SqliteClient::isShuttingDown(false);
@@ -89,8 +90,11 @@ void SqliteClient::WorkerLoop() {
       sqlite3_finalize(stmt);
     }
 
-    std::lock_guard<std::mutex> lock(resultMutex);
-    resultQueue.push_back(std::move(result));
+    {
+      std::lock_guard<std::mutex> lock(resultMutex);
+      resultQueue.push_back(std::move(result));
+    }
+    Timers::WakeMainThread();
   }
 }
 
@@ -0,0 +1,133 @@
+#include "hit_index.h"
+#include "../ui/ui.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace HitIndex {
+  static constexpr float CELL_SIZE = 64.0f;
+
+  struct Entry {
+    Node* node;
+    Rect box;
+  };
+
+  static std::vector<Entry> entries;
+  static std::vector<Entry> topEntries;
+
+  // cells are stored flat: cellStart[c]..cellStart[c + 1] index cellItems,
+  // which holds entry indices in paint order
+  static std::vector<uint32_t> cellStart;
+  static std::vector<uint32_t> cellItems;
+
+  // (node, entry index) sorted by node, so remove() is a binary search
+  static std::vector<std::pair<Node*, uint32_t>> byNode;
+
+  static Rect bounds = {0, 0, 0, 0};
+  static int cols = 0;
+  static int rows = 0;
+  static bool valid = false;
+
+  void begin(const Rect& viewport) {
+    entries.clear();
+    topEntries.clear();
+    bounds = viewport;
+    cols = std::max(1, (int)std::ceil(viewport.w / CELL_SIZE));
+    rows = std::max(1, (int)std::ceil(viewport.h / CELL_SIZE));
+    valid = false;
+  }
+
+  void insert(Node* n, const Rect& box, bool onTop) {
+    if (box.w <= 0.0f || box.h <= 0.0f) return;
+    (onTop ? topEntries : entries).push_back({n, box});
+  }
+
+  static void cellRange(const Rect& box, int& c0, int& r0, int& c1, int& r1) {
+    c0 = std::clamp((int)std::floor((box.x - bounds.x) / CELL_SIZE), 0, cols - 1);
+    r0 = std::clamp((int)std::floor((box.y - bounds.y) / CELL_SIZE), 0, rows - 1);
+    c1 = std::clamp((int)std::floor((box.x + box.w - bounds.x) / CELL_SIZE), 0, cols - 1);
+    r1 = std::clamp((int)std::floor((box.y + box.h - bounds.y) / CELL_SIZE), 0, rows - 1);
+  }
+
+  void end() {
+    entries.insert(entries.end(), topEntries.begin(), topEntries.end());
+    topEntries.clear();
+
+    // count, prefix-sum, then fill, so the grid is two flat arrays
+    cellStart.assign((size_t)cols * rows + 1, 0);
+    for (const Entry& e : entries) {
+      int c0, r0, c1, r1;
+      cellRange(e.box, c0, r0, c1, r1);
+      for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++) {
+          cellStart[r * cols + c + 1]++;
+        }
+      }
+    }
+    for (size_t i = 1; i < cellStart.size(); i++) {
+      cellStart[i] += cellStart[i - 1];
+    }
+
+    cellItems.resize(cellStart.back());
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for (uint32_t i = 0; i < entries.size(); i++) {
+      int c0, r0, c1, r1;
+      cellRange(entries[i].box, c0, r0, c1, r1);
+      for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++) {
+          cellItems[fill[r * cols + c]++] = i;
+        }
+      }
+    }
+
+    byNode.resize(entries.size());
+    for (uint32_t i = 0; i < entries.size(); i++) {
+      byNode[i] = {entries[i].node, i};
+    }
+    std::sort(byNode.begin(), byNode.end());
+
+    valid = true;
+  }
+
+  void remove(Node* n) {
+    if (!valid) return;
+    auto it = std::lower_bound(byNode.begin(), byNode.end(), std::make_pair(n, (uint32_t)0));
+    for (; it != byNode.end() && it->first == n; ++it) {
+      entries[it->second].node = nullptr;
+    }
+  }
+
+  bool isValid() {
+    return valid;
+  }
+
+  static bool isInside(Node* n, Node* ancestor) {
+    for (; n; n = n->parent) {
+      if (n == ancestor) return true;
+    }
+    return false;
+  }
+
+  Node* query(float x, float y, Node* ignore) {
+    if (!valid) return nullptr;
+    if (x < bounds.x || y < bounds.y || x > bounds.x + bounds.w || y > bounds.y + bounds.h) {
+      return nullptr;
+    }
+
+    int c = std::clamp((int)std::floor((x - bounds.x) / CELL_SIZE), 0, cols - 1);
+    int r = std::clamp((int)std::floor((y - bounds.y) / CELL_SIZE), 0, rows - 1);
+    size_t cell = (size_t)r * cols + c;
+
+    // later entries were painted later, so walk the cell backwards
+    for (uint32_t i = cellStart[cell + 1]; i > cellStart[cell]; i--) {
+      const Entry& e = entries[cellItems[i - 1]];
+      if (!e.node) continue;
+      if (x < e.box.x || x > e.box.x + e.box.w || y < e.box.y || y > e.box.y + e.box.h) continue;
+      if (ignore && isInside(e.node, ignore)) continue;
+      return e.node;
+    }
+    return nullptr;
+  }
+}
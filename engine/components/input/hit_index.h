@@ -0,0 +1,25 @@
+#pragma once
+#include "../renderer/commands.h"
+
+struct Node;
+
+// Uniform grid over the window of every node box the last frame drew,
+// clipped to its overflow-hidden ancestors and offset by translate and drag.
+// It is rebuilt by the render flatten, which already visits exactly the
+// visible nodes in paint order, so a pointer query only looks at the few
+// boxes in one cell and returns the topmost.
+namespace HitIndex {
+  void begin(const Rect& viewport);
+  // boxes must be inserted in paint order; `onTop` ones (a dragged subtree)
+  // stack above everything else
+  void insert(Node* n, const Rect& box, bool onTop);
+  void end();
+
+  // a node is being freed; its boxes are dropped and the rest of the index
+  // stays usable, since everything else is still where it was drawn
+  void remove(Node* n);
+  bool isValid();
+
+  // topmost node containing the point, skipping `ignore` and its subtree
+  Node* query(float x, float y, Node* ignore);
+}
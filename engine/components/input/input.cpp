@@ -1,4 +1,5 @@
 #include "input.h"
+#include "hit_index.h"
 #include <SDL_events.h>
 #include <SDL_keyboard.h>
 #include <SDL_keycode.h>
@@ -49,21 +50,22 @@ namespace Input {
   }
 
   static int getTextIndexAtCoords(Node* n, int mx, int my) {
-    if (!n || n->type != "text" || !n->font || n->computedLines.empty()) return -1;
+    if (!n || n->type != "text" || !n->textState->font || n->textState->computedLines.empty()) return -1;
   
+    const NodeText& text = n->textState.get();
     float contentWidth = n->w - (n->paddingLeft + n->paddingRight);
-    const std::vector<uint32_t>& codepoints = n->codepoints;
+    const std::vector<uint32_t>& codepoints = text.codepoints;
 
     float startX = n->x + n->paddingLeft - n->scrollX + n->cachedOffsetX;
     float startY = n->y + n->paddingTop - n->scrollY + n->cachedOffsetY;
 
     float localY = my - startY;
-    int lineIdx = std::floor(localY / n->computedLineHeight);
+    int lineIdx = std::floor(localY / text.computedLineHeight);
 
     if (lineIdx < 0) lineIdx = 0;
-    if (lineIdx >= (int)n->computedLines.size()) lineIdx = n->computedLines.size() - 1;
+    if (lineIdx >= (int)text.computedLines.size()) lineIdx = text.computedLines.size() - 1;
     
-    const TextLine& line = n->computedLines[lineIdx];
+    const TextLine& line = text.computedLines[lineIdx];
 
     float lineXOffset = 0;
     if (n->wordWrap) {
@@ -76,7 +78,7 @@ namespace Input {
 
     for (uint32_t i = 0; i < line.count; i++ ) {
       uint32_t charIdx = line.startIndex + i;
-      float adv = n->font->GetLogicalAdvance(codepoints[charIdx]);
+      float adv = text.font->GetLogicalAdvance(codepoints[charIdx]);
       if (mx < currentX + (adv / 2.0f)) {
         return charIdx;
       }
@@ -86,14 +88,16 @@ namespace Input {
   }
 
 
-  Node* hitTest(Node* root, int mx, int my, Node* ignore, float parentOffsetX, float parentOffsetY) {
+  // Tree walk used until the first frame has built the hit index, or
+  // while a freed node may still be in it.
+  static Node* hitTestTree(Node* root, int mx, int my, Node* ignore, float parentOffsetX, float parentOffsetY) {
     if (!root || root == ignore) return nullptr;
 
-    float totalOffsetX = parentOffsetX;
-    float totalOffsetY = parentOffsetY;
+    float totalOffsetX = parentOffsetX + root->translateX;
+    float totalOffsetY = parentOffsetY + root->translateY;
 
-    totalOffsetX += root->dragOffsetX;
-    totalOffsetY += root->dragOffsetY;
+    totalOffsetX += root->drag->dragOffsetX;
+    totalOffsetY += root->drag->dragOffsetY;
 
     float screenX = root->x + totalOffsetX;
     float screenY = root->y + totalOffsetY;
@@ -106,7 +110,7 @@ namespace Input {
     }
 
     for (int i = root->children.size() - 1; i >= 0; --i) {
-      Node* target = hitTest(root->children[i], mx, my, ignore, totalOffsetX - root->scrollX, totalOffsetY - root->scrollY);
+      Node* target = hitTestTree(root->children[i], mx, my, ignore, totalOffsetX - root->scrollX, totalOffsetY - root->scrollY);
       if (target) {
         return target;
       }
@@ -119,6 +123,15 @@ namespace Input {
     return nullptr;
   }
 
+  Node* hitTest(Node* root, int mx, int my, Node* ignore, float parentOffsetX, float parentOffsetY) {
+    // the index holds the whole tree as last drawn, so it only answers
+    // queries from the root
+    if (HitIndex::isValid() && root && !root->parent && parentOffsetX == 0.0f && parentOffsetY == 0.0f) {
+      return HitIndex::query((float)mx, (float)my, ignore);
+    }
+    return hitTestTree(root, mx, my, ignore, parentOffsetX, parentOffsetY);
+  }
+
 
 
   void fireDragEvent(lua_State* L, int ref, int dx, int dy, int mx, int my, int textIndex) {
@@ -174,13 +187,16 @@ namespace Input {
   static std::vector<Node*> lastHoveredPath;
 
   void processHover(lua_State* L, const std::vector<Node*>& activePath) {
+    // the pointer almost always moves within the node it was already over
+    if (activePath == lastHoveredPath) return;
+
     // 1. Fire onMouseLeave for nodes that are no longer hovered
     for (Node* oldNode : lastHoveredPath) {
       if (std::find(activePath.begin(), activePath.end(), oldNode) == activePath.end()) {
         oldNode->isHovered = false;
         oldNode->makePaintDirty();
-        if (oldNode->onMouseLeaveRef != -2) {
-          lua_rawgeti(L, LUA_REGISTRYINDEX, oldNode->onMouseLeaveRef);
+        if (oldNode->events->onMouseLeaveRef != -2) {
+          lua_rawgeti(L, LUA_REGISTRYINDEX, oldNode->events->onMouseLeaveRef);
           if (lua_isfunction(L, -1)) {
             if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
               std::cout << "Input Error (onMouseLeave): " << lua_tostring(L, -1) << std::endl;
@@ -198,8 +214,8 @@ namespace Input {
       if (std::find(lastHoveredPath.begin(), lastHoveredPath.end(), newNode) == lastHoveredPath.end()) {
         newNode->isHovered = true;
         newNode->makePaintDirty();
-        if (newNode->onMouseEnterRef != -2) {
-          lua_rawgeti(L, LUA_REGISTRYINDEX, newNode->onMouseEnterRef);
+        if (newNode->events->onMouseEnterRef != -2) {
+          lua_rawgeti(L, LUA_REGISTRYINDEX, newNode->events->onMouseEnterRef);
           if (lua_isfunction(L, -1)) {
             if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
               std::cout << "Input Error (onMouseEnter): " << lua_tostring(L, -1) << std::endl;
@@ -218,7 +234,7 @@ namespace Input {
 
   Node* findFocusedNode(Node* root) {
     if (!root) return nullptr;
-    if (root->isFocused) return root;
+    if (root->textEdit->isFocused) return root;
     for (Node* c : root->children) {
       Node* f = findFocusedNode(c);
       if (f) return f;
@@ -238,7 +254,7 @@ namespace Input {
       int my = event.motion.y;
 
       if (draggedScrollbarNode) {
-        draggedScrollbarNode->scrollbarTimer = 1.5f;
+        draggedScrollbarNode->scrollbar.edit().scrollbarTimer = 1.5f;
         ScrollbarMetrics sb = draggedScrollbarNode->getScrollbarMetrics();
 
         if (!draggedIsHorizontal && sb.vVisible) {
@@ -261,27 +277,27 @@ namespace Input {
         return;
       }
 
-      if (activeDragNode && activeDragNode->isDragging) {
+      if (activeDragNode && activeDragNode->drag->isDragging) {
         int dx = mx - dragInitialMouseX;
         int dy = my - dragInitialMouseY;
 
-        if (activeDragNode->isDraggable) {
+        if (activeDragNode->drag->isDraggable) {
           activeDragNode->makePaintDirty();
-          activeDragNode->dragOffsetX = (float)dx;
-          activeDragNode->dragOffsetY = (float)dy;
+          activeDragNode->drag.edit().dragOffsetX = (float)dx;
+          activeDragNode->drag.edit().dragOffsetY = (float)dy;
           activeDragNode->makePaintDirty();
         }
 
         int textIdx = getTextIndexAtCoords(activeDragNode, mx, my);
 
         // selection support when mouse is in motion and dragging
-        if (activeDragNode->allowSelection && activeDragNode->type == "text") {
-          activeDragNode->selectionEnd = textIdx;
-          activeDragNode->cursorPosition = textIdx;
+        if (activeDragNode->textEdit->allowSelection && activeDragNode->type == "text") {
+          activeDragNode->textEdit.edit().selectionEnd = textIdx;
+          activeDragNode->textEdit.edit().cursorPosition = textIdx;
           activeDragNode->makePaintDirty();
         }
 
-        fireDragEvent(L, activeDragNode->onDragRef, dx, dy, mx, my, textIdx);
+        fireDragEvent(L, activeDragNode->drag->onDragRef, dx, dy, mx, my, textIdx);
       }
 
       Node* target = hitTest(root, mx, my);
@@ -314,11 +330,13 @@ namespace Input {
             dropTarget = dropTarget->parent;
           }
 
-          fireDragEndEvent(L, activeDragNode->onDragEndRef, dropId, finalDx, finalDy);
+          fireDragEndEvent(L, activeDragNode->drag->onDragEndRef, dropId, finalDx, finalDy);
 
-          activeDragNode->isDragging = false;
-          activeDragNode->dragOffsetX = 0.0f;
-          activeDragNode->dragOffsetY = 0.0f;
+          // damage the floating copy before it snaps back
+          activeDragNode->makePaintDirty();
+          activeDragNode->drag.edit().isDragging = false;
+          activeDragNode->drag.edit().dragOffsetX = 0.0f;
+          activeDragNode->drag.edit().dragOffsetY = 0.0f;
           activeDragNode = nullptr;
         }
       }
@@ -346,7 +364,7 @@ namespace Input {
 
           if (maxScrollY > 0 || maxScrollX > 0) {
             float scrollSpeed = 40.0f;
-            target->scrollbarTimer = 1.5f;
+            target->scrollbar.edit().scrollbarTimer = 1.5f;
 
             target->targetScrollY -= wheelY * scrollSpeed;
             target->targetScrollX -= wheelX * scrollSpeed;
@@ -374,7 +392,7 @@ namespace Input {
         while (curr) {
           ScrollbarMetrics sb = curr->getScrollbarMetrics();
 
-          if (curr->scrollbarOpacity > 0.0f) {
+          if (curr->scrollbar->scrollbarOpacity > 0.0f) {
             if (sb.vVisible) {
               float sTrackX = sb.vTrackX + curr->cachedOffsetX;
               float sTrackY = sb.vTrackY + curr->cachedOffsetY;
@@ -411,20 +429,20 @@ namespace Input {
         bool focusHandle = false;
 
         while (focusCheck) {
-          if (focusCheck->isFocusable) {
+          if (focusCheck->textEdit->isFocusable) {
             Node* focusedNode = findFocusedNode(root);
             if (focusedNode != focusCheck) {
               if (focusedNode) {
-                focusedNode->isFocused = false;
-                if (focusedNode && focusedNode->onBlurRef != -2) {
-                  lua_rawgeti(L, LUA_REGISTRYINDEX, focusedNode->onBlurRef);
+                focusedNode->textEdit.edit().isFocused = false;
+                if (focusedNode && focusedNode->events->onBlurRef != -2) {
+                  lua_rawgeti(L, LUA_REGISTRYINDEX, focusedNode->events->onBlurRef);
                   if (lua_isfunction(L, -1)) lua_pcall(L, 0, 0, 0);
                   else lua_pop(L, 1);
                 }
               }
-              focusCheck->isFocused = true;
-              if (focusCheck->onFocusRef != -2) {
-                lua_rawgeti(L, LUA_REGISTRYINDEX, focusCheck->onFocusRef);
+              focusCheck->textEdit.edit().isFocused = true;
+              if (focusCheck->events->onFocusRef != -2) {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, focusCheck->events->onFocusRef);
                 if (lua_isfunction(L, -1)) lua_pcall(L, 0, 0, 0);
                 else lua_pop(L, 1);
               }
@@ -438,10 +456,10 @@ namespace Input {
         if (!focusHandle) {
           Node* focusedNode = findFocusedNode(root);
           if (focusedNode) {
-            focusedNode->isFocused = false; 
+            focusedNode->textEdit.edit().isFocused = false; 
 
-            if (focusedNode->onBlurRef != -2) {
-              lua_rawgeti(L, LUA_REGISTRYINDEX, focusedNode->onBlurRef);
+            if (focusedNode->events->onBlurRef != -2) {
+              lua_rawgeti(L, LUA_REGISTRYINDEX, focusedNode->events->onBlurRef);
               if (lua_isfunction(L, -1)) {
                 lua_pcall(L, 0, 0, 0);
               } else {
@@ -453,56 +471,56 @@ namespace Input {
         Node* dragCheck = target;
         while (dragCheck) {
           // Only trigger selection drag logic if it is explicitly a text node!
-          if (dragCheck->isDraggable || dragCheck->onDragRef != -2 || dragCheck->onDragStartRef != -2 || (dragCheck->allowSelection && dragCheck->type == "text")) {
+          if (dragCheck->drag->isDraggable || dragCheck->drag->onDragRef != -2 || dragCheck->drag->onDragStartRef != -2 || (dragCheck->textEdit->allowSelection && dragCheck->type == "text")) {
             activeDragNode = dragCheck;
-            activeDragNode->isDragging = true;
-            activeDragNode->lastCursorPosition = -1;
+            activeDragNode->drag.edit().isDragging = true;
+            activeDragNode->textEdit.set(&NodeTextEdit::lastCursorPosition, -1);
             dragInitialMouseX = mx;
             dragInitialMouseY = my;
 
             int textIndex = getTextIndexAtCoords(activeDragNode, mx, my);
 
-            if (activeDragNode->allowSelection && activeDragNode->type == "text") {
+            if (activeDragNode->textEdit->allowSelection && activeDragNode->type == "text") {
               SDL_Keymod mod = SDL_GetModState();
               bool isShift = mod & KMOD_SHIFT;
 
               if (event.button.clicks >= 3) {
                 // Triple click: Select All
-                activeDragNode->selectionStart = 0;
-                activeDragNode->selectionEnd = activeDragNode->codepoints.size();
-                activeDragNode->cursorPosition = activeDragNode->codepoints.size();
+                activeDragNode->textEdit.edit().selectionStart = 0;
+                activeDragNode->textEdit.edit().selectionEnd = activeDragNode->textState->codepoints.size();
+                activeDragNode->textEdit.edit().cursorPosition = activeDragNode->textState->codepoints.size();
               } else if (event.button.clicks == 2) {
                 // Double click: Select Word
                 int start = textIndex;
                 int end = textIndex;
-                const auto& cps = activeDragNode->codepoints;
+                const auto& cps = activeDragNode->textState->codepoints;
                 int maxLen = (int)cps.size();
 
                 while (start > 0 && cps[start - 1] != ' ' && cps[start - 1] != '\n') start--;
                 while (end < maxLen && cps[end] != ' ' && cps[end] != '\n') end++;
 
-                activeDragNode->selectionStart = start;
-                activeDragNode->selectionEnd = end;
-                activeDragNode->cursorPosition = end;
+                activeDragNode->textEdit.edit().selectionStart = start;
+                activeDragNode->textEdit.edit().selectionEnd = end;
+                activeDragNode->textEdit.edit().cursorPosition = end;
               } else if (isShift) {
                 // Shift + Click expands the current selection
-                if (activeDragNode->selectionStart == -1) {
-                  activeDragNode->selectionStart = (activeDragNode->cursorPosition != -1) ? activeDragNode->cursorPosition : 0;
+                if (activeDragNode->textEdit->selectionStart == -1) {
+                  activeDragNode->textEdit.edit().selectionStart = (activeDragNode->textEdit->cursorPosition != -1) ? activeDragNode->textEdit->cursorPosition : 0;
                 }
-                activeDragNode->selectionEnd = textIndex;
-                activeDragNode->cursorPosition = textIndex;
+                activeDragNode->textEdit.edit().selectionEnd = textIndex;
+                activeDragNode->textEdit.edit().cursorPosition = textIndex;
               } else {
                 // Standard single click
-                activeDragNode->selectionStart = textIndex;
-                activeDragNode->selectionEnd = textIndex;
-                activeDragNode->cursorPosition = textIndex;
+                activeDragNode->textEdit.edit().selectionStart = textIndex;
+                activeDragNode->textEdit.edit().selectionEnd = textIndex;
+                activeDragNode->textEdit.edit().cursorPosition = textIndex;
               }
               activeDragNode->makePaintDirty();
             }
 
-            fireMouseEvent(L, activeDragNode->onDragStartRef, mx, my, textIndex, event.button.clicks);
+            fireMouseEvent(L, activeDragNode->drag->onDragStartRef, mx, my, textIndex, event.button.clicks);
 
-            if (activeDragNode->isDraggable || activeDragNode->onDragRef != -2 || activeDragNode->onDragStartRef != -2) {
+            if (activeDragNode->drag->isDraggable || activeDragNode->drag->onDragRef != -2 || activeDragNode->drag->onDragStartRef != -2) {
               eventConsumed = true;
             }
 
@@ -518,9 +536,9 @@ namespace Input {
           int refToCall = -2;
 
           if (button == SDL_BUTTON_LEFT) {
-            refToCall = target->onClickRef;
+            refToCall = target->events->onClickRef;
           } else if (button == SDL_BUTTON_RIGHT) {
-            refToCall = target->onRightClickRef;
+            refToCall = target->events->onRightClickRef;
           }
 
           if (refToCall != -2) {
@@ -549,18 +567,18 @@ namespace Input {
     else if (event.type == SDL_KEYDOWN) {  
       Node* focusedNode = findFocusedNode(root);
       if (focusedNode) {
-        if (focusedNode->allowSelection && focusedNode->type == "text") {
+        if (focusedNode->textEdit->allowSelection && focusedNode->type == "text") {
           SDL_Keymod mod = SDL_GetModState();
           bool isCtrl = (mod & KMOD_CTRL) || (mod & KMOD_GUI);
 
           if (isCtrl && event.key.keysym.sym == SDLK_c) {
-            int selMin = std::min(focusedNode->selectionStart, focusedNode->selectionEnd);
-            int selMax = std::max(focusedNode->selectionStart, focusedNode->selectionEnd);
+            int selMin = std::min(focusedNode->textEdit->selectionStart, focusedNode->textEdit->selectionEnd);
+            int selMax = std::max(focusedNode->textEdit->selectionStart, focusedNode->textEdit->selectionEnd);
 
             if (selMin >= 0 && selMax >= 0 && selMin != selMax) {
               std::string clipboardData = "";
-              for (int i = selMin; i < selMax && i < (int)focusedNode->codepoints.size(); i++) {
-                uint32_t cp = focusedNode->codepoints[i];
+              for (int i = selMin; i < selMax && i < (int)focusedNode->textState->codepoints.size(); i++) {
+                uint32_t cp = focusedNode->textState->codepoints[i];
                 if (cp <= 0x7F) { clipboardData += (char)cp; } 
                 else if (cp <= 0x7FF) {
                   clipboardData += (char)(0xC0 | ((cp >> 6) & 0x1F));
@@ -580,18 +598,18 @@ namespace Input {
             }
           }
           else if (isCtrl && event.key.keysym.sym == SDLK_a) {
-            focusedNode->selectionStart = 0;
-            focusedNode->selectionEnd = focusedNode->codepoints.size();
-            focusedNode->cursorPosition = focusedNode->codepoints.size();
+            focusedNode->textEdit.edit().selectionStart = 0;
+            focusedNode->textEdit.edit().selectionEnd = focusedNode->textState->codepoints.size();
+            focusedNode->textEdit.edit().cursorPosition = focusedNode->textState->codepoints.size();
             focusedNode->makePaintDirty();
           }
 
         }
       }
 
-      if (focusedNode && focusedNode->onKeyDownRef != -2) {
-        focusedNode->lastCursorPosition = -1;
-        lua_rawgeti(L, LUA_REGISTRYINDEX, focusedNode->onKeyDownRef);
+      if (focusedNode && focusedNode->events->onKeyDownRef != -2) {
+        focusedNode->textEdit.edit().lastCursorPosition = -1;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, focusedNode->events->onKeyDownRef);
         if (lua_isfunction(L, -1)) {
           lua_pushstring(L, SDL_GetKeyName(event.key.keysym.sym));
           SDL_Keymod mod = SDL_GetModState();
@@ -612,9 +630,9 @@ namespace Input {
 
     else if (event.type == SDL_TEXTINPUT) {
       Node* focusedNode = findFocusedNode(root);
-      if (focusedNode && focusedNode->onTextInputRef != -2) {
-        focusedNode->lastCursorPosition = -1;
-        lua_rawgeti(L, LUA_REGISTRYINDEX, focusedNode->onTextInputRef);
+      if (focusedNode && focusedNode->events->onTextInputRef != -2) {
+        focusedNode->textEdit.edit().lastCursorPosition = -1;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, focusedNode->events->onTextInputRef);
         if (lua_isfunction(L, -1)) {
           lua_pushstring(L, event.text.text);
           if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
@@ -667,7 +685,12 @@ namespace Input {
 
 
 
+  Node* getActiveDragNode() {
+    return activeDragNode;
+  }
+
   void clearNodeState(Node *n) {
+    HitIndex::remove(n);
     if (activeDragNode == n) activeDragNode = nullptr;
     if (draggedScrollbarNode == n) draggedScrollbarNode = nullptr;
 
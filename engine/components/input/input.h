@@ -13,6 +13,8 @@ namespace Input {
   void init();
   void updateState();
   Node* findFocusedNode(Node* root);
+  // the node under an active drag, or nullptr
+  Node* getActiveDragNode();
 
   void clearNodeState(Node* n);
 
@@ -24,4 +24,11 @@ namespace Layout {
   
   LayoutSolver* createYogaSolver();
 
+  // frees the node's Yoga mirror; called from freeTree
+  void releaseNode(Node* n);
+
+  // a relayout boundary whose inside changed; solved on the next solve()
+  void scheduleBoundary(Node* n);
+  bool hasPendingRelayout();
+
 }
@@ -5,17 +5,19 @@
 #include "yoga/YGNodeStyle.h"
 #include <algorithm>
 #include <cmath>
+#include <iostream>
 #include <yoga/Yoga.h>
 #include <vector>
 #include "../ui/ui.h"
 #include "../text/font.h"
+#include "../vdom/vdom.h"
 
 namespace Layout {
 
   YGSize textMeasure(YGNodeConstRef node, float width, YGMeasureMode widthMode, float height, YGMeasureMode heightMode) {
     Node* n = (Node*)YGNodeGetContext(node);
     YGSize size = {0, 0};
-    if (!n || !n->font || n->text.empty()) {
+    if (!n || !n->textState->font || n->textState->text.empty()) {
       return size;
     }
 
@@ -27,16 +29,11 @@ namespace Layout {
       }
     }
 
-    const auto& codepoints = n->codepoints;
+    // shared with computeTextLayout, so the post-layout pass is usually a hit
+    WrapResultRef wrap = wrapNodeText(n, maxWidth);
 
-    auto lines = n->font->CalculateWordWrap(codepoints, maxWidth);
-
-    float actualWidth = 0.0f;
-    for (const auto& line : lines) {
-      actualWidth = std::max(actualWidth, line.width);
-    }
-
-    float actualHeight = lines.size() * n->font->GetLogicalLineHeight();
+    float actualWidth = wrap->width;
+    float actualHeight = wrap->lines.size() * n->textState->font->GetLogicalLineHeight();
 
     size.width = std::ceil(actualWidth);
     size.height = std::ceil(actualHeight);
@@ -48,38 +45,295 @@ namespace Layout {
     return size;
   }
 
+  // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+  // ╏ PERSISTENT YOGA MIRROR  ╏
+  // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+  // Every Node owns its YGNodeRef for its whole life. A solve only walks the
+  // isLayoutDirty path: style is pushed for nodes patched with a layout
+  // change, child lists are fixed up where the diff touched them, and Yoga's
+  // own dirty flags + measure cache decide what actually gets recomputed.
+  //
+  // Relayout boundaries (Node::isLayoutBoundary) are split out of their
+  // parent's Yoga tree: the parent only sees a childless proxy carrying the
+  // boundary's outer box, and the boundary's own YGNode is a separate root.
+  // Changes inside never dirty the parent tree, and the subtree is solved on
+  // its own at the size the proxy was given.
+
+  static std::vector<Node*> g_pendingBoundaries;
+
+  void scheduleBoundary(Node* n) {
+    if (std::find(g_pendingBoundaries.begin(), g_pendingBoundaries.end(), n) == g_pendingBoundaries.end()) {
+      g_pendingBoundaries.push_back(n);
+    }
+  }
+
+  bool hasPendingRelayout() {
+    return !g_pendingBoundaries.empty();
+  }
+
+  void releaseNode(Node* n) {
+    if (!n) return;
+    if (!g_pendingBoundaries.empty()) {
+      g_pendingBoundaries.erase(
+          std::remove(g_pendingBoundaries.begin(), g_pendingBoundaries.end(), n),
+          g_pendingBoundaries.end());
+    }
+    if (n->yogaProxy) {
+      YGNodeFree(n->yogaProxy);
+      n->yogaProxy = nullptr;
+    }
+    if (n->yogaNode) {
+      YGNodeFree(n->yogaNode);
+      n->yogaNode = nullptr;
+    }
+  }
+
+  // the node that represents `n` inside its parent's Yoga tree
+  static YGNodeRef outerNode(Node* n) {
+    return n->yogaProxy ? n->yogaProxy : n->yogaNode;
+  }
+
   class YogaSolver : public LayoutSolver {
     public:
       void solve(Node* root, Size viewport) override {
         if (!root) return;
 
-        YGNodeRef yogaRoot = buildTree(root);
-        YGNodeStyleSetWidth(yogaRoot, (float)viewport.w);
-        YGNodeStyleSetHeight(yogaRoot, (float)viewport.h);
+        // wrap the text this solve will measure up front, on the worker
+        // pool, so textMeasure mostly reads cached lines
+        applyChildPatches();
+
+        std::vector<Node*> dirtyText;
+        if (root->isLayoutDirty || !root->yogaNode) collectDirtyText(root, dirtyText);
+        for (Node* b : g_pendingBoundaries) collectDirtyText(b, dirtyText);
+        prewrapText(dirtyText);
 
-        YGNodeCalculateLayout(yogaRoot, (float)viewport.w, (float)viewport.h, YGDirectionLTR);
-        applyLayout(root, yogaRoot, 0, 0);
-        YGNodeFreeRecursive(yogaRoot);
+        if (root->isLayoutDirty || !root->yogaNode) {
+          sync(root);
+          YGNodeStyleSetWidth(root->yogaNode, (float)viewport.w);
+          YGNodeStyleSetHeight(root->yogaNode, (float)viewport.h);
+
+          YGNodeCalculateLayout(root->yogaNode, (float)viewport.w, (float)viewport.h, YGDirectionLTR);
+          applyLayout(root, 0, 0, true);
+        }
+
+        // boundaries dirtied from inside; outermost first, so a nested one
+        // is usually already handled by the time it comes up
+        std::vector<Node*> pending;
+        pending.swap(g_pendingBoundaries);
+        std::sort(pending.begin(), pending.end(), [](Node* a, Node* b) { return depth(a) < depth(b); });
+
+        for (Node* b : pending) {
+          // also reached by a full pass that did not re-place it
+          if (!b->yogaNode) continue;
+          sync(b);
+          float originX = b->parent ? b->parent->x : 0.0f;
+          float originY = b->parent ? b->parent->y : 0.0f;
+          applyLayout(b, originX, originY, true);
+        }
       }
     private:
-      YGNodeRef buildTree(Node* n) {
-        YGNodeRef yogaNode = YGNodeNew();
-        YGNodeSetContext(yogaNode, n);
+      // the text nodes sync() is going to visit
+      static void collectDirtyText(Node* n, std::vector<Node*>& out) {
+        if (n->type == "text") out.push_back(n);
+        for (Node* c : n->children) {
+          if (c->isLayoutDirty || !c->yogaNode) collectDirtyText(c, out);
+        }
+      }
+
+      static int depth(Node* n) {
+        int d = 0;
+        for (Node* p = n->parent; p; p = p->parent) d++;
+        return d;
+      }
+
+      static void ensureYogaNode(Node* n) {
+        if (n->yogaNode) return;
+        n->yogaNode = YGNodeNew();
+        YGNodeSetContext(n->yogaNode, n);
+        n->isStyleDirty = true;
+        n->isChildListDirty = true;
+      }
+
+      // Replays the keyed diff's inserts and moves on the Yoga children, so
+      // a reorder costs one detach and insert per moved child instead of
+      // the cascade syncChildren makes of it. Removed children already
+      // detached when their Yoga nodes were freed. syncChildren still runs
+      // on the parent afterwards and finds everything in place, or fixes
+      // what a dropped entry left out.
+      static void applyChildPatches() {
+        for (const VDOM::ChildPatch& p : VDOM::patchLog()) {
+          if (p.op == VDOM::PatchOp::Remove) continue;
+          // a parent without a mirror yet gets its children on its first sync
+          YGNodeRef parent = p.parent->yogaNode;
+          if (!parent) continue;
+
+          ensureYogaNode(p.child);
+          YGNodeRef child = outerNode(p.child);
+          if (YGNodeRef owner = YGNodeGetOwner(child)) {
+            YGNodeRemoveChild(owner, child);
+          }
 
-        if (n->position == PositionType::Absolute) {
-          YGNodeStyleSetPositionType(yogaNode, YGPositionTypeAbsolute);
+          size_t count = YGNodeGetChildCount(parent);
+          size_t at = count;
+          if (p.before) {
+            YGNodeRef anchor = outerNode(p.before);
+            for (size_t i = 0; i < count; i++) {
+              if (YGNodeGetChild(parent, i) == anchor) {
+                at = i;
+                break;
+              }
+            }
+          }
+          YGNodeInsertChild(parent, child, at);
+        }
+      }
+
+      void sync(Node* n) {
+        ensureYogaNode(n);
+
+        if (n->type == "text" && !n->children.empty()) {
+          std::cerr << "ERROR: Text Node (text='" 
+            << n->textState->text.substr(0, 20) << (n->textState->text.length() > 20 ? "..." : "") 
+            << "') cannot have children.\n";
+          exit(1);
+        }
+
+        if (n->isStyleDirty) {
+          updateBoundary(n);
+          if (n->yogaProxy) {
+            applyStyle(n, n->yogaProxy, true, false);
+            applyStyle(n, n->yogaNode, false, true);
+          } else {
+            applyStyle(n, n->yogaNode, true, true);
+          }
+          n->isStyleDirty = false;
+        }
+
+        for (Node* c : n->children) {
+          if (c->isLayoutDirty || !c->yogaNode) sync(c);
+        }
+
+        if (n->isChildListDirty) {
+          syncChildren(n);
+          n->isChildListDirty = false;
+        }
+
+        n->isLayoutDirty = false;
+      }
+
+      // splits the node out into its own Yoga root, or folds it back in,
+      // when its boundary status changes
+      void updateBoundary(Node* n) {
+        bool boundary = n->isLayoutBoundary();
+        if (boundary == (n->yogaProxy != nullptr)) return;
+
+        if (boundary) {
+          if (YGNodeRef owner = YGNodeGetOwner(n->yogaNode)) {
+            YGNodeRemoveChild(owner, n->yogaNode);
+          }
+          n->yogaProxy = YGNodeNew();
+          YGNodeSetContext(n->yogaProxy, n);
+
+          // the standalone root is placed by the proxy, not by its own style
+          YGNodeStyleSetPositionType(n->yogaNode, YGPositionTypeRelative);
+          for (YGEdge edge : {YGEdgeLeft, YGEdgeTop, YGEdgeRight, YGEdgeBottom}) {
+            YGNodeStyleSetPosition(n->yogaNode, edge, YGUndefined);
+            YGNodeStyleSetMargin(n->yogaNode, edge, 0.0f);
+          }
+          YGNodeStyleSetFlexGrow(n->yogaNode, 0.0f);
+          YGNodeStyleSetFlexShrink(n->yogaNode, 0.0f);
+          YGNodeStyleSetMinWidth(n->yogaNode, YGUndefined);
+          YGNodeStyleSetMinHeight(n->yogaNode, YGUndefined);
+          YGNodeStyleSetMaxWidth(n->yogaNode, YGUndefined);
+          YGNodeStyleSetMaxHeight(n->yogaNode, YGUndefined);
         } else {
-          YGNodeStyleSetPositionType(yogaNode, YGPositionTypeRelative);
+          YGNodeFree(n->yogaProxy);
+          n->yogaProxy = nullptr;
         }
 
-        if (n->hasLeft) YGNodeStyleSetPosition(yogaNode, YGEdgeLeft, n->leftVal);
-        if (n->hasTop) YGNodeStyleSetPosition(yogaNode, YGEdgeTop, n->topVal);
-        if (n->hasRight) YGNodeStyleSetPosition(yogaNode, YGEdgeRight, n->rightVal);
-        if (n->hasBottom) YGNodeStyleSetPosition(yogaNode, YGEdgeBottom, n->bottomVal);
+        if (n->parent) n->parent->isChildListDirty = true;
+      }
 
+      // brings the Yoga child list in line with n->children; after
+      // applyChildPatches this is normally a read-only check
+      void syncChildren(Node* n) {
+        YGNodeRef parent = n->yogaNode;
 
-        if (n->type == "text") {
-          YGNodeSetMeasureFunc(yogaNode, textMeasure);
+        for (size_t i = 0; i < n->children.size(); i++) {
+          YGNodeRef want = outerNode(n->children[i]);
+          if (i < YGNodeGetChildCount(parent) && YGNodeGetChild(parent, i) == want) continue;
+
+          if (YGNodeRef owner = YGNodeGetOwner(want)) {
+            YGNodeRemoveChild(owner, want);
+          }
+          YGNodeInsertChild(parent, want, i);
+        }
+
+        // freed children already detached themselves, this only catches
+        // nodes that were moved to another parent or split into a boundary
+        while (YGNodeGetChildCount(parent) > n->children.size()) {
+          YGNodeRemoveChild(parent, YGNodeGetChild(parent, YGNodeGetChildCount(parent) - 1));
+        }
+      }
+
+      // Every property is written, including the "unset" ones, because the
+      // Yoga node outlives the style it was first built from. Yoga ignores
+      // writes of an unchanged value, so only real changes dirty the node.
+      // `outer` is how the node sits in its parent, `inner` how it lays out
+      // its own content; a boundary splits them between proxy and root.
+      void applyStyle(Node* n, YGNodeRef yogaNode, bool outer, bool inner) {
+        if (outer) {
+          if (n->position == PositionType::Absolute) {
+            YGNodeStyleSetPositionType(yogaNode, YGPositionTypeAbsolute);
+          } else {
+            YGNodeStyleSetPositionType(yogaNode, YGPositionTypeRelative);
+          }
+
+          YGNodeStyleSetPosition(yogaNode, YGEdgeLeft, n->hasLeft ? n->leftVal : YGUndefined);
+          YGNodeStyleSetPosition(yogaNode, YGEdgeTop, n->hasTop ? n->topVal : YGUndefined);
+          YGNodeStyleSetPosition(yogaNode, YGEdgeRight, n->hasRight ? n->rightVal : YGUndefined);
+          YGNodeStyleSetPosition(yogaNode, YGEdgeBottom, n->hasBottom ? n->bottomVal : YGUndefined);
+
+          YGNodeStyleSetFlexGrow(yogaNode, n->flexGrow > 0 ? n->flexGrow : 0.0f);
+          YGNodeStyleSetFlexShrink(yogaNode, n->flexShrink >= 0 ? n->flexShrink : 0.0f);
+
+          if (n->widthStyle.isSet && n->widthStyle.type == PERCENT) {
+            YGNodeStyleSetWidthPercent(yogaNode, n->widthStyle.value);
+          } else if (n->widthStyle.isSet && n->widthStyle.value > 0) {
+            YGNodeStyleSetWidth(yogaNode, n->widthStyle.value);
+          } else if (n->parent) {
+            YGNodeStyleSetWidthAuto(yogaNode);
+          }
+
+          if (n->heightStyle.isSet && n->heightStyle.type == PERCENT) {
+            YGNodeStyleSetHeightPercent(yogaNode, n->heightStyle.value);
+          } else if (n->heightStyle.isSet && n->heightStyle.value > 0) {
+            YGNodeStyleSetHeight(yogaNode, n->heightStyle.value);
+          } else if (n->parent) {
+            YGNodeStyleSetHeightAuto(yogaNode);
+          }
+
+          YGNodeStyleSetMinWidth(yogaNode, n->minWidth);
+          YGNodeStyleSetMinHeight(yogaNode, n->minHeight);
+
+          YGNodeStyleSetMaxWidth(yogaNode, n->maxWidth < 99999 ? n->maxWidth : YGUndefined);
+          YGNodeStyleSetMaxHeight(yogaNode, n->maxHeight < 99999 ? n->maxHeight : YGUndefined);
+
+          YGNodeStyleSetMargin(yogaNode, YGEdgeTop, (float)n->marginTop);
+          YGNodeStyleSetMargin(yogaNode, YGEdgeBottom, (float)n->marginBottom);
+          YGNodeStyleSetMargin(yogaNode, YGEdgeLeft, (float)n->marginLeft);
+          YGNodeStyleSetMargin(yogaNode, YGEdgeRight, (float)n->marginRight);
+        }
+
+        if (!inner) return;
+
+        bool isText = n->type == "text";
+        if (isText != YGNodeHasMeasureFunc(yogaNode)) {
+          YGNodeSetMeasureFunc(yogaNode, isText ? textMeasure : nullptr);
+        }
+        if (isText) {
+          // text, font or wrapping may have changed under the same style
+          YGNodeMarkDirty(yogaNode);
         }
 
         if (n->type == "vbox") {
@@ -112,37 +366,6 @@ namespace Layout {
           YGNodeStyleSetFlexWrap(yogaNode, YGWrapNoWrap);
         }
 
-        if (n->flexGrow > 0) {
-          YGNodeStyleSetFlexGrow(yogaNode, n->flexGrow);
-        }
-
-        if (n->flexShrink >= 0) {
-          YGNodeStyleSetFlexShrink(yogaNode, n->flexShrink);
-        }
-
-        if (n->widthStyle.isSet) {
-          if (n->widthStyle.type == PERCENT) {
-            YGNodeStyleSetWidthPercent(yogaNode, n->widthStyle.value);
-          } else if (n->widthStyle.value > 0) {
-            YGNodeStyleSetWidth(yogaNode, n->widthStyle.value);
-          }
-        }
-
-        if (n->heightStyle.isSet) {
-          if (n->heightStyle.type == PERCENT) {
-            YGNodeStyleSetHeightPercent(yogaNode, n->heightStyle.value);
-          } else if (n->heightStyle.value > 0) {
-            YGNodeStyleSetHeight(yogaNode, n->heightStyle.value);
-          }
-        }
-
-
-        YGNodeStyleSetMinWidth(yogaNode, n->minWidth);
-        YGNodeStyleSetMinHeight(yogaNode, n->minHeight);
-
-        if (n->maxWidth < 99999) YGNodeStyleSetMaxWidth(yogaNode, n->maxWidth);
-        if (n->maxHeight < 99999) YGNodeStyleSetMaxHeight(yogaNode, n->maxHeight);
-
         YGNodeStyleSetAlignItems(yogaNode, mapAlign(n->alignItems));
         YGNodeStyleSetJustifyContent(yogaNode, mapJustify(n->justifyContent));
 
@@ -151,61 +374,67 @@ namespace Layout {
         YGNodeStyleSetPadding(yogaNode, YGEdgeLeft, (float)n->paddingLeft);
         YGNodeStyleSetPadding(yogaNode, YGEdgeRight, (float)n->paddingRight);
 
-        YGNodeStyleSetMargin(yogaNode, YGEdgeTop, (float)n->marginTop);
-        YGNodeStyleSetMargin(yogaNode, YGEdgeBottom, (float)n->marginBottom);
-        YGNodeStyleSetMargin(yogaNode, YGEdgeLeft, (float)n->marginLeft);
-        YGNodeStyleSetMargin(yogaNode, YGEdgeRight, (float)n->marginRight);
-
-        if (n->spacing > 0) {
-          YGNodeStyleSetGap(yogaNode, YGGutterAll, (float)n->spacing);
-        }
+        YGNodeStyleSetGap(yogaNode, YGGutterAll, n->spacing > 0 ? (float)n->spacing : 0.0f);
+      }
 
-        if (n->type == "text" && !n->children.empty()) {
-          std::cerr << "ERROR: Text Node (text='" 
-            << n->text.substr(0, 20) << (n->text.length() > 20 ? "..." : "") 
-            << "') cannot have children.\n";
-          exit(1);
-        } else {
-          for (size_t i = 0; i < n->children.size(); i++) {
-            YGNodeRef childYoga = buildTree(n->children[i]);
-            YGNodeInsertChild(yogaNode, childYoga, i);
+      // Copies Yoga's results back. A subtree is skipped when Yoga did not
+      // touch it and its origin did not move; its stored geometry is still
+      // current and is what the parent's content size is built from.
+      void applyLayout(Node* n, float parentX, float parentY, bool force) {
+        YGNodeRef outer = outerNode(n);
+        if (!outer) return;
+
+        float newX = parentX + YGNodeLayoutGetLeft(outer);
+        float newY = parentY + YGNodeLayoutGetTop(outer);
+        float newW = YGNodeLayoutGetWidth(outer);
+        float newH = YGNodeLayoutGetHeight(outer);
+        bool moved = newX != n->x || newY != n->y;
+        bool hasNewLayout = YGNodeGetHasNewLayout(outer);
+        YGNodeSetHasNewLayout(outer, false);
+
+        if (n->yogaProxy) {
+          // solve the standalone subtree at the size the parent gave it
+          YGNodeStyleSetWidth(n->yogaNode, newW);
+          YGNodeStyleSetHeight(n->yogaNode, newH);
+          if (YGNodeIsDirty(n->yogaNode)) {
+            YGNodeCalculateLayout(n->yogaNode, newW, newH, YGDirectionLTR);
           }
+          hasNewLayout = YGNodeGetHasNewLayout(n->yogaNode) || hasNewLayout;
+          YGNodeSetHasNewLayout(n->yogaNode, false);
         }
 
-        return yogaNode;
-      }
+        if (!force && !moved && !hasNewLayout) return;
 
-      void applyLayout(Node* n, YGNodeRef yogaNode, float parentX, float parentY) {
+        bool resized = newW != n->w || newH != n->h;
 
-        if (!n || !yogaNode) return;
+        // damages the old box; regenerating the node damages the new one.
+        // Nodes that kept their box keep their display lists.
+        if (moved || resized) n->makePaintDirty();
 
-        float relX = YGNodeLayoutGetLeft(yogaNode);
-        float relY = YGNodeLayoutGetTop(yogaNode);
-
-        n->x = parentX + relX;
-        n->y = parentY + relY;
-        n->w = YGNodeLayoutGetWidth(yogaNode);
-        n->h = YGNodeLayoutGetHeight(yogaNode);
+        n->x = newX;
+        n->y = newY;
+        n->w = newW;
+        n->h = newH;
 
         float maxChildBottom = 0.0f;
         float maxChildRight = 0.0f;
 
-        for (size_t i = 0; i < n->children.size(); i++) {
-          YGNodeRef childNode = YGNodeGetChild(yogaNode, i);
-
-          float childRelX = YGNodeLayoutGetLeft(childNode);
-          float childRelY = YGNodeLayoutGetTop(childNode);
-          float childW = YGNodeLayoutGetWidth(childNode);
-          float childH = YGNodeLayoutGetHeight(childNode);
+        for (Node* c : n->children) {
+          applyLayout(c, n->x, n->y, false);
 
-          maxChildRight = std::max(maxChildRight, childRelX + childW);
-          maxChildBottom = std::max(maxChildBottom, childRelY + childH);
+          float childTrueW = std::max(c->w, c->contentW);
+          float childTrueH = std::max(c->h, c->contentH);
 
-          applyLayout(n->children[i], childNode, n->x , n->y );
+          maxChildRight = std::max(maxChildRight, (c->x - n->x) + childTrueW);
+          maxChildBottom = std::max(maxChildBottom, (c->y - n->y) + childTrueH);
         }
 
-        n->contentW = maxChildRight + n->paddingRight;
-        n->contentH = maxChildBottom + n->paddingBottom;
+        if (n->type == "text") {
+          if (resized || hasNewLayout || n->textState->computedLines.empty()) computeTextLayout(n);
+        } else {
+          n->contentW = maxChildRight + n->paddingRight;
+          n->contentH = maxChildBottom + n->paddingBottom;
+        }
       }
 
       YGAlign mapAlign(Align a) {
@@ -0,0 +1,333 @@
+#include "http_cache.h"
+#include <curl/curl.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+#include <vector>
+#include "../../components/database/kv_cache.h"
+#include "../../components/system/pathUtils.h"
+
+namespace HttpCache {
+  static const char* INDEX_PREFIX = "httpcache:";
+  // earlier builds keyed the index by the raw request, cookies included
+  static const char* LEGACY_INDEX_PREFIX = "http_cache:";
+  static const char* INDEX_VERSION = "v1";
+
+  // bodies past this total are pruned oldest first, down to 3/4 of it
+  static constexpr uintmax_t MAX_BODY_BYTES = 64ull * 1024 * 1024;
+  // entries untouched this long are dropped whatever the total
+  static constexpr int64_t MAX_ENTRY_AGE = 30 * 24 * 60 * 60;
+
+  static std::filesystem::path bodyDirectory() {
+    return Vulpis::getCacheDirectory() / "http_cache";
+  }
+
+  static std::filesystem::path bodyPath(const std::string& key) {
+    return bodyDirectory() / (key + ".body");
+  }
+
+  // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+  // ╏ SHA-256 OF A KEY ╏
+  // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+  // The key material carries cookies and Authorization headers; only its
+  // digest reaches the (unencrypted) index and the body file names.
+
+  static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+  static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+  static void sha256Block(uint32_t state[8], const unsigned char* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+      w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+             ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+      uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+      uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+
+  static std::string sha256Hex(const std::string& data) {
+    uint32_t state[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    size_t full = data.size() / 64 * 64;
+    for (size_t i = 0; i < full; i += 64) {
+      sha256Block(state, reinterpret_cast<const unsigned char*>(data.data()) + i);
+    }
+
+    // the tail, a 0x80 marker and the bit length, in one or two blocks
+    unsigned char tail[128] = {};
+    size_t rest = data.size() - full;
+    std::memcpy(tail, data.data() + full, rest);
+    tail[rest] = 0x80;
+    size_t tailLen = rest < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)data.size() * 8;
+    for (int i = 0; i < 8; i++) tail[tailLen - 1 - i] = (unsigned char)(bits >> (i * 8));
+    for (size_t i = 0; i < tailLen; i += 64) sha256Block(state, tail + i);
+
+    static const char* hex = "0123456789abcdef";
+    std::string out;
+    out.reserve(64);
+    for (uint32_t word : state) {
+      for (int shift = 28; shift >= 0; shift -= 4) out += hex[(word >> shift) & 0xf];
+    }
+    return out;
+  }
+
+  // ┏╍╍╍╍╍╍╍╍╍┓
+  // ╏ PRUNING ╏
+  // ┗╍╍╍╍╍╍╍╍╍┛
+  // Every entry has a body file named after its key, so the folder is the
+  // list of entries. Hits touch their body, which makes the oldest
+  // modification time the least recently used entry.
+
+  static bool scanned = false;
+  static uintmax_t bodyBytes = 0;
+
+  static void prune(uintmax_t targetBytes) {
+    namespace fs = std::filesystem;
+    struct BodyFile {
+      fs::path path;
+      fs::file_time_type touched;
+      uintmax_t size;
+    };
+    std::vector<BodyFile> files;
+
+    std::error_code ec;
+    auto oldest = fs::file_time_type::clock::now() - std::chrono::seconds(MAX_ENTRY_AGE);
+    bodyBytes = 0;
+    for (fs::directory_iterator it(bodyDirectory(), ec), end; !ec && it != end; it.increment(ec)) {
+      const fs::path& path = it->path();
+      std::string key = path.stem().string();
+      bool ours = path.extension() == ".body" && key.size() == 64;
+      std::error_code timeEc, sizeEc;
+      fs::file_time_type touched = it->last_write_time(timeEc);
+      uintmax_t size = it->file_size(sizeEc);
+      if (timeEc || sizeEc || !ours || touched < oldest) {
+        // expired, or a stray (temp file, older naming scheme)
+        if (ours) KVCache::Delete(INDEX_PREFIX + key);
+        fs::remove(path, ec);
+        ec.clear();
+        continue;
+      }
+      files.push_back({path, touched, size});
+      bodyBytes += size;
+    }
+
+    if (bodyBytes <= targetBytes) return;
+    std::sort(files.begin(), files.end(), [](const BodyFile& a, const BodyFile& b) { return a.touched < b.touched; });
+    for (const BodyFile& file : files) {
+      if (bodyBytes <= targetBytes) break;
+      KVCache::Delete(INDEX_PREFIX + file.path.stem().string());
+      fs::remove(file.path, ec);
+      bodyBytes -= file.size;
+    }
+  }
+
+  // the first use in a run drops expired entries and the legacy index
+  static void scanOnce() {
+    if (scanned) return;
+    scanned = true;
+    KVCache::DeletePrefix(LEGACY_INDEX_PREFIX);
+    prune(MAX_BODY_BYTES);
+  }
+
+  static std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+  }
+
+  std::string KeyFor(const std::string& url, const std::map<std::string, std::string>& headers, const std::string& cookies) {
+    std::string material = url;
+    for (const auto& kv : headers) {
+      material += "\n" + kv.first + ": " + kv.second;
+    }
+    if (!cookies.empty()) material += "\nCookie: " + cookies;
+    return sha256Hex(material);
+  }
+
+  int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  bool IsFresh(const Entry& entry, int64_t now) {
+    return now - entry.storedAt < entry.maxAge;
+  }
+
+  void ReadHeader(const std::string& name, const std::string& value, Directives& out) {
+    if (name == "cache-control") {
+      std::stringstream ss(value);
+      std::string token;
+      while (std::getline(ss, token, ',')) {
+        token = trim(token);
+        std::transform(token.begin(), token.end(), token.begin(), ::tolower);
+
+        if (token == "no-store") {
+          out.noStore = true;
+        } else if (token == "no-cache") {
+          out.noCache = true;
+        } else if (token.rfind("max-age=", 0) == 0) {
+          std::string seconds = token.substr(8);
+          seconds.erase(std::remove(seconds.begin(), seconds.end(), '"'), seconds.end());
+          out.hasMaxAge = true;
+          out.maxAge = std::strtoll(seconds.c_str(), nullptr, 10);
+        }
+      }
+    } else if (name == "vary") {
+      // varies on something outside the request headers
+      if (value.find('*') != std::string::npos) out.varyAll = true;
+    } else if (name == "etag") {
+      out.etag = value;
+    } else if (name == "last-modified") {
+      out.lastModified = value;
+    } else if (name == "expires") {
+      // an unparseable Expires means already expired
+      time_t t = curl_getdate(value.c_str(), nullptr);
+      out.expires = t < 0 ? 0 : (int64_t)t;
+    } else if (name == "date") {
+      time_t t = curl_getdate(value.c_str(), nullptr);
+      if (t >= 0) out.date = t;
+    }
+  }
+
+  bool ApplyDirectives(const Directives& directives, int64_t now, Entry& entry) {
+    if (directives.noStore || directives.varyAll) return false;
+
+    int64_t lifetime = 0;
+    if (directives.noCache) {
+      lifetime = 0;
+    } else if (directives.hasMaxAge) {
+      lifetime = directives.maxAge;
+    } else if (directives.expires >= 0) {
+      lifetime = directives.expires - (directives.date >= 0 ? directives.date : now);
+    }
+
+    entry.storedAt = now;
+    entry.maxAge = std::max<int64_t>(lifetime, 0);
+    // a 304 may leave the validators out; the stored ones still hold
+    if (!directives.etag.empty()) entry.etag = directives.etag;
+    if (!directives.lastModified.empty()) entry.lastModified = directives.lastModified;
+    return true;
+  }
+
+  bool Load(const std::string& key, Entry& entry, std::string* body) {
+    scanOnce();
+    bool found = false;
+    std::string index = KVCache::Get(INDEX_PREFIX + key, found);
+    if (!found) return false;
+
+    std::stringstream ss(index);
+    std::string version, status, storedAt, maxAge;
+    std::getline(ss, version);
+    std::getline(ss, status);
+    std::getline(ss, storedAt);
+    std::getline(ss, maxAge);
+    std::getline(ss, entry.etag);
+    std::getline(ss, entry.lastModified);
+    if (version != INDEX_VERSION) return false;
+
+    entry.statusCode = std::atoi(status.c_str());
+    entry.storedAt = std::strtoll(storedAt.c_str(), nullptr, 10);
+    entry.maxAge = std::strtoll(maxAge.c_str(), nullptr, 10);
+
+    if (!body) return true;
+
+    std::ifstream file(bodyPath(key), std::ios::binary | std::ios::ate);
+    if (!file) {
+      // the index outlived its body (cache folder cleared by hand)
+      Remove(key);
+      return false;
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    body->resize(size);
+    if (!file.read(body->data(), size)) return false;
+
+    // a hit counts as a use for pruning
+    std::error_code ec;
+    std::filesystem::last_write_time(bodyPath(key), std::filesystem::file_time_type::clock::now(), ec);
+    return true;
+  }
+
+  bool Store(const std::string& key, const Entry& entry, const std::string* body) {
+    scanOnce();
+    if (body) {
+      namespace fs = std::filesystem;
+      fs::path path = bodyPath(key);
+      std::error_code sizeEc;
+      uintmax_t replaced = fs::file_size(path, sizeEc);
+      if (!sizeEc) bodyBytes -= std::min(bodyBytes, replaced);
+      fs::path tmpPath = path;
+      tmpPath += ".tmp";
+
+      std::error_code ec;
+      fs::create_directories(path.parent_path(), ec);
+      {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(body->data(), body->size())) {
+          std::cerr << "[HttpCache Error] Unable to write " << tmpPath.string() << std::endl;
+          return false;
+        }
+      }
+      // readers never see a half-written body
+      fs::rename(tmpPath, path, ec);
+      if (ec) {
+        std::cerr << "[HttpCache Error] " << ec.message() << std::endl;
+        return false;
+      }
+
+      bodyBytes += body->size();
+      if (bodyBytes > MAX_BODY_BYTES) prune(MAX_BODY_BYTES / 4 * 3);
+    }
+
+    std::string index = std::string(INDEX_VERSION) + "\n" +
+      std::to_string(entry.statusCode) + "\n" +
+      std::to_string(entry.storedAt) + "\n" +
+      std::to_string(entry.maxAge) + "\n" +
+      entry.etag + "\n" +
+      entry.lastModified;
+    return KVCache::Set(INDEX_PREFIX + key, index);
+  }
+
+  void Remove(const std::string& key) {
+    KVCache::Delete(INDEX_PREFIX + key);
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(bodyPath(key), ec);
+    if (!ec) bodyBytes -= std::min(bodyBytes, size);
+    std::filesystem::remove(bodyPath(key), ec);
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Opt-in cache for GET responses (fetch with `cache = true`). The index
+// lives in KVCache, bodies in their own files under the cache directory,
+// both named by a SHA-256 of the key material. Bodies are capped in total
+// size and age, least recently used first. Only the HTTP I/O thread uses it.
+namespace HttpCache {
+  struct Entry {
+    int statusCode = 0;
+    int64_t storedAt = 0; // unix seconds
+    int64_t maxAge = 0;   // seconds the entry is fresh for after storedAt
+    std::string etag;
+    std::string lastModified;
+  };
+
+  // what a response said about caching itself, gathered header by header
+  struct Directives {
+    bool noStore = false;
+    bool noCache = false;
+    bool varyAll = false;
+    bool hasMaxAge = false;
+    int64_t maxAge = 0;
+    int64_t expires = -1;
+    int64_t date = -1;
+    std::string etag;
+    std::string lastModified;
+  };
+
+  // a request is cached per URL and every header it sends: the Lua ones
+  // and the cookies from the jar. Responses fetched with different
+  // credentials never answer each other, and whatever a Vary names is
+  // already part of the key. Returns a hex digest, never the material.
+  std::string KeyFor(const std::string& url, const std::map<std::string, std::string>& headers, const std::string& cookies);
+
+  int64_t Now();
+  bool IsFresh(const Entry& entry, int64_t now);
+
+  // `name` lower case; anything that isn't a caching header is ignored
+  void ReadHeader(const std::string& name, const std::string& value, Directives& out);
+  // fills the freshness and validators from a response; false for
+  // no-store and Vary: *
+  bool ApplyDirectives(const Directives& directives, int64_t now, Entry& entry);
+
+  // `body` may be null to read or write the index only
+  bool Load(const std::string& key, Entry& entry, std::string* body);
+  bool Store(const std::string& key, const Entry& entry, const std::string* body);
+  void Remove(const std::string& key);
+}
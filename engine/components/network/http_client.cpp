@@ -1,29 +1,26 @@
 #include <SDL2/SDL.h>
 #include "http_client.h"
-#include <codecvt>
-#include <cpr/api.h>
-#include <cpr/body.h>
-#include <cpr/cookies.h>
-#include <cpr/cprtypes.h>
-#include <cpr/session.h>
-#include <cpr/status_codes.h>
-#include <cstddef>
-#include <ios>
-#include <iterator>
+#include "http_cache.h"
+#include <curl/curl.h>
 #include <lauxlib.h>
 #include <lua.h>
 #include <mutex>
-#include <queue>
-#include <stdexcept>
 #include <string>
 #include <thread>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <unordered_map>
 #include <iostream>
-#include <cpr/cpr.h>
 #include <utility>
 #include <vector>
 #include <map>
 #include <algorithm>
+#include <limits>
+#include <cctype>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <sstream>
 #include "../../components/system/secure_storage.h"
 
@@ -34,163 +31,778 @@ std::vector<HttpResponse> HttpClient::responseQueue;
 std::mutex HttpClient::queueMutex;
 std::atomic<bool> HttpClient::isShuttingDown(false);
 
-static std::mutex g_cookieMutex;
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ HTTP I/O THREAD STATE        ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// One thread drives every request through a single curl multi handle.
+// Connections stay open in the multi's cache between requests, so a burst
+// of calls to the same API reuses a warm TLS connection, and HTTP/2
+// servers get all of them multiplexed on one.
+
+// in-flight transfers per host; the rest wait their turn in order
+static constexpr size_t MAX_PER_HOST = 6;
+// connections kept warm across all hosts
+static constexpr long MAX_CACHED_CONNECTIONS = 32;
+// cookie changes are written out once they have been quiet this long
+static constexpr std::chrono::milliseconds COOKIE_FLUSH_DELAY(2000);
+static const char* COOKIE_FILE = "secure_session.dat";
+// a stream pauses its transfer once Lua is this many bytes behind, and
+// resumes when it has caught up to half
+static constexpr size_t STREAM_BACKLOG_LIMIT = 1 << 20;
+static constexpr std::chrono::milliseconds PROGRESS_INTERVAL(100);
+// streams and downloads have no overall deadline unless asked for; they
+// only give up on a slow connect or a connection quiet for a minute
+// (SSE servers send keep-alive comments well within that)
+static constexpr long STREAM_CONNECT_TIMEOUT_MS = 10000;
+static constexpr long STREAM_STALL_SECONDS = 60;
+
+struct PendingRequest {
+  std::string url;
+  std::string method;
+  long timeout; // whole transfer, ms; 0 for none
+  std::string body;
+  std::map<std::string, std::string> headers;
+  int luaCallbackRef;
+  bool useCache;
+  HttpStreamOptions stream;
+};
+
+struct Transfer {
+  PendingRequest request;
+  std::string host;
+  CURL* easy = nullptr;
+  curl_slist* headerList = nullptr;
+  std::string responseBody;
+  std::vector<std::pair<std::string, std::string>> cookies;
+  char errorBuffer[CURL_ERROR_SIZE] = {};
+
+  // set when the response goes through the cache
+  std::string cacheKey;
+  // the jar's cookies when the key was made; sent as they were so the
+  // response matches the key it is stored under
+  std::string keyCookies;
+  bool revalidating = false;
+  HttpCache::Entry cached;
+  size_t cachedBodyHash = 0;
+  HttpCache::Directives directives;
+
+  // streams and downloads; curl callbacks add to `events`, the loop hands
+  // them to the main thread
+  std::vector<HttpResponse> events;
+  std::shared_ptr<std::atomic<size_t>> backlog;
+  bool paused = false;
+  std::string lineBuffer;
+  std::string sseData;
+  std::string sseEvent;
+  std::string sseId;
+  bool sseHasData = false;
+  std::ofstream file;
+  curl_off_t lastReported = 0;
+  std::chrono::steady_clock::time_point lastProgress;
+};
+
+static CURLM* g_multi = nullptr;
+static CURLSH* g_share = nullptr;
+static std::thread g_loopThread;
+
+// handed from FetchAsync to the I/O thread
+static std::mutex g_submitMutex;
+static std::vector<PendingRequest> g_submitted;
+
+// everything below is owned by the I/O thread while it runs
+static std::unordered_map<std::string, std::deque<std::unique_ptr<Transfer>>> g_waiting;
+static std::unordered_map<std::string, size_t> g_activePerHost;
+static std::unordered_map<CURL*, std::unique_ptr<Transfer>> g_active;
+// finished easy handles keep their TLS session and DNS state for the next one
+static std::vector<CURL*> g_idleHandles;
+static std::string g_caBundle;
+
+// domain -> name -> value, loaded once and written back behind the requests
+static std::map<std::string, std::map<std::string, std::string>> g_cookieJar;
+static bool g_cookiesDirty = false;
+static std::chrono::steady_clock::time_point g_cookiesChangedAt;
+
+static std::string hostOf(const std::string& url) {
+  size_t protocalPos = url.find("://");
+  if (protocalPos == std::string::npos) return url;
+  size_t start = protocalPos + 3;
+  size_t end = url.find_first_of("/?#", start);
+  return url.substr(start, end - start);
+}
 
-void HttpClient::Init() {
-  isShuttingDown = false;
+static std::string findCaBundle() {
+#if defined(_WIN32)
+  const char* certPaths[] = { "cacert.pem", "curl-ca-bundle.crt" };
+#elif defined(__APPLE__)
+  const char* certPaths[] = { "/etc/ssl/cert.pem", "/usr/local/etc/openssl/cert.pem", "/opt/homebrew/etc/openssl/cert.pem" };
+#else 
+  const char* certPaths[] = {
+    "/etc/ssl/certs/ca-certificates.crt", "/etc/pki/tls/certs/ca-bundle.crt", 
+    "/etc/ssl/ca-bundle.pem", "/etc/pki/tls/cacert.pem", "/etc/ssl/certs/ca-bundle.crt"
+  };
+#endif
+
+  for (const char* cert : certPaths) {
+    if (std::filesystem::exists(cert)) return cert;
+  }
+  return "";
 }
 
-void HttpClient::ShutDown() {
-  isShuttingDown = true;
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ COOKIE JAR          ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+static void loadCookies() {
+  g_cookieJar.clear();
+  std::string decryptedData;
+  if (!Vulpis::SecureStorage::Load(COOKIE_FILE, decryptedData)) return;
+
+  std::stringstream ss(decryptedData);
+  std::string line;
+  while (std::getline(ss, line)) {
+    if (line.empty()) {
+      continue;
+    }
+
+    size_t firstTab = line.find('\t');
+    size_t secondTab = line.find('\t', firstTab + 1);
+
+    if (firstTab != std::string::npos && secondTab != std::string::npos) {
+      std::string savedDomain = line.substr(0, firstTab);
+      std::string key = line.substr(firstTab + 1, secondTab - firstTab - 1);
+      std::string val = line.substr(secondTab + 1);
+
+      g_cookieJar[savedDomain][key] = val;
+    }
+  }
 }
 
+static void saveCookies() {
+  std::stringstream ss;
+  for (const auto& domainPair : g_cookieJar) {
+    for (const auto& cookiePair : domainPair.second) {
+      ss << domainPair.first << "\t" << cookiePair.first << "\t" << cookiePair.second << "\n";
+    }
+  }
 
-void HttpClient::FetchAsync(const std::string &url, const std::string &method, long timeout, const std::string &body,
-    const std::map<std::string, std::string> &headers, int luaCallbackRef) {
-  std::thread([url, method, timeout, body, headers, luaCallbackRef]() {
-      cpr::Session session;
-      session.SetUrl(cpr::Url{url});
-      session.SetTimeout(std::chrono::milliseconds(timeout));
+  Vulpis::SecureStorage::Save(COOKIE_FILE, ss.str());
+  g_cookiesDirty = false;
+}
 
-#if defined(_WIN32)
-      const char* certPaths[] = { "cacert.pem", "curl-ca-bundle.crt" };
-#elif defined(__APPLE__)
-      const char* certPaths[] = { "/etc/ssl/cert.pem", "/usr/local/etc/openssl/cert.pem", "/opt/homebrew/etc/openssl/cert.pem" };
-#else 
-      const char* certPaths[] = {
-      "/etc/ssl/certs/ca-certificates.crt", "/etc/pki/tls/certs/ca-bundle.crt", 
-      "/etc/ssl/ca-bundle.pem", "/etc/pki/tls/cacert.pem", "/etc/ssl/certs/ca-bundle.crt"
-      };
-#endif
+static std::string cookieHeaderFor(const std::string& domain) {
+  std::string cookieHeaderStr;
+  auto it = g_cookieJar.find(domain);
+  if (it == g_cookieJar.end()) return cookieHeaderStr;
 
-      for (const char* cert : certPaths) {
-      if (std::filesystem::exists(cert)) {
-      session.SetOption(cpr::Ssl(cpr::ssl::CaInfo{cert}));
+  for (const auto& cookie : it->second) {
+    if (!cookieHeaderStr.empty()) {
+      cookieHeaderStr += "; ";
+    }
+    cookieHeaderStr += cookie.first + "=" + cookie.second;
+  }
+  return cookieHeaderStr;
+}
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ TRANSFERS           ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+static std::string trim(const std::string& s) {
+  size_t start = s.find_first_not_of(" \t\r\n");
+  if (start == std::string::npos) return "";
+  size_t end = s.find_last_not_of(" \t\r\n");
+  return s.substr(start, end - start + 1);
+}
+
+// the jar keeps the name and value of each Set-Cookie; cached requests
+// also collect what the response says about its own freshness
+static size_t onHeader(char* data, size_t size, size_t nmemb, void* user) {
+  Transfer* t = static_cast<Transfer*>(user);
+  size_t len = size * nmemb;
+  std::string line(data, len);
+
+  // a redirect or a 100 Continue starts another header block; only the
+  // last one describes the body
+  if (line.rfind("HTTP/", 0) == 0) {
+    t->directives = HttpCache::Directives();
+    return len;
+  }
+
+  size_t colon = line.find(':');
+  if (colon == std::string::npos) return len;
+  std::string name = trim(line.substr(0, colon));
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  std::string value = trim(line.substr(colon + 1));
+
+  if (name == "set-cookie") {
+    value = value.substr(0, value.find(';'));
+    size_t eq = value.find('=');
+    if (eq == std::string::npos) return len;
+
+    std::string cookieName = trim(value.substr(0, eq));
+    if (!cookieName.empty()) {
+      t->cookies.emplace_back(cookieName, trim(value.substr(eq + 1)));
+    }
+  } else if (!t->cacheKey.empty()) {
+    HttpCache::ReadHeader(name, value, t->directives);
+  }
+  return len;
+}
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ STREAMING           ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+static void emitPiece(Transfer& t, HttpEventKind kind, std::string data) {
+  HttpResponse ev;
+  ev.kind = kind;
+  ev.luaChunkRef = t.request.stream.luaChunkRef;
+  ev.backlog = t.backlog;
+  t.backlog->fetch_add(data.size());
+  ev.body = std::move(data);
+  t.events.push_back(std::move(ev));
+}
+
+static void readSseLine(Transfer& t, const std::string& line) {
+  if (line.empty()) {
+    // a blank line dispatches the event gathered so far
+    if (t.sseHasData) {
+      emitPiece(t, HttpEventKind::Event, std::move(t.sseData));
+      t.events.back().eventName = t.sseEvent.empty() ? "message" : t.sseEvent;
+      t.events.back().eventId = t.sseId;
+    }
+    t.sseData.clear();
+    t.sseEvent.clear();
+    t.sseHasData = false;
+    return;
+  }
+  if (line[0] == ':') return; // comment, often a keep-alive
+
+  size_t colon = line.find(':');
+  std::string field = line.substr(0, colon);
+  std::string value = colon == std::string::npos ? "" : line.substr(colon + 1);
+  if (!value.empty() && value[0] == ' ') value.erase(0, 1);
+
+  if (field == "data") {
+    if (t.sseHasData) t.sseData += '\n';
+    t.sseData += value;
+    t.sseHasData = true;
+  } else if (field == "event") {
+    t.sseEvent = value;
+  } else if (field == "id") {
+    // the last id sticks to the events after it
+    t.sseId = value;
+  }
+}
+
+static void takeLine(Transfer& t, std::string line) {
+  if (!line.empty() && line.back() == '\r') line.pop_back();
+
+  switch (t.request.stream.mode) {
+    case HttpStreamMode::SSE:
+      readSseLine(t, line);
       break;
-      }
-      }
+    case HttpStreamMode::NDJSON:
+      if (line.find_first_not_of(" \t") == std::string::npos) break;
+      emitPiece(t, HttpEventKind::Chunk, std::move(line));
+      break;
+    default:
+      emitPiece(t, HttpEventKind::Chunk, std::move(line));
+      break;
+  }
+}
 
-      cpr::Header cprHeaders;
-      for (const auto& kv : headers) {
-        cprHeaders[kv.first] = kv.second;
-      }
-      if (!body.empty() && cprHeaders.find("Content-Type") == cprHeaders.end()) {
-        cprHeaders["Content-Type"] = "application/json";
-      }
+static void readLines(Transfer& t, const char* data, size_t len) {
+  t.lineBuffer.append(data, len);
 
-      std::string domain = "";
-      size_t protocalPos = url.find("://");
-      if (protocalPos != std::string::npos) {
-        size_t start = protocalPos + 3;
-        size_t end = url.find_first_of("/?#", start);
-        domain = url.substr(start, end - start);
+  size_t start = 0;
+  size_t nl;
+  while ((nl = t.lineBuffer.find('\n', start)) != std::string::npos) {
+    takeLine(t, t.lineBuffer.substr(start, nl - start));
+    start = nl + 1;
+  }
+  t.lineBuffer.erase(0, start);
+}
+
+static size_t onBody(char* data, size_t size, size_t nmemb, void* user) {
+  Transfer* t = static_cast<Transfer*>(user);
+  size_t len = size * nmemb;
+
+  switch (t->request.stream.mode) {
+    case HttpStreamMode::Buffer:
+      t->responseBody.append(data, len);
+      return len;
+
+    case HttpStreamMode::Download:
+      // a short count aborts the transfer with CURLE_WRITE_ERROR
+      if (!t->file.write(data, len)) return 0;
+      return len;
+
+    default:
+      // nothing is consumed while paused; curl hands the same data back
+      // once the loop resumes the transfer
+      if (t->backlog->load() >= STREAM_BACKLOG_LIMIT) {
+        t->paused = true;
+        return CURL_WRITEFUNC_PAUSE;
+      }
+      if (t->request.stream.mode == HttpStreamMode::Chunk) {
+        emitPiece(*t, HttpEventKind::Chunk, std::string(data, len));
       } else {
-        domain = url;
+        readLines(*t, data, len);
       }
+      return len;
+  }
+}
 
-      std::string cookieHeaderStr = "";
-      {
-        std::lock_guard<std::mutex> lock(g_cookieMutex);
-
-        std::string decryptedData;
-        if (Vulpis::SecureStorage::Load("secure_session.dat", decryptedData)) {
-          std::stringstream ss(decryptedData);
-          std::string line;
-
-          while (std::getline(ss, line)) {
-            if (line.empty()) {
-              continue;
-            }
-
-            size_t firstTab = line.find('\t');
-            size_t secondTab = line.find('\t', firstTab + 1);
-
-            if (firstTab != std::string::npos && secondTab != std::string::npos) {
-              std::string savedDomain = line.substr(0, firstTab);
-              std::string key = line.substr(firstTab + 1, secondTab - firstTab - 1);
-              std::string val = line.substr(secondTab + 1);
-
-              if (savedDomain == domain) {
-                if (!cookieHeaderStr.empty()) {
-                  cookieHeaderStr += "; ";
-                }
-                cookieHeaderStr += key + "=" + val;
-              }
-            }
-          }
-        }
-      }
+static void emitProgress(Transfer& t, curl_off_t received, curl_off_t total) {
+  t.lastReported = received;
+  t.lastProgress = std::chrono::steady_clock::now();
+
+  HttpResponse ev;
+  ev.kind = HttpEventKind::Progress;
+  ev.luaProgressRef = t.request.stream.luaProgressRef;
+  ev.received = received;
+  ev.total = total;
+  t.events.push_back(std::move(ev));
+}
+
+static int onProgress(void* user, curl_off_t dltotal, curl_off_t dlnow, curl_off_t, curl_off_t) {
+  Transfer* t = static_cast<Transfer*>(user);
+  if (dlnow == t->lastReported) return 0;
+  if (std::chrono::steady_clock::now() - t->lastProgress < PROGRESS_INTERVAL) return 0;
+  emitProgress(*t, dlnow, dltotal);
+  return 0;
+}
+
+static void resumePaused() {
+  for (auto& pair : g_active) {
+    Transfer& t = *pair.second;
+    if (t.paused && t.backlog->load() < STREAM_BACKLOG_LIMIT / 2) {
+      t.paused = false;
+      curl_easy_pause(t.easy, CURLPAUSE_CONT);
+    }
+  }
+}
+
+static void drainEvents(Transfer& t, std::vector<HttpResponse>& out) {
+  for (auto& ev : t.events) out.push_back(std::move(ev));
+  t.events.clear();
+}
+
+static std::string partPath(const std::string& path) {
+  return path + ".part";
+}
 
-      if (!cookieHeaderStr.empty()) cprHeaders["Cookie"] = cookieHeaderStr;
-      if (!body.empty()) session.SetBody(cpr::Body{body});
-      if (!cprHeaders.empty()) session.SetHeader(cprHeaders);
+static void startTransfer(std::unique_ptr<Transfer> t) {
+  CURL* easy;
+  if (!g_idleHandles.empty()) {
+    easy = g_idleHandles.back();
+    g_idleHandles.pop_back();
+  } else {
+    easy = curl_easy_init();
+  }
+  t->easy = easy;
+
+  const PendingRequest& req = t->request;
+  curl_easy_setopt(easy, CURLOPT_URL, req.url.c_str());
+  if (req.timeout > 0) curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, req.timeout);
+  if (req.stream.mode != HttpStreamMode::Buffer) {
+    // curl skips the speed check while backpressure has the transfer paused
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, STREAM_CONNECT_TIMEOUT_MS);
+    curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, STREAM_STALL_SECONDS);
+  }
+  curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+  curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  // wait for a connection that can multiplex instead of opening another
+  curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+  curl_easy_setopt(easy, CURLOPT_SHARE, g_share);
+  if (!g_caBundle.empty()) curl_easy_setopt(easy, CURLOPT_CAINFO, g_caBundle.c_str());
+
+  curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, t->errorBuffer);
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, onBody);
+  curl_easy_setopt(easy, CURLOPT_WRITEDATA, t.get());
+  curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, onHeader);
+  curl_easy_setopt(easy, CURLOPT_HEADERDATA, t.get());
+
+  bool hasContentType = false;
+  for (const auto& kv : req.headers) {
+    if (kv.first == "Content-Type") hasContentType = true;
+    t->headerList = curl_slist_append(t->headerList, (kv.first + ": " + kv.second).c_str());
+  }
+  if (!req.body.empty() && !hasContentType) {
+    t->headerList = curl_slist_append(t->headerList, "Content-Type: application/json");
+  }
+  std::string cookieHeaderStr = t->cacheKey.empty() ? cookieHeaderFor(t->host) : t->keyCookies;
+  if (!cookieHeaderStr.empty()) {
+    t->headerList = curl_slist_append(t->headerList, ("Cookie: " + cookieHeaderStr).c_str());
+  }
+  if (t->revalidating) {
+    if (!t->cached.etag.empty()) {
+      t->headerList = curl_slist_append(t->headerList, ("If-None-Match: " + t->cached.etag).c_str());
+    }
+    if (!t->cached.lastModified.empty()) {
+      t->headerList = curl_slist_append(t->headerList, ("If-Modified-Since: " + t->cached.lastModified).c_str());
+    }
+  }
+  if (t->headerList) curl_easy_setopt(easy, CURLOPT_HTTPHEADER, t->headerList);
+
+  const HttpStreamOptions& stream = req.stream;
+  if (stream.mode == HttpStreamMode::Download) {
+    std::error_code ec;
+    std::filesystem::path target(stream.downloadPath);
+    if (target.has_parent_path()) std::filesystem::create_directories(target.parent_path(), ec);
+    // written beside the target and renamed once complete
+    t->file.open(partPath(stream.downloadPath), std::ios::binary | std::ios::trunc);
+  } else if (stream.mode != HttpStreamMode::Buffer) {
+    t->backlog = std::make_shared<std::atomic<size_t>>(0);
+  }
+  if (stream.luaProgressRef != LUA_NOREF) {
+    curl_easy_setopt(easy, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(easy, CURLOPT_XFERINFOFUNCTION, onProgress);
+    curl_easy_setopt(easy, CURLOPT_XFERINFODATA, t.get());
+  }
 
-      cpr::Response r;
-      if (method == "POST") r = session.Post();
-      else if (method == "PUT") r = session.Put();
-      else if (method == "DELETE") r = session.Delete();
-      else if (method == "PATCH") r = session.Patch();
-      else r = session.Get();
+  const std::string& method = req.method;
+  bool knownMethod = method == "POST" || method == "PUT" || method == "DELETE" || method == "PATCH";
+  if (!req.body.empty()) {
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)req.body.size());
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDS, req.body.data());
+    if (method != "POST") curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, knownMethod ? method.c_str() : "GET");
+  } else if (method == "POST") {
+    curl_easy_setopt(easy, CURLOPT_POST, 1L);
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, 0L);
+  } else if (knownMethod) {
+    curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, method.c_str());
+  }
 
-      if (isShuttingDown) return;
+  g_activePerHost[t->host]++;
+  curl_multi_add_handle(g_multi, easy);
+  g_active[easy] = std::move(t);
+}
 
-      if (!r.cookies.empty()) {
-        std::lock_guard<std::mutex> lock(g_cookieMutex);
+static void startWaiting(const std::string& host) {
+  auto it = g_waiting.find(host);
+  if (it == g_waiting.end()) return;
 
-        std::map<std::string, std::map<std::string, std::string>> allCookies;
-        std::string decryptedData;
+  while (!it->second.empty() && g_activePerHost[host] < MAX_PER_HOST) {
+    std::unique_ptr<Transfer> t = std::move(it->second.front());
+    it->second.pop_front();
+    startTransfer(std::move(t));
+  }
+  if (it->second.empty()) g_waiting.erase(it);
+}
 
-        if (Vulpis::SecureStorage::Load("secure_session.dat", decryptedData)) {
-          std::stringstream ss(decryptedData);
-          std::string line;
-          while (std::getline(ss, line)) {
-            if (line.empty()) {
-              continue;
-            }
+static void releaseTransfer(Transfer& t, bool keepHandle) {
+  curl_multi_remove_handle(g_multi, t.easy);
+  curl_slist_free_all(t.headerList);
+  t.headerList = nullptr;
 
-            size_t firstTab = line.find('\t');
-            size_t secondTab = line.find('\t', firstTab + 1);
+  if (keepHandle) {
+    curl_easy_reset(t.easy);
+    g_idleHandles.push_back(t.easy);
+  } else {
+    curl_easy_cleanup(t.easy);
+  }
+  t.easy = nullptr;
+}
 
-            if (firstTab != std::string::npos && secondTab != std::string::npos) {
-              std::string savedDomain = line.substr(0, firstTab);
-              std::string key = line.substr(firstTab + 1, secondTab - firstTab - 1);
-              std::string val = line.substr(secondTab + 1);
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ RESPONSE CACHE      ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Looks the request up before it goes out. A fresh entry answers it on its
+// own; a stale one answers it right away and the request goes out anyway
+// as a conditional revalidation. Returns whether `hit` was filled.
+static bool lookupCache(Transfer& t, HttpResponse& hit) {
+  t.keyCookies = cookieHeaderFor(t.host);
+  t.cacheKey = HttpCache::KeyFor(t.request.url, t.request.headers, t.keyCookies);
+
+  std::string body;
+  if (!HttpCache::Load(t.cacheKey, t.cached, &body)) return false;
+
+  bool fresh = HttpCache::IsFresh(t.cached, HttpCache::Now());
+  if (!fresh) {
+    t.revalidating = true;
+    t.cachedBodyHash = std::hash<std::string>{}(body);
+  }
 
-              allCookies[savedDomain][key] = val;
-            }
-          }
-        }
+  hit.statusCode = t.cached.statusCode;
+  hit.body = std::move(body);
+  hit.luaCallbackRef = t.request.luaCallbackRef;
+  hit.fromCache = true;
+  hit.releaseCallback = fresh;
+  return true;
+}
 
-        for (const auto& cookie : r.cookies) {
-          allCookies[domain][cookie.GetName()] = cookie.GetValue();
-        }
+// stores or refreshes the entry once the network answered; a revalidation
+// only calls back again when the content actually changed
+static void updateCache(Transfer& t, CURLcode result, long status, HttpResponse& res) {
+  if (result != CURLE_OK) {
+    // the stale copy already went out; a failed refresh keeps it
+    if (t.revalidating) res.invokeCallback = false;
+    return;
+  }
+
+  // a response that sets cookies belongs to this session alone
+  if (!t.cookies.empty()) {
+    HttpCache::Remove(t.cacheKey);
+    if (status == 304 && t.revalidating) res.invokeCallback = false;
+    return;
+  }
 
-        std::stringstream ss;
-        for (const auto& domainPair : allCookies) {
-          for (const auto& cookiePair : domainPair.second) {
-            ss << domainPair.first << "\t" << cookiePair.first << "\t" << cookiePair.second << "\n";
-          }
+  int64_t now = HttpCache::Now();
+  if (status == 304 && t.revalidating) {
+    HttpCache::Entry entry = t.cached;
+    if (HttpCache::ApplyDirectives(t.directives, now, entry)) {
+      HttpCache::Store(t.cacheKey, entry, nullptr);
+    } else {
+      HttpCache::Remove(t.cacheKey);
+    }
+    res.invokeCallback = false;
+    return;
+  }
+
+  if (status != 200) {
+    if (status >= 400 && status < 500) HttpCache::Remove(t.cacheKey);
+    return;
+  }
+
+  HttpCache::Entry entry;
+  entry.statusCode = (int)status;
+  if (!HttpCache::ApplyDirectives(t.directives, now, entry)) {
+    HttpCache::Remove(t.cacheKey);
+    return;
+  }
+
+  bool unchanged = t.revalidating && std::hash<std::string>{}(res.body) == t.cachedBodyHash;
+  HttpCache::Store(t.cacheKey, entry, unchanged ? nullptr : &res.body);
+  if (unchanged) res.invokeCallback = false;
+}
+
+// queues the transfer's last stream pieces and its final response in `out`
+static void finishTransfer(CURL* easy, CURLcode result, std::vector<HttpResponse>& out) {
+  auto it = g_active.find(easy);
+  std::unique_ptr<Transfer> t = std::move(it->second);
+  g_active.erase(it);
+
+  long status = 0;
+  curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+
+  if (!t->cookies.empty()) {
+    auto& domainCookies = g_cookieJar[t->host];
+    for (auto& cookie : t->cookies) {
+      domainCookies[cookie.first] = std::move(cookie.second);
+    }
+    g_cookiesDirty = true;
+    g_cookiesChangedAt = std::chrono::steady_clock::now();
+  }
+
+  const HttpStreamOptions& stream = t->request.stream;
+  if (result == CURLE_OK) {
+    // a last line without a newline still counts; an unterminated SSE
+    // event does not
+    if (!t->lineBuffer.empty() && (stream.mode == HttpStreamMode::Lines || stream.mode == HttpStreamMode::NDJSON)) {
+      takeLine(*t, std::move(t->lineBuffer));
+    }
+    if (stream.luaProgressRef != LUA_NOREF) {
+      curl_off_t received = 0, total = 0;
+      curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD_T, &received);
+      curl_easy_getinfo(easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &total);
+      if (received != t->lastReported) emitProgress(*t, received, total < 0 ? 0 : total);
+    }
+  }
+  drainEvents(*t, out);
+
+  HttpResponse res;
+  res.statusCode = result == CURLE_OK ? (int)status : 0;
+  res.body = std::move(t->responseBody);
+  if (result != CURLE_OK) {
+    res.error = t->errorBuffer[0] ? t->errorBuffer : curl_easy_strerror(result);
+  }
+  res.luaCallbackRef = t->request.luaCallbackRef;
+  res.luaChunkRef = stream.luaChunkRef;
+  res.luaProgressRef = stream.luaProgressRef;
+
+  if (stream.mode == HttpStreamMode::Download) {
+    bool opened = t->file.is_open();
+    t->file.close();
+    std::error_code ec;
+    std::string part = partPath(stream.downloadPath);
+    if (result == CURLE_OK && status >= 200 && status < 300) {
+      std::filesystem::rename(part, stream.downloadPath, ec);
+      if (ec) res.error = ec.message();
+    } else {
+      std::filesystem::remove(part, ec);
+    }
+    if (!opened) res.error = "unable to write " + stream.downloadPath;
+    res.path = stream.downloadPath;
+  }
+
+  if (!t->cacheKey.empty()) updateCache(*t, result, status, res);
+
+  releaseTransfer(*t, true);
+
+  if (--g_activePerHost[t->host] == 0) g_activePerHost.erase(t->host);
+  startWaiting(t->host);
+  out.push_back(std::move(res));
+}
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ HTTP CLIENT         ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+void HttpClient::Init() {
+  isShuttingDown = false;
+
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  g_caBundle = findCaBundle();
+  loadCookies();
+
+  // the share handle is only used from the I/O thread, so it needs no locks
+  g_share = curl_share_init();
+  curl_share_setopt(g_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(g_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+
+  g_multi = curl_multi_init();
+  curl_multi_setopt(g_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(g_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)MAX_PER_HOST);
+  curl_multi_setopt(g_multi, CURLMOPT_MAXCONNECTS, MAX_CACHED_CONNECTIONS);
+
+  g_loopThread = std::thread(RunLoop);
+}
+
+void HttpClient::ShutDown() {
+  if (!g_multi) return;
+
+  isShuttingDown = true;
+  curl_multi_wakeup(g_multi);
+  if (g_loopThread.joinable()) g_loopThread.join();
+
+  // requests still in flight are dropped, as they were when the loader
+  // threads outlived the engine
+  for (auto& pair : g_active) {
+    Transfer& t = *pair.second;
+    releaseTransfer(t, false);
+    if (t.request.stream.mode == HttpStreamMode::Download) {
+      t.file.close();
+      std::error_code ec;
+      std::filesystem::remove(partPath(t.request.stream.downloadPath), ec);
+    }
+  }
+  g_active.clear();
+  g_waiting.clear();
+  g_activePerHost.clear();
+  for (CURL* easy : g_idleHandles) curl_easy_cleanup(easy);
+  g_idleHandles.clear();
+  {
+    std::lock_guard<std::mutex> lock(g_submitMutex);
+    g_submitted.clear();
+  }
+
+  if (g_cookiesDirty) saveCookies();
+
+  curl_multi_cleanup(g_multi);
+  g_multi = nullptr;
+  curl_share_cleanup(g_share);
+  g_share = nullptr;
+  curl_global_cleanup();
+}
+
+void HttpClient::PushResponses(std::vector<HttpResponse>& batch) {
+  if (batch.empty()) return;
+
+  std::lock_guard<std::mutex> lock(queueMutex);
+  for (auto& res : batch) responseQueue.push_back(std::move(res));
+  batch.clear();
+  SDL_Event s_event;
+  SDL_zero(s_event);
+  s_event.type = SDL_USEREVENT;
+  SDL_PushEvent(&s_event);
+}
+
+void HttpClient::RunLoop() {
+  std::vector<HttpResponse> outgoing;
+
+  while (!isShuttingDown) {
+    std::vector<PendingRequest> incoming;
+    {
+      std::lock_guard<std::mutex> lock(g_submitMutex);
+      incoming.swap(g_submitted);
+    }
+    for (auto& req : incoming) {
+      auto t = std::make_unique<Transfer>();
+      t->host = hostOf(req.url);
+      t->request = std::move(req);
+
+      bool buffered = t->request.stream.mode == HttpStreamMode::Buffer;
+      if (t->request.useCache && buffered && t->request.method == "GET") {
+        HttpResponse hit;
+        if (lookupCache(*t, hit)) {
+          bool fresh = hit.releaseCallback;
+          outgoing.push_back(std::move(hit));
+          if (fresh) continue;
         }
+      }
 
-        Vulpis::SecureStorage::Save("secure_session.dat", ss.str());
+      std::string host = t->host;
+      g_waiting[host].push_back(std::move(t));
+      startWaiting(host);
+    }
+
+    int running = 0;
+    curl_multi_perform(g_multi, &running);
+
+    // streams Lua has caught up with; ProcessQueue wakes the loop for this
+    resumePaused();
+    for (auto& pair : g_active) drainEvents(*pair.second, outgoing);
+
+    CURLMsg* msg;
+    int left = 0;
+    while ((msg = curl_multi_info_read(g_multi, &left))) {
+      if (msg->msg == CURLMSG_DONE) {
+        finishTransfer(msg->easy_handle, msg->data.result, outgoing);
+      }
+    }
+    PushResponses(outgoing);
+
+    // sleeps until a socket is ready, curl has a timer due, FetchAsync,
+    // ProcessQueue or ShutDown wakes it, or the cookie write comes due; with
+    // none of those pending an idle loop doesn't wake at all
+    long curlWaitMs = -1;
+    curl_multi_timeout(g_multi, &curlWaitMs);
+    int waitMs = curlWaitMs < 0 ? std::numeric_limits<int>::max()
+                                : (int)std::min<long>(curlWaitMs, std::numeric_limits<int>::max());
+    if (g_cookiesDirty) {
+      auto due = g_cookiesChangedAt + COOKIE_FLUSH_DELAY;
+      auto now = std::chrono::steady_clock::now();
+      if (now >= due) {
+        saveCookies();
+      } else {
+        int flushMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1;
+        waitMs = std::min(waitMs, flushMs);
       }
+    }
+    curl_multi_poll(g_multi, nullptr, 0, waitMs, nullptr);
+  }
+}
 
-      HttpResponse res;
-      res.statusCode = r.status_code;
-      res.body = r.text;
-      res.error = r.error.message;
-      res.luaCallbackRef = luaCallbackRef;
-
-      std::lock_guard<std::mutex> lock(queueMutex);
-      responseQueue.push_back(res);
-      SDL_Event s_event;
-      SDL_zero(s_event);
-      s_event.type = SDL_USEREVENT;
-      SDL_PushEvent(&s_event);
-  }).detach();
+void HttpClient::FetchAsync(const std::string &url, const std::string &method, long timeout, const std::string &body,
+    const std::map<std::string, std::string> &headers, int luaCallbackRef, bool useCache, const HttpStreamOptions& stream) {
+  if (!g_multi || isShuttingDown) return;
+
+  {
+    std::lock_guard<std::mutex> lock(g_submitMutex);
+    g_submitted.push_back({url, method, timeout, body, headers, luaCallbackRef, useCache, stream});
+  }
+  curl_multi_wakeup(g_multi);
 }
 
 
+static void callLua(lua_State* L, int nargs) {
+  if (lua_pcall(L, nargs, 0, 0) != LUA_OK) {
+    std::cerr << "[Net Error] Lua Callback failed: " << lua_tostring(L, -1) << std::endl;
+    lua_pop(L, 1);
+  }
+}
+
 bool HttpClient::ProcessQueue(lua_State *L) {
   std::vector<HttpResponse> localQueue;
 
@@ -203,26 +815,69 @@ bool HttpClient::ProcessQueue(lua_State *L) {
     responseQueue.clear();
   }
 
+  bool tookStream = false;
   for (const auto& res : localQueue) {
-    lua_rawgeti(L, LUA_REGISTRYINDEX, res.luaCallbackRef);
-    lua_newtable(L);
-    lua_pushinteger(L, res.statusCode);
-    lua_setfield(L, -2, "status");
+    if (res.kind == HttpEventKind::Chunk || res.kind == HttpEventKind::Event) {
+      lua_rawgeti(L, LUA_REGISTRYINDEX, res.luaChunkRef);
+      if (res.kind == HttpEventKind::Chunk) {
+        lua_pushlstring(L, res.body.c_str(), res.body.size());
+      } else {
+        lua_newtable(L);
+        lua_pushlstring(L, res.body.c_str(), res.body.size());
+        lua_setfield(L, -2, "data");
+        lua_pushstring(L, res.eventName.c_str());
+        lua_setfield(L, -2, "event");
+        lua_pushstring(L, res.eventId.c_str());
+        lua_setfield(L, -2, "id");
+      }
+      callLua(L, 1);
+
+      res.backlog->fetch_sub(res.body.size());
+      tookStream = true;
+      continue;
+    }
 
-    lua_pushlstring(L, res.body.c_str(), res.body.size());
-    lua_setfield(L, -2, "body");
+    if (res.kind == HttpEventKind::Progress) {
+      lua_rawgeti(L, LUA_REGISTRYINDEX, res.luaProgressRef);
+      lua_pushinteger(L, res.received);
+      lua_pushinteger(L, res.total);
+      callLua(L, 2);
+      continue;
+    }
 
-    lua_pushstring(L, res.error.c_str());
-    lua_setfield(L, -2, "error");
+    if (res.invokeCallback) {
+      lua_rawgeti(L, LUA_REGISTRYINDEX, res.luaCallbackRef);
+      lua_newtable(L);
+      lua_pushinteger(L, res.statusCode);
+      lua_setfield(L, -2, "status");
 
-    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
-      std::cerr << "[Net Error] Lua Callback failed: " << lua_tostring(L, -1) << std::endl;
-      lua_pop(L, 1);
+      lua_pushlstring(L, res.body.c_str(), res.body.size());
+      lua_setfield(L, -2, "body");
+
+      lua_pushstring(L, res.error.c_str());
+      lua_setfield(L, -2, "error");
+
+      lua_pushboolean(L, res.fromCache);
+      lua_setfield(L, -2, "fromCache");
+
+      if (!res.path.empty()) {
+        lua_pushstring(L, res.path.c_str());
+        lua_setfield(L, -2, "path");
+      }
+
+      callLua(L, 1);
     }
 
-    luaL_unref(L, LUA_REGISTRYINDEX, res.luaCallbackRef);
+    if (res.releaseCallback) {
+      luaL_unref(L, LUA_REGISTRYINDEX, res.luaCallbackRef);
+      luaL_unref(L, LUA_REGISTRYINDEX, res.luaChunkRef);
+      luaL_unref(L, LUA_REGISTRYINDEX, res.luaProgressRef);
+    }
   }
 
+  // a paused stream only resumes once the I/O thread sees the backlog drop
+  if (tookStream && g_multi) curl_multi_wakeup(g_multi);
+
   return true;
 }
 
@@ -230,9 +885,12 @@ int Lua_Fetch(lua_State* L) {
   std::string url = luaL_checkstring(L, 1);
 
   std::string method = "GET";
-  long timeout = 10000; // 10 second default timeout
+  long timeout = -1; // 10 seconds unless given; streams have none by default
   std::string body = "";
   std::map<std::string, std::string> headers;
+  bool useCache = false;
+  HttpStreamOptions stream;
+  bool wantsProgress = false;
 
   int callbackIndex = 2;
 
@@ -250,11 +908,48 @@ int Lua_Fetch(lua_State* L) {
     if (lua_isnumber(L, -1)) timeout = lua_tointeger(L, -1);
     lua_pop(L, 1);
 
+    // opt-in response cache, GET only
+    lua_getfield(L, 2, "cache");
+    useCache = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
     // Parse body
     lua_getfield(L, 2, "body");
     if (lua_isstring(L, -1)) body = lua_tostring(L, -1);
     lua_pop(L, 1);
 
+    // streaming: the body goes to onChunk as it arrives and the callback
+    // only gets the status at the end
+    lua_getfield(L, 2, "stream");
+    if (lua_isstring(L, -1)) {
+      std::string mode = lua_tostring(L, -1);
+      if (mode == "chunk") stream.mode = HttpStreamMode::Chunk;
+      else if (mode == "lines") stream.mode = HttpStreamMode::Lines;
+      else if (mode == "ndjson") stream.mode = HttpStreamMode::NDJSON;
+      else if (mode == "sse") stream.mode = HttpStreamMode::SSE;
+      else return luaL_error(L, "fetch: unknown stream mode '%s'", mode.c_str());
+    }
+    lua_pop(L, 1);
+
+    // download: the body goes straight to this file
+    lua_getfield(L, 2, "download");
+    if (lua_isstring(L, -1)) {
+      stream.mode = HttpStreamMode::Download;
+      stream.downloadPath = lua_tostring(L, -1);
+    }
+    lua_pop(L, 1);
+
+    if (stream.mode != HttpStreamMode::Buffer && stream.mode != HttpStreamMode::Download) {
+      lua_getfield(L, 2, "onChunk");
+      bool hasOnChunk = lua_isfunction(L, -1);
+      lua_pop(L, 1);
+      if (!hasOnChunk) return luaL_error(L, "fetch: a stream needs an onChunk function");
+    }
+
+    lua_getfield(L, 2, "onProgress");
+    wantsProgress = lua_isfunction(L, -1);
+    lua_pop(L, 1);
+
     // Parse headers table
     lua_getfield(L, 2, "headers");
     if (lua_istable(L, -1)) {
@@ -273,7 +968,18 @@ int Lua_Fetch(lua_State* L) {
   lua_pushvalue(L, callbackIndex);
   int callbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
 
-  HttpClient::FetchAsync(url, method, timeout, body, headers, callbackRef);
+  if (stream.mode != HttpStreamMode::Buffer && stream.mode != HttpStreamMode::Download) {
+    lua_getfield(L, 2, "onChunk");
+    stream.luaChunkRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  if (wantsProgress) {
+    lua_getfield(L, 2, "onProgress");
+    stream.luaProgressRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  if (timeout < 0) timeout = stream.mode == HttpStreamMode::Buffer ? 10000 : 0;
+
+  HttpClient::FetchAsync(url, method, timeout, body, headers, callbackRef, useCache, stream);
   return 0;
 }
 
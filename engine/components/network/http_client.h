@@ -5,12 +5,47 @@
 #include <mutex>
 #include <atomic>
 #include <map>
+#include <memory>
+
+// How a response body reaches Lua. Buffer hands over the whole body at the
+// end; the streaming modes hand it to `onChunk` piece by piece as it
+// arrives (raw chunks, lines, non-empty NDJSON lines or server-sent
+// events); Download writes it to a file on the I/O thread.
+enum class HttpStreamMode { Buffer, Chunk, Lines, NDJSON, SSE, Download };
+
+struct HttpStreamOptions {
+  HttpStreamMode mode = HttpStreamMode::Buffer;
+  std::string downloadPath;
+  int luaChunkRef = LUA_NOREF;
+  int luaProgressRef = LUA_NOREF;
+};
+
+enum class HttpEventKind { Complete, Chunk, Event, Progress };
 
 struct HttpResponse {
-  int statusCode;
+  int statusCode = 0;
   std::string body;
   std::string error;
-  int luaCallbackRef;
+  int luaCallbackRef = LUA_NOREF;
+
+  bool fromCache = false;
+  // a stale cache hit is delivered first and the callback kept for the
+  // revalidation, which may then finish without calling it again
+  bool invokeCallback = true;
+  bool releaseCallback = true;
+
+  // streams deliver Chunk/Event/Progress entries ahead of the Complete one,
+  // which releases the stream callbacks along with the main one
+  HttpEventKind kind = HttpEventKind::Complete;
+  int luaChunkRef = LUA_NOREF;
+  int luaProgressRef = LUA_NOREF;
+  std::string eventName; // SSE event type; its data is in `body`
+  std::string eventId;
+  long long received = 0;
+  long long total = 0;
+  std::string path; // download target
+  // bytes of this stream queued for Lua; the transfer pauses while it is high
+  std::shared_ptr<std::atomic<size_t>> backlog;
 };
 
 class HttpClient {
@@ -25,13 +60,20 @@ class HttpClient {
         long timeout, 
         const std::string& body, 
         const std::map<std::string, std::string>& headers, 
-        int luaCallbackRef
+        int luaCallbackRef,
+        bool useCache = false,
+        const HttpStreamOptions& stream = HttpStreamOptions()
     );
 
   private:
     static std::vector<HttpResponse> responseQueue;
     static std::mutex queueMutex;
     static std::atomic<bool> isShuttingDown;
+
+    // the I/O thread: every request runs as a transfer on one curl multi
+    // handle, so connections, TLS sessions and DNS lookups are shared
+    static void RunLoop();
+    static void PushResponses(std::vector<HttpResponse>& batch);
 };
 
 
@@ -18,7 +18,7 @@ enum class FontWeight { VeryThin, Thin, Normal, SemiBold, Bold, VeryBold };
 enum class TextDecoration { None, Underline, StrikeThrough };
 
 struct DrawTextCommand {
-  std::string text;
+  GlyphRunRef run;
   Font* font;
   float x, y;
   Color color;
@@ -45,7 +45,7 @@ struct PopClipCommand {
 
 struct DrawImageCommand {
   Rect rect;
-  uint32_t textureId;
+  uint32_t textureId; // GL texture; atlas pages are resolved when the command is built
   Color tint;
   float uMin = 0.0f;
   float vMin = 0.0f;
@@ -5,6 +5,7 @@
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <type_traits>
 #include <variant>
@@ -12,13 +13,15 @@
 
 const char* vertexSource = R"(
 #version 330 core
-layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec3 aTextCoord;
-layout (location = 2) in vec4 aColor;
-layout (location = 3) in vec2 aLocalPos;
-layout (location = 4) in vec4 aBoxData;
+layout (location = 0) in vec4 aRect;
+layout (location = 1) in vec4 aUV;
+layout (location = 2) in vec2 aLocalPos;
+layout (location = 3) in vec4 aBoxData;
+layout (location = 4) in vec4 aColor;
 layout (location = 5) in vec4 aBorderColor;
-layout (location = 6) in float aType;
+layout (location = 6) in float aPage;
+layout (location = 7) in float aType;
+layout (location = 8) in float aClip;
 
 out vec4 fColor;
 out vec3 fTextCoord;
@@ -27,18 +30,24 @@ out vec4 fBoxData;
 out vec4 fBorderColor;
 out float fType;
 out vec2 vScreenPos;
+flat out int fClip;
 
 uniform mat4 projection;
 
 void main() {
-  gl_Position = projection * vec4(aPos, 0.0, 1.0);
+  // triangle strip corners: (0,0) (1,0) (0,1) (1,1)
+  vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+  vec2 pos = aRect.xy + corner * aRect.zw;
+
+  gl_Position = projection * vec4(pos, 0.0, 1.0);
   fColor = aColor;
-  fTextCoord = aTextCoord;
-  fLocalPos = aLocalPos;
+  fTextCoord = vec3(mix(aUV.xy, aUV.zw, corner), aPage);
+  fLocalPos = aLocalPos + corner * aRect.zw;
   fBoxData = aBoxData;
   fBorderColor = aBorderColor;
   fType = aType;
-  vScreenPos = aPos;
+  vScreenPos = pos;
+  fClip = int(aClip + 0.5);
 }
 )";
 
@@ -53,14 +62,13 @@ in vec4 fBoxData;
 in vec4 fBorderColor;
 in float fType;
 in vec2 vScreenPos;
+flat in int fClip;
 
 uniform sampler2D texSampler;
 uniform sampler2DArray fontSampler;
+uniform samplerBuffer clipTable;
 uniform int useArray;
 
-uniform vec4 uClipRect; 
-uniform vec3 uClipData;
-
 float roundedBoxSDF(vec2 p, vec2 b, float r) {
   vec2 q = abs(p) - b + vec2(r);
   return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - r;
@@ -125,22 +133,32 @@ void main() {
         finalOutput = fColor * texColor * vec4(1.0, 1.0, 1.0, alpha);
     }
 
-    if (uClipData.z > 0.5) {
-        vec2 clipHalfSize = vec2(uClipRect.z, uClipRect.w) * 0.5;
-        vec2 clipCenter = vec2(uClipRect.x, uClipRect.y) + clipHalfSize;
-        
-        float clipDist = roundedBoxSDF(vScreenPos - clipCenter, clipHalfSize, uClipData.x);
-        
-        // Contract the clip area perfectly inside the parent's border
-        if (uClipData.y > 0.0) {
-            clipDist += uClipData.y;
-        }
+    if (fClip > 0) {
+        // bounds of the whole clip stack: a plain rect test
+        vec4 bounds = texelFetch(clipTable, fClip * 3);
+        if (vScreenPos.x < bounds.x || vScreenPos.y < bounds.y ||
+            vScreenPos.x >= bounds.z || vScreenPos.y >= bounds.w) discard;
 
-        float fw = fwidth(clipDist);
-        float clipAlpha = smoothstep(max(fw, 0.001), -max(fw, 0.001), clipDist);
-        
-        finalOutput.a *= clipAlpha;
-        if (finalOutput.a < 0.001) discard;
+        // rounded / bordered innermost clip: soft SDF edge
+        vec4 params = texelFetch(clipTable, fClip * 3 + 2);
+        if (params.z > 0.5) {
+            vec4 shape = texelFetch(clipTable, fClip * 3 + 1);
+            vec2 clipHalfSize = shape.zw * 0.5;
+            vec2 clipCenter = shape.xy + clipHalfSize;
+
+            float clipDist = roundedBoxSDF(vScreenPos - clipCenter, clipHalfSize, params.x);
+
+            // Contract the clip area perfectly inside the parent's border
+            if (params.y > 0.0) {
+                clipDist += params.y;
+            }
+
+            float fw = fwidth(clipDist);
+            float clipAlpha = smoothstep(max(fw, 0.001), -max(fw, 0.001), clipDist);
+
+            finalOutput.a *= clipAlpha;
+            if (finalOutput.a < 0.001) discard;
+        }
     }
 
     FragColor = finalOutput;
@@ -173,18 +191,33 @@ OpenGLRenderer::OpenGLRenderer(SDL_Window* win) : window(win) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-  currentTextureID = whiteTexture;
+  state.texture = whiteTexture;
 }
 
 OpenGLRenderer::~OpenGLRenderer() {
   glDeleteVertexArrays(1, &vao);
-  glDeleteBuffers(1, &vbo);
+  for (InstanceBuffer& buf : ring) {
+    if (buf.fence) glDeleteSync(buf.fence);
+    glDeleteBuffers(1, &buf.vbo);
+  }
+  glDeleteTextures(1, &clipTexture);
+  glDeleteBuffers(1, &clipBuffer);
   glDeleteProgram(shaderProgram);
   glDeleteTextures(1, &whiteTexture);
   SDL_GL_DeleteContext(context);
 
 }
 
+void OpenGLRenderer::makeContextCurrent() {
+  if (SDL_GL_MakeCurrent(window, context) != 0) {
+    std::cerr << "Failed to make OpenGL context current: " << SDL_GetError() << std::endl;
+  }
+}
+
+void OpenGLRenderer::releaseContext() {
+  SDL_GL_MakeCurrent(window, nullptr);
+}
+
 void OpenGLRenderer::initShaders() {
   // Compile Vertex Shader
   GLuint vs = glCreateShader(GL_VERTEX_SHADER);
@@ -203,42 +236,152 @@ void OpenGLRenderer::initShaders() {
 
   glDeleteShader(fs);
   glDeleteShader(vs);
+
+  useArrayLoc = glGetUniformLocation(shaderProgram, "useArray");
 }
 
 void OpenGLRenderer::initBuffers() {
 
   glGenVertexArrays(1, &vao);
-  glGenBuffers(1, &vbo);
+  for (InstanceBuffer& buf : ring) {
+    glGenBuffers(1, &buf.vbo);
+  }
 
   glBindVertexArray(vao);
+  for (GLuint loc = 0; loc < 9; loc++) {
+    glEnableVertexAttribArray(loc);
+    glVertexAttribDivisor(loc, 1);
+  }
+  bindInstanceRange(ring[0].vbo, 0);
+
+  glBindVertexArray(0);
+
+  glGenBuffers(1, &clipBuffer);
+  glGenTextures(1, &clipTexture);
+  glBindBuffer(GL_TEXTURE_BUFFER, clipBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(ClipEntry), nullptr, GL_DYNAMIC_DRAW);
+  glBindTexture(GL_TEXTURE_BUFFER, clipTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, clipBuffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// GL 3.3 has no base-instance draws, so a batch that starts mid-buffer
+// points the attributes at its first instance instead
+void OpenGLRenderer::bindInstanceRange(GLuint vbo, GLint first) {
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
-  glEnableVertexAttribArray(0); // pos
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE ,sizeof(Vertex), (void*)offsetof(Vertex, x));
+  size_t base = (size_t)first * sizeof(QuadInstance);
+  auto attrib = [base](GLuint loc, GLint size, GLenum type, GLboolean norm, size_t offset) {
+    glVertexAttribPointer(loc, size, type, norm, sizeof(QuadInstance), (void*)(base + offset));
+  };
 
-  glEnableVertexAttribArray(1); // UVW
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, u));
+  attrib(0, 4, GL_FLOAT, GL_FALSE, offsetof(QuadInstance, x));           // Rect
+  attrib(1, 4, GL_FLOAT, GL_FALSE, offsetof(QuadInstance, uMin));        // UV
+  attrib(2, 2, GL_FLOAT, GL_FALSE, offsetof(QuadInstance, localX));      // LocalPos
+  attrib(3, 4, GL_FLOAT, GL_FALSE, offsetof(QuadInstance, boxW));        // BoxData
+  attrib(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(QuadInstance, color));       // Color
+  attrib(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(QuadInstance, borderColor)); // BorderColor
+  attrib(6, 1, GL_FLOAT, GL_FALSE, offsetof(QuadInstance, page));        // Page
+  attrib(7, 1, GL_FLOAT, GL_FALSE, offsetof(QuadInstance, type));        // Type
+  attrib(8, 1, GL_FLOAT, GL_FALSE, offsetof(QuadInstance, clip));        // Clip
+}
 
-  glEnableVertexAttribArray(2); // Color
-  glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ BACK BUFFER AGE ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// How many swaps ago the buffer we are about to draw into was presented,
+// from EGL_EXT_buffer_age or GLX_EXT_buffer_age. The entry points come
+// straight from the system libraries: on X11 SDL_GL_GetProcAddress goes
+// through glXGetProcAddress, which returns stubs for names it doesn't know.
+// Without either extension we assume a plain double-buffered swap chain.
+
+namespace {
+
+constexpr int FALLBACK_BUFFER_AGE = 2;
+
+struct BufferAgeQuery {
+  bool initialized = false;
+
+  void* (*eglGetCurrentDisplay)() = nullptr;
+  void* (*eglGetCurrentSurface)(int32_t) = nullptr;
+  const char* (*eglQueryString)(void*, int32_t) = nullptr;
+  unsigned int (*eglQuerySurface)(void*, void*, int32_t, int32_t*) = nullptr;
+  bool eglSupported = false;
+
+  void* (*glXGetCurrentDisplay)() = nullptr;
+  unsigned long (*glXGetCurrentDrawable)() = nullptr;
+  const char* (*glXQueryExtensionsString)(void*, int) = nullptr;
+  void (*glXQueryDrawable)(void*, unsigned long, int, unsigned int*) = nullptr;
+  bool glxSupported = false;
+
+  static constexpr int32_t EGL_EXTENSIONS_ = 0x3055;
+  static constexpr int32_t EGL_DRAW_ = 0x3059;
+  static constexpr int32_t EGL_BUFFER_AGE_EXT_ = 0x313D;
+  static constexpr int GLX_BACK_BUFFER_AGE_EXT_ = 0x20F4;
+
+  template <typename Fn>
+  static void load(void* lib, const char* name, Fn& out) {
+    out = lib ? reinterpret_cast<Fn>(SDL_LoadFunction(lib, name)) : nullptr;
+  }
 
-  glEnableVertexAttribArray(3); // LocalPos
-  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, localX));
+  void init() {
+    initialized = true;
 
-  glEnableVertexAttribArray(4); // BoxData
-  glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, boxW));
+#if defined(__linux__) || defined(__FreeBSD__)
+    void* egl = SDL_LoadObject("libEGL.so.1");
+    load(egl, "eglGetCurrentDisplay", eglGetCurrentDisplay);
+    load(egl, "eglGetCurrentSurface", eglGetCurrentSurface);
+    load(egl, "eglQueryString", eglQueryString);
+    load(egl, "eglQuerySurface", eglQuerySurface);
 
-  glEnableVertexAttribArray(5); // BorderColor
-  glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, borderColor));
+    if (eglGetCurrentDisplay && eglGetCurrentSurface && eglQueryString && eglQuerySurface) {
+      void* display = eglGetCurrentDisplay();
+      const char* ext = display ? eglQueryString(display, EGL_EXTENSIONS_) : nullptr;
+      eglSupported = ext && std::strstr(ext, "EGL_EXT_buffer_age") != nullptr;
+    }
+    if (eglSupported) return;
+
+    void* glx = SDL_LoadObject("libGL.so.1");
+    load(glx, "glXGetCurrentDisplay", glXGetCurrentDisplay);
+    load(glx, "glXGetCurrentDrawable", glXGetCurrentDrawable);
+    load(glx, "glXQueryExtensionsString", glXQueryExtensionsString);
+    load(glx, "glXQueryDrawable", glXQueryDrawable);
+
+    if (glXGetCurrentDisplay && glXGetCurrentDrawable && glXQueryExtensionsString && glXQueryDrawable) {
+      void* display = glXGetCurrentDisplay();
+      const char* ext = display ? glXQueryExtensionsString(display, 0) : nullptr;
+      glxSupported = ext && std::strstr(ext, "GLX_EXT_buffer_age") != nullptr;
+    }
+#endif
+  }
 
-  glEnableVertexAttribArray(6); // Type
-  glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, type));
+  int query() {
+    if (!initialized) init();
 
+    if (eglSupported) {
+      int32_t age = 0;
+      if (eglQuerySurface(eglGetCurrentDisplay(), eglGetCurrentSurface(EGL_DRAW_), EGL_BUFFER_AGE_EXT_, &age)) {
+        return age;
+      }
+      return 0;
+    }
+
+    if (glxSupported) {
+      unsigned int age = 0;
+      glXQueryDrawable(glXGetCurrentDisplay(), glXGetCurrentDrawable(), GLX_BACK_BUFFER_AGE_EXT_, &age);
+      return (int)age;
+    }
+
+    return FALLBACK_BUFFER_AGE;
+  }
+};
+
+BufferAgeQuery g_bufferAge;
 
-  glBindVertexArray(0);
 }
 
-void OpenGLRenderer::beginFrame(const DamageRect& damage) {
+void OpenGLRenderer::beginFrame(const DamageTracker& damage) {
 
   SDL_GetWindowSize(window, &winWidth, &winHeight);
   int drawableW, drawableH;
@@ -247,37 +390,71 @@ void OpenGLRenderer::beginFrame(const DamageRect& damage) {
 
   float dpiScale = (float)drawableW / (float)winWidth;
 
-  if (damage.active && !damage.fullScreen) {
-    glEnable(GL_SCISSOR_TEST);
-    int sx = (int)std::floor(damage.x * dpiScale);
-    int sw = (int)std::floor(damage.w * dpiScale);
-    int sh = (int)std::floor(damage.h * dpiScale);
-    int sy = drawableH - (int)std::floor(damage.y * dpiScale) - sh;
-
-    sx = std::max(0, sx);
-    sy = std::max(0, sy);
-    sw = std::min(drawableW - sx, sw);
-    sh = std::min(drawableH - sy, sh);
-
-    glScissor(sx, sy, sw, sh);
-  } else {
-    glDisable(GL_SCISSOR_TEST);
+  state = DrawState{};
+  state.texture = whiteTexture;
+
+  // everything that changed since this back buffer was last shown
+  DamageRegion region = damage.regionForAge(g_bufferAge.query());
+
+  damagePasses.clear();
+  if (!region.fullScreen) {
+    for (int i = 0; i < region.count; i++) {
+      const Rect& r = region.rects[i];
+      int x0 = std::max(0, (int)std::floor(r.x * dpiScale));
+      int y0 = std::max(0, (int)std::floor(r.y * dpiScale));
+      int x1 = std::min(drawableW, (int)std::ceil((r.x + r.w) * dpiScale));
+      int y1 = std::min(drawableH, (int)std::ceil((r.y + r.h) * dpiScale));
+      if (x1 <= x0 || y1 <= y0) continue;
+
+      // disjoint rects can still share a pixel once rounded outwards; merge
+      // those so no pixel is drawn by two passes
+      Rect rect = r;
+      for (size_t j = 0; j < damagePasses.size();) {
+        DamagePass& other = damagePasses[j];
+        int ox0 = other.scissor[0];
+        int ox1 = ox0 + other.scissor[2];
+        int oy1 = drawableH - other.scissor[1];
+        int oy0 = oy1 - other.scissor[3];
+        if (x0 < ox1 && ox0 < x1 && y0 < oy1 && oy0 < y1) {
+          x0 = std::min(x0, ox0);
+          y0 = std::min(y0, oy0);
+          x1 = std::max(x1, ox1);
+          y1 = std::max(y1, oy1);
+          float rx0 = std::min(rect.x, other.rect.x);
+          float ry0 = std::min(rect.y, other.rect.y);
+          float rx1 = std::max(rect.x + rect.w, other.rect.x + other.rect.w);
+          float ry1 = std::max(rect.y + rect.h, other.rect.y + other.rect.h);
+          rect = {rx0, ry0, rx1 - rx0, ry1 - ry0};
+          damagePasses.erase(damagePasses.begin() + j);
+          j = 0; // the grown box may reach passes already checked
+        } else {
+          j++;
+        }
+      }
+      damagePasses.push_back({rect, {x0, drawableH - y1, x1 - x0, y1 - y0}});
+    }
+    if (damagePasses.empty()) region.fullScreen = true;
   }
 
   glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT); 
+  if (region.fullScreen) {
+    glDisable(GL_SCISSOR_TEST);
+    glClear(GL_COLOR_BUFFER_BIT);
+  } else {
+    glEnable(GL_SCISSOR_TEST);
+    for (const DamagePass& pass : damagePasses) {
+      glScissor(pass.scissor[0], pass.scissor[1], pass.scissor[2], pass.scissor[3]);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+  }
 
   glUseProgram(shaderProgram);
 
-  useArrayLoc = glGetUniformLocation(shaderProgram, "useArray");
   glUniform1i(useArrayLoc, 0);
-  currentIsArray = false;
-  
-  GLint clipDataLoc = glGetUniformLocation(shaderProgram, "uClipData");
-  glUniform3f(clipDataLoc, 0.0f, 0.0f, 0.0f); 
 
   glUniform1i(glGetUniformLocation(shaderProgram, "texSampler"), 0);
   glUniform1i(glGetUniformLocation(shaderProgram, "fontSampler"), 1);
+  glUniform1i(glGetUniformLocation(shaderProgram, "clipTable"), 2);
 
   float L = 0.0f, R = (float)winWidth;
   float B = (float)winHeight, T = 0.0f;
@@ -292,34 +469,188 @@ void OpenGLRenderer::beginFrame(const DamageRect& damage) {
   GLint projLoc = glGetUniformLocation(shaderProgram, "projection");
   glUniformMatrix4fv(projLoc, 1, GL_FALSE, ortho);
 
-  vertices.clear();
-  currentTextureID = whiteTexture;
+  instances.clear();
+  batches.clear();
+  batchStart = 0;
+
+  // row 0 is "no clip"; quads outside any clip point at it
+  clips.clear();
+  clips.push_back({{0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, 0.0f, 0.0f});
   glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, currentTextureID);
+  glBindTexture(GL_TEXTURE_2D, whiteTexture);
 }
 
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ FRAME UPLOAD AND BATCH REPLAY     ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// The whole frame's instances go into one buffer of a small ring. Each slot
+// keeps a shadow of its contents, so a frame that matches the one drawn
+// from that slot last time only uploads the instances that changed (a caret
+// blink is one instance). A fence per slot keeps us from overwriting data
+// the GPU is still reading.
+
 void OpenGLRenderer::endFrame() {
-  glDisable(GL_SCISSOR_TEST);
   flush();
+
+  if (!batches.empty()) {
+    InstanceBuffer& buf = uploadInstances();
+    uploadClips();
+
+    glBindVertexArray(vao);
+    if (damagePasses.empty()) {
+      drawBatches(buf.vbo, nullptr);
+    } else {
+      // each damage rect gets its own scissored pass, drawing only the
+      // batches that reach into it
+      for (const DamagePass& pass : damagePasses) {
+        glScissor(pass.scissor[0], pass.scissor[1], pass.scissor[2], pass.scissor[3]);
+        drawBatches(buf.vbo, &pass.rect);
+      }
+    }
+    glBindVertexArray(0);
+
+    buf.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ringIndex = (ringIndex + 1) % INSTANCE_RING_SIZE;
+  }
+
+  glDisable(GL_SCISSOR_TEST);
   SDL_GL_SwapWindow(window);
 }
 
-void OpenGLRenderer::flush() {
-  if (vertices.empty()) return;
+InstanceBuffer& OpenGLRenderer::uploadInstances() {
+  InstanceBuffer& buf = ring[ringIndex];
 
-  glBindVertexArray(vao);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  if (buf.fence) {
+    glClientWaitSync(buf.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    glDeleteSync(buf.fence);
+    buf.fence = nullptr;
+  }
 
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_DYNAMIC_DRAW);
-  glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+  glBindBuffer(GL_ARRAY_BUFFER, buf.vbo);
 
-  glBindVertexArray(0);
-  vertices.clear();
+  size_t count = instances.size();
+  if (count > buf.capacity) {
+    buf.capacity = std::max(count + count / 2, (size_t)1024);
+    glBufferData(GL_ARRAY_BUFFER, buf.capacity * sizeof(QuadInstance), nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(QuadInstance), instances.data());
+    buf.shadow = instances;
+    return buf;
+  }
+
+  // upload runs of changed instances; small clean gaps are sent along with
+  // their neighbours rather than splitting into many tiny calls
+  constexpr size_t MERGE_GAP = 8;
+  size_t shadowCount = std::min(buf.shadow.size(), count);
+  size_t i = 0;
+
+  while (i < count) {
+    if (i < shadowCount && std::memcmp(&instances[i], &buf.shadow[i], sizeof(QuadInstance)) == 0) {
+      i++;
+      continue;
+    }
+
+    size_t runStart = i;
+    size_t runEnd = i + 1;
+    size_t clean = 0;
+    for (size_t j = runEnd; j < count && clean < MERGE_GAP; j++) {
+      if (j < shadowCount && std::memcmp(&instances[j], &buf.shadow[j], sizeof(QuadInstance)) == 0) {
+        clean++;
+      } else {
+        clean = 0;
+        runEnd = j + 1;
+      }
+    }
+
+    glBufferSubData(GL_ARRAY_BUFFER, runStart * sizeof(QuadInstance),
+        (runEnd - runStart) * sizeof(QuadInstance), instances.data() + runStart);
+    i = runEnd;
+  }
+
+  buf.shadow = instances;
+  return buf;
+}
+
+void OpenGLRenderer::applyState(const DrawState& next, const DrawState* prev) {
+  if (!prev || prev->isArray != next.isArray || prev->texture != next.texture) {
+    glUniform1i(useArrayLoc, next.isArray ? 1 : 0);
+    if (next.isArray) {
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, next.texture);
+      glActiveTexture(GL_TEXTURE0);
+    } else {
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, next.texture);
+    }
+  }
+
+}
+
+void OpenGLRenderer::drawBatches(GLuint vbo, const Rect* damage) {
+  const DrawState* prev = nullptr;
+  for (const DrawBatch& batch : batches) {
+    if (damage) {
+      const Rect& b = batch.bounds;
+      if (b.x >= damage->x + damage->w || b.x + b.w <= damage->x ||
+          b.y >= damage->y + damage->h || b.y + b.h <= damage->y) {
+        continue;
+      }
+    }
+
+    applyState(batch.state, prev);
+    prev = &batch.state;
+
+    bindInstanceRange(vbo, batch.first);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, batch.count);
+  }
+}
+
+// the clip table is usually identical frame to frame; only re-upload it
+// when an entry changed
+void OpenGLRenderer::uploadClips() {
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_BUFFER, clipTexture);
+  glActiveTexture(GL_TEXTURE0);
+
+  if (clips.size() == uploadedClips.size() &&
+      std::memcmp(clips.data(), uploadedClips.data(), clips.size() * sizeof(ClipEntry)) == 0) {
+    return;
+  }
+
+  glBindBuffer(GL_TEXTURE_BUFFER, clipBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, clips.size() * sizeof(ClipEntry), clips.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  uploadedClips = clips;
+}
+
+// closes the current batch; the draw itself happens in endFrame()
+void OpenGLRenderer::flush() {
+  if (instances.size() == batchStart) return;
+
+  float x0 = instances[batchStart].x, y0 = instances[batchStart].y;
+  float x1 = x0 + instances[batchStart].w, y1 = y0 + instances[batchStart].h;
+  for (size_t i = batchStart + 1; i < instances.size(); i++) {
+    const QuadInstance& q = instances[i];
+    x0 = std::min(x0, q.x);
+    y0 = std::min(y0, q.y);
+    x1 = std::max(x1, q.x + q.w);
+    y1 = std::max(y1, q.y + q.h);
+  }
+
+  batches.push_back({state, (GLint)batchStart, (GLsizei)(instances.size() - batchStart),
+      {x0, y0, x1 - x0, y1 - y0}});
+  batchStart = instances.size();
+}
+
+void OpenGLRenderer::setTexture(GLuint texture, bool isArray) {
+  if (state.isArray == isArray && state.texture == texture) return;
+  flush();
+  state.isArray = isArray;
+  state.texture = texture;
 }
 
 struct ClipStackEntry {
   Rect intersected;
-  PushClipCommand originalCmd;
+  int index; // row in the clip table
 };
 
 void OpenGLRenderer::submit(const RenderCommandList& list) {
@@ -330,17 +661,19 @@ void OpenGLRenderer::submit(const RenderCommandList& list) {
   };
 
   std::vector<ClipStackEntry> clipStack;
+  float currentClip = 0.0f;
+
+  // every quad is recorded whatever this frame's damage, so an unchanged
+  // frame yields the same instances and the diffed upload sends nothing;
+  // drawBatches skips the batches a damage rect misses
+  auto push = [this, &currentClip](QuadInstance q) {
+    q.clip = currentClip;
+    instances.push_back(q);
+  };
 
   for (const auto& cmd : list.commands) {
     if (std::holds_alternative<DrawRectCommand>(cmd)) {
-      if (currentIsArray || currentTextureID != whiteTexture) {
-        flush();
-        currentIsArray = false;
-        glUniform1i(useArrayLoc, 0);
-        currentTextureID = whiteTexture;
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, whiteTexture);
-      }
+      setTexture(whiteTexture, false);
 
       const auto& data = std::get<DrawRectCommand>(cmd);
       float x = snap(data.rect.x);
@@ -356,18 +689,12 @@ void OpenGLRenderer::submit(const RenderCommandList& list) {
       Color bc = data.borderColor;
       float type = (radius > 0.0f || borderW > 0.0f) ? 1.0f : 0.0f;
 
-      vertices.push_back({x, y, 0.0f, 0.0f, 0.0f, c,     0.0f, 0.0f, w, h, radius, borderW, bc, type});
-      vertices.push_back({x + w, y, 0.0f, 0.0f, 0.0f, c, w,    0.0f, w, h, radius, borderW, bc, type});
-      vertices.push_back({x + w, y + h, 0.0f, 0.0f, 0.0f, c, w, h, w, h, radius, borderW, bc, type});
-
-      vertices.push_back({x, y, 0.0f, 0.0f, 0.0f, c,     0.0f, 0.0f, w, h, radius, borderW, bc, type});
-      vertices.push_back({x, y + h, 0.0f, 0.0f, 0.0f, c, 0.0f, h,    w, h, radius, borderW, bc, type});
-      vertices.push_back({x + w, y + h, 0.0f, 0.0f, 0.0f, c, w,    h,    w, h, radius, borderW, bc, type});
+      push({x, y, w, h, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, w, h, radius, borderW, c, bc, 0.0f, type});
     }
 
     else if (std::holds_alternative<DrawTextCommand>(cmd)) {
       const auto& data = std::get<DrawTextCommand>(cmd);
-      if (!data.font) continue;
+      if (!data.font || !data.run) continue;
 
       float fSize = (float)data.font->GetLogicalSize();
       float underlineY = data.y + (fSize*0.1f);
@@ -382,195 +709,83 @@ void OpenGLRenderer::submit(const RenderCommandList& list) {
 
       GLuint fontTex = data.font->GetTextureID();
 
-      if (!currentIsArray || currentTextureID != fontTex) {
-        flush();
-        currentIsArray = true;
-        glUniform1i(useArrayLoc, 1);
-        currentTextureID = fontTex;
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, fontTex);
-        glActiveTexture(GL_TEXTURE0);
-      }
-
-      float cursorX = snap(data.x);
-      float cursorY = snap(data.y);
-      float textStartX = cursorX;
-
-      std::vector<uint32_t> codepoints = Font::DecodeUTF8(data.text);
-
-      for (uint32_t c : codepoints) {
-        const Character& ch = data.font->GetCharacter(c);
-
-        float xpos = snap(cursorX + (ch.BearingX / dpiScale));
-        float ypos = snap(cursorY + ((ch.SizeY - ch.BearingY) / dpiScale));
-        float w = (float)ch.SizeX / dpiScale;
-        float h = (float)ch.SizeY / dpiScale;
+      setTexture(fontTex, true);
 
-        float left   = xpos;
-        float right  = xpos + w;
-        float top    = ypos - h;
-        float bottom = ypos;
+      float originX = snap(data.x);
+      float originY = snap(data.y);
+      float textStartX = originX;
 
-        vertices.push_back({ right, top,    ch.uMax, ch.vMin, ch.pageIndex, data.color });
-        vertices.push_back({ right, bottom, ch.uMax, ch.vMax, ch.pageIndex, data.color });
-        vertices.push_back({ left,  bottom, ch.uMin, ch.vMax, ch.pageIndex, data.color });
+      for (const ShapedGlyph& g : data.run->glyphs) {
+        float left   = snap(originX + g.x);
+        float bottom = snap(originY + g.y);
 
-        vertices.push_back({ left,  bottom, ch.uMin, ch.vMax, ch.pageIndex, data.color });
-        vertices.push_back({ left,  top,    ch.uMin, ch.vMin, ch.pageIndex, data.color });
-        vertices.push_back({ right, top,    ch.uMax, ch.vMin, ch.pageIndex, data.color });
-
-        cursorX += ((ch.Advance >> 6) / dpiScale);
+        push({left, bottom - g.h, g.w, g.h, g.uMin, g.vMin, g.uMax, g.vMax,
+            0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, data.color, {0, 0, 0, 0}, g.page, 0.0f});
       }
 
       if (data.decoration != TextDecoration::None) {
-        if (currentIsArray || currentTextureID != whiteTexture) {
-          flush();
-          currentIsArray = false;
-          glUniform1i(useArrayLoc, 0);
-          currentTextureID = whiteTexture;
-          glActiveTexture(GL_TEXTURE0);
-          glBindTexture(GL_TEXTURE_2D, whiteTexture);
-        }
+        setTexture(whiteTexture, false);
 
         float decorationThickness = std::max(1.0f, std::round(fSize * 0.05f));
-        float width = cursorX - textStartX;
+        float width = data.run->advance;
         float rawY = (data.decoration == TextDecoration::Underline) ? underlineY : strikeThroughY;
 
         float lineY = snap(rawY);
         float lineBottom = snap(rawY + (decorationThickness / dpiScale));
 
-        vertices.push_back({ textStartX + width, lineY,       0.0f, 0.0f, 0.0f, data.color });
-        vertices.push_back({ textStartX + width, lineBottom,  0.0f, 0.0f, 0.0f, data.color });
-        vertices.push_back({ textStartX,         lineBottom,  0.0f, 0.0f, 0.0f, data.color });
-
-        vertices.push_back({ textStartX,         lineBottom,  0.0f, 0.0f, 0.0f, data.color });
-        vertices.push_back({ textStartX,         lineY,       0.0f, 0.0f, 0.0f, data.color });
-        vertices.push_back({ textStartX + width, lineY,       0.0f, 0.0f, 0.0f, data.color });
+        push({textStartX, lineY, width, lineBottom - lineY, 0.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, data.color, {0, 0, 0, 0}, 0.0f, 0.0f});
       }
     }
 
     else if (std::holds_alternative<PushClipCommand>(cmd)) {
-      flush();
       const auto& data = std::get<PushClipCommand>(cmd);
 
-      Rect currentClip = data.rect;
+      Rect currentClipRect = data.rect;
       if (!clipStack.empty()) {
         Rect parentClip = clipStack.back().intersected;
-        float x1 = std::max(currentClip.x, parentClip.x);
-        float y1 = std::max(currentClip.y, parentClip.y);
-        float x2 = std::min(currentClip.x + currentClip.w, parentClip.x + parentClip.w);
-        float y2 = std::min(currentClip.y + currentClip.h, parentClip.y + parentClip.h);
-        currentClip.x = x1;
-        currentClip.y = y1;
-        currentClip.w = std::max(0.0f, x2 - x1);
-        currentClip.h = std::max(0.0f, y2 - y1);
+        float x1 = std::max(currentClipRect.x, parentClip.x);
+        float y1 = std::max(currentClipRect.y, parentClip.y);
+        float x2 = std::min(currentClipRect.x + currentClipRect.w, parentClip.x + parentClip.w);
+        float y2 = std::min(currentClipRect.y + currentClipRect.h, parentClip.y + parentClip.h);
+        currentClipRect.x = x1;
+        currentClipRect.y = y1;
+        currentClipRect.w = std::max(0.0f, x2 - x1);
+        currentClipRect.h = std::max(0.0f, y2 - y1);
       }
-      clipStack.push_back({currentClip, data});
-
-      int drawW, drawH;
-      SDL_GL_GetDrawableSize(window, &drawW, &drawH);
-      float scaleX = (float)drawW / winWidth;
-      float scaleY = (float)drawH / winHeight;
-
-      float clipLeft = snap(currentClip.x);
-      float clipTop = snap(currentClip.y);
-      float clipRight = snap(currentClip.x + currentClip.w);
-      float clipBottom = snap(currentClip.y + currentClip.h);
 
-      int scissorX = (int)std::round(clipLeft * scaleX);
-      int scissorY = (int)std::round(drawH - clipBottom * scaleY);
-      int scissorW = (int)std::round((clipRight - clipLeft) * scaleX);
-      int scissorH = (int)std::round((clipBottom - clipTop) * scaleY);
-
-      glEnable(GL_SCISSOR_TEST);
-      glScissor(scissorX, scissorY, scissorW, scissorH);
-
-      GLint clipRectLoc = glGetUniformLocation(shaderProgram, "uClipRect");
-      GLint clipDataLoc = glGetUniformLocation(shaderProgram, "uClipData");
-      
       float uLeft = snap(data.rect.x);
       float uTop = snap(data.rect.y);
       float uW = snap(data.rect.x + data.rect.w) - uLeft;
       float uH = snap(data.rect.y + data.rect.h) - uTop;
 
-      glUniform4f(clipRectLoc, uLeft, uTop, uW, uH);
-      glUniform3f(clipDataLoc, data.borderRadius, data.borderWidth, 1.0f);
+      // plain rectangular clips are fully handled by the bounds test
+      bool useSdf = data.borderRadius > 0.0f || data.borderWidth > 0.0f;
+
+      ClipEntry entry = {
+        {snap(currentClipRect.x), snap(currentClipRect.y),
+          snap(currentClipRect.x + currentClipRect.w), snap(currentClipRect.y + currentClipRect.h)},
+        {uLeft, uTop, uW, uH},
+        data.borderRadius, data.borderWidth, useSdf ? 1.0f : 0.0f, 0.0f
+      };
+
+      int index = (int)clips.size();
+      clips.push_back(entry);
+      clipStack.push_back({currentClipRect, index});
+      currentClip = (float)index;
     }
 
     else if (std::holds_alternative<PopClipCommand>(cmd)) {
-      flush();
-
       if (!clipStack.empty()) {
         clipStack.pop_back();
       }
-
-      GLint clipRectLoc = glGetUniformLocation(shaderProgram, "uClipRect");
-      GLint clipDataLoc = glGetUniformLocation(shaderProgram, "uClipData");
-
-      if (clipStack.empty()) {
-        glUniform3f(clipDataLoc, 0.0f, 0.0f, 0.0f);
-
-        if (g_damageTracker.active && !g_damageTracker.fullScreen) {
-          int drawW, drawH;
-          SDL_GL_GetDrawableSize(window, &drawW, &drawH);
-          float dpiScale = (float)drawW / winWidth;
-          int sx = (int)std::floor(g_damageTracker.x * dpiScale);
-          int sw = (int)std::floor(g_damageTracker.w * dpiScale);
-          int sh = (int)std::floor(g_damageTracker.h * dpiScale);
-          int sy = drawH - (int)std::floor(g_damageTracker.y * dpiScale) - sh;
-
-          sx = std::max(0, sx);
-          sy = std::max(0, sy);
-          sw = std::min(drawW - sx, sw);
-          sh = std::min(drawH - sy, sh);
-
-          glEnable(GL_SCISSOR_TEST);
-          glScissor(sx, sy, sw, sh);
-        } else {
-            glDisable(GL_SCISSOR_TEST);
-        }
-      } else {
-        Rect restoredClip = clipStack.back().intersected;
-        const auto& entry = clipStack.back();
-
-        float uLeft = snap(entry.originalCmd.rect.x);
-        float uTop = snap(entry.originalCmd.rect.y);
-        float uW = snap(entry.originalCmd.rect.x + entry.originalCmd.rect.w) - uLeft;
-        float uH = snap(entry.originalCmd.rect.y + entry.originalCmd.rect.h) - uTop;
-
-        glUniform4f(clipRectLoc, uLeft, uTop, uW, uH);
-        glUniform3f(clipDataLoc, entry.originalCmd.borderRadius, entry.originalCmd.borderWidth, 1.0f);
-
-        int drawW, drawH;
-        SDL_GL_GetDrawableSize(window, &drawW, &drawH);
-        float scaleX = (float)drawW / winWidth;
-        float scaleY = (float)drawH / winHeight;
-
-        float clipLeft = snap(restoredClip.x);
-        float clipTop = snap(restoredClip.y);
-        float clipRight = snap(restoredClip.x + restoredClip.w);
-        float clipBottom = snap(restoredClip.y + restoredClip.h);
-
-        int scissorX = (int)std::round(clipLeft * scaleX);
-        int scissorY = (int)std::round(drawH - clipBottom * scaleY);
-        int scissorW = (int)std::round((clipRight - clipLeft) * scaleX);
-        int scissorH = (int)std::round((clipBottom - clipTop) * scaleY);
-
-        glScissor(scissorX, scissorY, scissorW, scissorH);
-      }
+      currentClip = clipStack.empty() ? 0.0f : (float)clipStack.back().index;
     }
 
     else if (std::holds_alternative<DrawImageCommand>(cmd)) {
       const auto& data = std::get<DrawImageCommand>(cmd);
 
-      if ( currentIsArray || currentTextureID != data.textureId) {
-        flush();
-        currentIsArray = false;
-        glUniform1i(useArrayLoc, 0);
-        currentTextureID = data.textureId;
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, data.textureId);
-      }
+      setTexture(data.textureId, false);
 
       float left   = snap(data.rect.x);
       float top    = snap(data.rect.y);
@@ -588,17 +803,10 @@ void OpenGLRenderer::submit(const RenderCommandList& list) {
 
       float localLeft = left - nodeX;
       float localTop = top - nodeY;
-      float localRight = localLeft + drawW;
-      float localBottom = localTop + drawH;
       float radius = data.borderRadius;
 
-      vertices.push_back({left, top, data.uMin, data.vMin, 0.0f, data.tint, localLeft, localTop, boxW, boxH, radius, data.borderWidth, {0,0,0,0}, 0.0f});
-      vertices.push_back({right, top, data.uMax, data.vMin, 0.0f, data.tint, localRight, localTop, boxW, boxH, radius, data.borderWidth, {0,0,0,0}, 0.0f});
-      vertices.push_back({right, bottom, data.uMax, data.vMax, 0.0f, data.tint, localRight, localBottom, boxW, boxH, radius, data.borderWidth, {0,0,0,0}, 0.0f});
-
-      vertices.push_back({left, top, data.uMin, data.vMin, 0.0f, data.tint, localLeft, localTop, boxW, boxH, radius, data.borderWidth, {0,0,0,0}, 0.0f});
-      vertices.push_back({left, bottom, data.uMin, data.vMax, 0.0f, data.tint, localLeft, localBottom, boxW, boxH, radius, data.borderWidth, {0,0,0,0}, 0.0f});
-      vertices.push_back({right, bottom, data.uMax, data.vMax, 0.0f, data.tint, localRight, localBottom, boxW, boxH, radius, data.borderWidth, {0,0,0,0}, 0.0f});
+      push({left, top, drawW, drawH, data.uMin, data.vMin, data.uMax, data.vMax,
+          localLeft, localTop, boxW, boxH, radius, data.borderWidth, data.tint, {0, 0, 0, 0}, 0.0f, 0.0f});
 
     }
   }
@@ -7,19 +7,67 @@
 #include <SDL2/SDL_opengl.h>
 #include <vector>
 
-struct Vertex {
-  float x, y;
-  float u, v, page;
-  Color color;
-
-  float localX = 0.0f;
-  float localY = 0.0f; 
+// One quad per rect, glyph or image. The vertex shader expands it into a
+// 4-vertex triangle strip, so per-quad data is stored once, not six times.
+struct QuadInstance {
+  float x, y, w, h;               // screen rect, logical px
+  float uMin, vMin, uMax, vMax;
+  float localX = 0.0f;            // quad's top-left inside its SDF box
+  float localY = 0.0f;
   float boxW = 0.0f;
   float boxH = 0.0f;
   float radius = 0.0f;
   float borderW = 0.0f;
+  Color color;
   Color borderColor = {0, 0, 0, 0};
+  float page = 0.0f;
   float type = 0.0f; // 0.0 defaults to Text/Image (Standard)
+  float clip = 0.0f; // row in the frame's clip table, 0 = unclipped
+};
+
+static_assert(sizeof(QuadInstance) == 76, "QuadInstance layout must match the instanced attribute setup");
+
+// One active clip as the fragment shader sees it. `bounds` is the
+// intersection with every enclosing clip (a hard test, like a scissor);
+// `shape` is the innermost clip's own box, only evaluated as a rounded SDF
+// when it has a radius or border. Three RGBA32F texels per entry.
+struct ClipEntry {
+  float bounds[4]; // x0, y0, x1, y1
+  float shape[4];  // x, y, w, h
+  float radius;
+  float borderW;
+  float useSdf;
+  float pad;
+};
+
+// GL state a batch is drawn with. submit() only records it; the GL calls
+// happen when the frame's batches are replayed in endFrame().
+struct DrawState {
+  GLuint texture = 0;
+  bool isArray = false;
+};
+
+struct DrawBatch {
+  DrawState state;
+  GLint first;
+  GLsizei count;
+  Rect bounds; // union of the batch's quads, to skip it for damage it misses
+};
+
+// One rect of the frame's damage region, in logical px and as the scissor
+// box it becomes in the drawable.
+struct DamagePass {
+  Rect rect;
+  GLint scissor[4];
+};
+
+// One slot of the instance ring. `shadow` is what the GPU copy currently
+// holds, so an upload only sends the instances that differ from it.
+struct InstanceBuffer {
+  GLuint vbo = 0;
+  GLsync fence = nullptr;
+  size_t capacity = 0; // in instances
+  std::vector<QuadInstance> shadow;
 };
 
 class OpenGLRenderer : public Renderer {
@@ -27,10 +75,14 @@ class OpenGLRenderer : public Renderer {
     OpenGLRenderer(SDL_Window* window);
     ~OpenGLRenderer();
 
-    void beginFrame(const DamageRect& damage) override;
+    void beginFrame(const DamageTracker& damage) override;
     void endFrame() override;
     void submit(const RenderCommandList& commandList) override;
 
+    // moves the context between the main and render threads
+    void makeContextCurrent();
+    void releaseContext();
+
   private:
     SDL_Window* window;
     SDL_GLContext context;
@@ -39,16 +91,38 @@ class OpenGLRenderer : public Renderer {
 
     GLuint shaderProgram;
     GLuint vao;
-    GLuint vbo;
 
     GLuint whiteTexture;
-    GLuint currentTextureID;
 
-    GLuint useArrayLoc;
-    bool currentIsArray = false;
+    GLint useArrayLoc;
+
+    // clips live in a texture buffer indexed per quad, so entering or
+    // leaving a clip never breaks a batch
+    GLuint clipBuffer = 0;
+    GLuint clipTexture = 0;
+    std::vector<ClipEntry> clips;
+    std::vector<ClipEntry> uploadedClips;
+
+    static constexpr int INSTANCE_RING_SIZE = 3;
+    InstanceBuffer ring[INSTANCE_RING_SIZE];
+    int ringIndex = 0;
+
+    // empty when the whole window is redrawn
+    std::vector<DamagePass> damagePasses;
+
+    DrawState state;
+    size_t batchStart = 0;
+    std::vector<DrawBatch> batches;
+    std::vector<QuadInstance> instances;
 
-    std::vector<Vertex> vertices;
     void initShaders();
     void initBuffers();
     void flush();
+
+    void setTexture(GLuint texture, bool isArray);
+    InstanceBuffer& uploadInstances();
+    void bindInstanceRange(GLuint vbo, GLint first);
+    void applyState(const DrawState& next, const DrawState* prev);
+    void uploadClips();
+    void drawBatches(GLuint vbo, const Rect* damage);
 };
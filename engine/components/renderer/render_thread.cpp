@@ -0,0 +1,158 @@
+#include "render_thread.h"
+#include "opengl_renderer.h"
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace RenderThread {
+  static constexpr int MAX_FRAMES_IN_FLIGHT = 1;
+
+  // a GL task or a frame, consumed in queue order
+  struct WorkItem {
+    std::function<void()> task;
+    std::unique_ptr<FramePacket> frame;
+  };
+
+  static OpenGLRenderer* activeRenderer = nullptr;
+  static std::thread worker;
+  static std::thread::id workerId;
+  static std::thread::id ownerId; // holds the context when not threaded
+  static bool threaded = false;
+
+  static std::mutex queueMutex;
+  static std::condition_variable queueCV;
+  static std::condition_variable frameDoneCV;
+  static std::deque<WorkItem> queue;
+  static int framesInFlight = 0;
+  static bool stopping = false;
+
+  static void drawFrame(FramePacket& packet) {
+    activeRenderer->beginFrame(packet.damage);
+    activeRenderer->submit(packet.commands);
+    activeRenderer->endFrame();
+  }
+
+  // inline mode: GL work from other threads (glyphs loaded during a
+  // parallel flatten) waits here for the owner's next GL call
+  static void drainInline() {
+    std::deque<WorkItem> pending;
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      if (queue.empty()) return;
+      pending.swap(queue);
+    }
+    for (WorkItem& item : pending) item.task();
+  }
+
+  static void workerLoop() {
+    activeRenderer->makeContextCurrent();
+
+    while (true) {
+      WorkItem item;
+      {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueCV.wait(lock, [] { return stopping || !queue.empty(); });
+        if (queue.empty()) break; // stopping, and everything queued ran
+        item = std::move(queue.front());
+        queue.pop_front();
+      }
+
+      if (item.task) item.task();
+
+      if (item.frame) {
+        drawFrame(*item.frame);
+        // the packet is released here, off the main thread
+        item.frame.reset();
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        framesInFlight--;
+        frameDoneCV.notify_all();
+      }
+    }
+
+    activeRenderer->releaseContext();
+  }
+
+  void Start(OpenGLRenderer* renderer, bool useThread) {
+    activeRenderer = renderer;
+    ownerId = std::this_thread::get_id();
+    threaded = useThread;
+    if (!threaded) return;
+
+    stopping = false;
+    renderer->releaseContext();
+    worker = std::thread(workerLoop);
+    workerId = worker.get_id();
+  }
+
+  void Stop() {
+    if (threaded) {
+      {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+      }
+      queueCV.notify_all();
+      worker.join();
+      threaded = false;
+      activeRenderer->makeContextCurrent();
+    } else {
+      drainInline();
+    }
+    activeRenderer = nullptr;
+  }
+
+  bool IsReady() {
+    return activeRenderer != nullptr;
+  }
+
+  bool IsThreaded() {
+    return threaded;
+  }
+
+  void RunOnGL(std::function<void()> task) {
+    std::thread::id self = std::this_thread::get_id();
+    if (!activeRenderer || (threaded ? self == workerId : self == ownerId)) {
+      if (!threaded) drainInline();
+      task();
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      queue.push_back({std::move(task), nullptr});
+    }
+    queueCV.notify_one();
+  }
+
+  void RunOnGLSync(const std::function<void()>& task) {
+    if (!threaded || std::this_thread::get_id() == workerId) {
+      RunOnGL(task);
+      return;
+    }
+    std::promise<void> done;
+    std::future<void> finished = done.get_future();
+    RunOnGL([&task, &done] {
+      task();
+      done.set_value();
+    });
+    finished.wait();
+  }
+
+  void SubmitFrame(FramePacket&& packet) {
+    if (!threaded) {
+      drainInline();
+      drawFrame(packet);
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    frameDoneCV.wait(lock, [] { return framesInFlight < MAX_FRAMES_IN_FLIGHT; });
+    framesInFlight++;
+    queue.push_back({nullptr, std::make_unique<FramePacket>(std::move(packet))});
+    lock.unlock();
+    queueCV.notify_one();
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <functional>
+#include "commands.h"
+#include "../ui/ui.h"
+
+class OpenGLRenderer;
+
+// Everything the renderer needs to draw one frame. The main thread fills it
+// and hands it over; after that it is never touched again, so the render
+// thread can read it while the main thread builds the next one.
+struct FramePacket {
+  RenderCommandList commands;
+  DamageTracker damage;
+};
+
+// Owns the GL context. With the render thread enabled, frames and all GL
+// work (texture uploads, glyph uploads, deletes) run on a dedicated thread in
+// the order they were queued; otherwise everything runs inline on the caller,
+// exactly as before. Code outside the renderer must not call GL directly,
+// only through RunOnGL / RunOnGLSync.
+namespace RenderThread {
+  // call with the context current on the calling thread; `threaded` moves it
+  // to a new render thread
+  void Start(OpenGLRenderer* renderer, bool threaded);
+  // drains the queue and joins; the context is current on the caller again
+  void Stop();
+
+  bool IsReady();    // Start has run, so GL work can be queued
+  bool IsThreaded();
+
+  // runs `task` where the context lives, after everything queued before it.
+  // Safe from any thread; without the render thread, calls from other
+  // threads wait for the main thread's next GL call or frame.
+  void RunOnGL(std::function<void()> task);
+  // same, but waits until it ran; main or render thread only
+  void RunOnGLSync(const std::function<void()>& task);
+
+  // hands a frame to the renderer. At most one frame is in flight: this
+  // waits until the previous one has been presented, which bounds input
+  // latency to a single frame.
+  void SubmitFrame(FramePacket&& packet);
+}
@@ -6,7 +6,7 @@ class Renderer {
   public:
     virtual ~Renderer() = default;
 
-    virtual void beginFrame(const DamageRect& damage) = 0;
+    virtual void beginFrame(const DamageTracker& damage) = 0;
     virtual void endFrame() = 0;
     virtual void submit(const RenderCommandList& commandList) = 0;
 };
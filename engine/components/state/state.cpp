@@ -25,6 +25,46 @@ StateManager& StateManager::instance() {
   return inst;
 }
 
+void StateManager::setState(const std::string& key, StateValue value) {
+  auto it = store.find(key);
+  if (it != store.end() && it->second == value) return;
+  store[key] = value;
+
+  auto subs = subscribers.find(key);
+  if (subs == subscribers.end() || subs->second.empty()) {
+    fullRender = true;
+    return;
+  }
+
+  for (Node* component : subs->second) {
+    if (component) dirtyComponents.insert(component);
+    else fullRender = true;
+  }
+}
+
+void StateManager::subscribe(Node* component, const std::vector<std::string>& keys) {
+  unsubscribe(component);
+  for (const std::string& key : keys) {
+    subscribers[key].insert(component);
+  }
+  subscriptions[component] = keys;
+}
+
+void StateManager::unsubscribe(Node* component) {
+  dirtyComponents.erase(component);
+
+  auto it = subscriptions.find(component);
+  if (it == subscriptions.end()) return;
+
+  for (const std::string& key : it->second) {
+    auto subs = subscribers.find(key);
+    if (subs == subscribers.end()) continue;
+    subs->second.erase(component);
+    if (subs->second.empty()) subscribers.erase(subs);
+  }
+  subscriptions.erase(it);
+}
+
 int l_setState(lua_State* L) {
   const char* key = luaL_checkstring(L, 1);
 
@@ -83,8 +123,9 @@ void registerStateBindings(lua_State* L) {
 
 
 int l_markDirty(lua_State* L) {
-    // Safely forces the StateManager to become dirty by setting a dummy value
-    StateManager::instance().setState("__force_redraw", (int)SDL_GetTicks());
+    // store.lua and friends keep their data outside the state store, so the
+    // only safe answer is to re-run App()
+    StateManager::instance().markFullRender();
     return 0;
 }
 
@@ -7,42 +7,102 @@
 #else
     #include <endian.h>
 #endif
+#include <algorithm>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 #include "../../lua.hpp"
 
 using StateValue = std::variant<int, float, std::string, bool>;
 
+struct Node;
+
 class StateManager {
   public:
     static StateManager& instance();
       
 
-    StateValue getState(const std::string key, StateValue defaultValue) {
-      if (store.find(key) == store.end()) {
-        store[key] = defaultValue;
+    StateValue getState(const std::string& key, StateValue defaultValue) {
+      auto it = store.find(key);
+      if (it == store.end()) {
+        it = store.emplace(key, defaultValue).first;
+      }
+      if (!trackingStack.empty()) {
+        auto& keys = trackingStack.back();
+        if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+          keys.push_back(key);
+        }
       }
-      return store[key];
+      return it->second;
     }
 
-    void setState(const std::string& key, StateValue value) {
-      store[key] = value;
-      dirty = true;
-    }
+    // Writing the value a key already holds is a no-op. Otherwise only the
+    // components that read the key during their last render are scheduled;
+    // keys read by App() (or by nobody) still re-run the whole App().
+    void setState(const std::string& key, StateValue value);
 
     bool isDirty() const {
-      return dirty;
+      return fullRender || !dirtyComponents.empty();
+    }
+
+    bool needsFullRender() const {
+      return fullRender;
+    }
+
+    void markFullRender() {
+      fullRender = true;
+    }
+
+    void clearFullRender() {
+      fullRender = false;
+    }
+
+    bool hasDirtyComponents() const {
+      return !dirtyComponents.empty();
     }
 
-    void clearDirty() {
-      dirty = false;
+    // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+    // ╏ COMPONENT SUBSCRIPTIONS     ╏
+    // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+    // Every useState() between beginTracking() and endTracking() is recorded,
+    // the returned keys are then handed to subscribe(). A null component
+    // stands for the global App() function.
+    void beginTracking() {
+      trackingStack.emplace_back();
+    }
+
+    std::vector<std::string> endTracking() {
+      std::vector<std::string> keys = std::move(trackingStack.back());
+      trackingStack.pop_back();
+      return keys;
+    }
+
+    void subscribe(Node* component, const std::vector<std::string>& keys);
+    void unsubscribe(Node* component);
+
+    bool isComponentDirty(Node* component) const {
+      return dirtyComponents.count(component) > 0;
+    }
+
+    // removes the component from the pending set, returns true if it was dirty
+    bool consumeDirty(Node* component) {
+      return dirtyComponents.erase(component) > 0;
+    }
+
+    std::vector<Node*> dirtyComponentList() const {
+      return std::vector<Node*>(dirtyComponents.begin(), dirtyComponents.end());
     }
 
   private:
     std::unordered_map<std::string, StateValue> store;
-    bool dirty = false;
+    bool fullRender = false;
+
+    std::vector<std::vector<std::string>> trackingStack;
+    std::unordered_map<std::string, std::unordered_set<Node*>> subscribers;
+    std::unordered_map<Node*, std::vector<std::string>> subscriptions;
+    std::unordered_set<Node*> dirtyComponents;
 };
 
 void registerStateBindings(lua_State* L);
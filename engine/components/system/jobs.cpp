@@ -0,0 +1,175 @@
+#include "jobs.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Jobs {
+  static constexpr int PRIORITY_COUNT = 3;
+  static constexpr unsigned MAX_CPU_WORKERS = 4;
+  static constexpr unsigned IO_WORKERS = 8;
+
+  static std::atomic<bool> shuttingDown(false);
+
+  CancelToken::CancelToken() : cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+  void CancelToken::Cancel() const {
+    cancelled->store(true);
+  }
+
+  bool CancelToken::IsCancelled() const {
+    return cancelled->load() || shuttingDown.load();
+  }
+
+  struct Task {
+    Job job;
+    CancelToken token;
+  };
+
+  // one per thread; the owner takes from the front, thieves from the back
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks[PRIORITY_COUNT];
+  };
+
+  struct PoolState {
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCV;
+    size_t pending = 0; // guarded by sleepMutex
+    size_t nextQueue = 0;
+    bool stopping = false;
+  };
+
+  static PoolState pools[2];
+
+  // set on worker threads, so a job submitting follow-up work keeps it local
+  static thread_local PoolState* currentPool = nullptr;
+  static thread_local size_t currentIndex = 0;
+
+  static bool takeFrom(WorkerQueue& q, int priority, bool own, Task& out) {
+    std::lock_guard<std::mutex> lock(q.mutex);
+    std::deque<Task>& tasks = q.tasks[priority];
+    if (tasks.empty()) return false;
+    if (own) {
+      out = std::move(tasks.front());
+      tasks.pop_front();
+    } else {
+      out = std::move(tasks.back());
+      tasks.pop_back();
+    }
+    return true;
+  }
+
+  // higher priorities win over locality: a High task on another worker is
+  // taken before a Normal one of our own
+  static bool findTask(PoolState& pool, size_t self, Task& out) {
+    size_t count = pool.queues.size();
+    for (int p = 0; p < PRIORITY_COUNT; p++) {
+      if (takeFrom(*pool.queues[self], p, true, out)) return true;
+      for (size_t i = 1; i < count; i++) {
+        if (takeFrom(*pool.queues[(self + i) % count], p, false, out)) return true;
+      }
+    }
+    return false;
+  }
+
+  static void workerLoop(PoolState& pool, size_t self) {
+    currentPool = &pool;
+    currentIndex = self;
+
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(pool.sleepMutex);
+        pool.sleepCV.wait(lock, [&] { return pool.stopping || pool.pending > 0; });
+        // a stopping pool still drains its queues; every token reads as
+        // cancelled by then, so the jobs only clean up
+        if (pool.stopping && pool.pending == 0) return;
+      }
+
+      Task task;
+      if (!findTask(pool, self, task)) {
+        // counted but not queued yet, or taken by another worker
+        std::this_thread::yield();
+        continue;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(pool.sleepMutex);
+        pool.pending--;
+      }
+      task.job(task.token);
+    }
+  }
+
+  static void startPool(PoolState& pool, unsigned count) {
+    pool.stopping = false;
+    pool.pending = 0;
+    for (unsigned i = 0; i < count; i++) {
+      pool.queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (unsigned i = 0; i < count; i++) {
+      pool.threads.emplace_back(workerLoop, std::ref(pool), (size_t)i);
+    }
+  }
+
+  static void stopPool(PoolState& pool) {
+    {
+      std::lock_guard<std::mutex> lock(pool.sleepMutex);
+      pool.stopping = true;
+    }
+    pool.sleepCV.notify_all();
+    for (std::thread& t : pool.threads) t.join();
+    pool.threads.clear();
+    pool.queues.clear();
+  }
+
+  void Init() {
+    shuttingDown = false;
+
+    // the main, render and frame-pool threads want cores too
+    unsigned hw = std::thread::hardware_concurrency();
+    unsigned cpuWorkers = std::clamp(hw / 2, 1u, MAX_CPU_WORKERS);
+
+    startPool(pools[(int)Pool::CPU], cpuWorkers);
+    startPool(pools[(int)Pool::IO], IO_WORKERS);
+  }
+
+  void ShutDown() {
+    shuttingDown = true;
+    stopPool(pools[(int)Pool::IO]);
+    stopPool(pools[(int)Pool::CPU]);
+  }
+
+  void Submit(Pool which, Priority priority, Job job, CancelToken token) {
+    PoolState& pool = pools[(int)which];
+    if (pool.queues.empty()) {
+      // before Init or after ShutDown there is nobody to run it
+      job(token);
+      return;
+    }
+
+    size_t target;
+    if (currentPool == &pool) {
+      target = currentIndex;
+    } else {
+      std::lock_guard<std::mutex> lock(pool.sleepMutex);
+      target = pool.nextQueue++ % pool.queues.size();
+    }
+
+    // counted before it is queued, so `pending` never drops below the tasks
+    // a worker can find
+    {
+      std::lock_guard<std::mutex> lock(pool.sleepMutex);
+      pool.pending++;
+    }
+    {
+      std::lock_guard<std::mutex> lock(pool.queues[target]->mutex);
+      pool.queues[target]->tasks[(int)priority].push_back({std::move(job), std::move(token)});
+    }
+    pool.sleepCV.notify_one();
+  }
+}
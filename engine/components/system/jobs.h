@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Background work that isn't tied to a frame: decoding and compressing
+// textures, HTTP requests, disk reads. Two fixed pools so a slow download
+// never holds up a decode: CPU for computation, IO for anything that
+// blocks. Each worker owns a queue per priority and idle workers steal
+// from the others, so a burst submitted at once spreads across the pool.
+// Frame-critical fork/join work goes through WorkerPool instead.
+namespace Jobs {
+  enum class Pool { CPU, IO };
+  enum class Priority { High, Normal, Low };
+
+  // Shared flag between whoever submitted a job and the job. A cancelled
+  // job still runs, so it can release what it owns; it should check the
+  // token and return early. Every token reads as cancelled once ShutDown
+  // has started.
+  class CancelToken {
+    public:
+      CancelToken();
+
+      void Cancel() const;
+      bool IsCancelled() const;
+
+    private:
+      std::shared_ptr<std::atomic<bool>> cancelled;
+  };
+
+  using Job = std::function<void(const CancelToken&)>;
+
+  void Init();
+  // cancels everything, runs the jobs that haven't started with their
+  // (now cancelled) tokens so they can release what they own, and joins the
+  // workers; a running job has to notice its token to end quickly
+  void ShutDown();
+
+  void Submit(Pool pool, Priority priority, Job job, CancelToken token = CancelToken());
+}
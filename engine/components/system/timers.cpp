@@ -0,0 +1,245 @@
+#include "timers.h"
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <lua.h>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+#include "../../scripting/regsitry.h"
+
+namespace Timers {
+  static constexpr uint64_t FRAME_INTERVAL_MS = 16;
+
+  struct Timer {
+    int ref;
+    uint64_t interval; // 0 for one-shot timers
+  };
+
+  // ordered by deadline, then by creation so equal deadlines run in order
+  struct Deadline {
+    uint64_t at;
+    uint64_t seq;
+    int id;
+
+    bool operator>(const Deadline& other) const {
+      return at != other.at ? at > other.at : seq > other.seq;
+    }
+  };
+
+  // cleared timers are only dropped from the map; their heap entries are
+  // skipped when they come up
+  static std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines;
+  static std::unordered_map<int, Timer> timers;
+  static std::vector<int> frameCallbacks; // ids, run before the next frame
+  static int nextId = 1;
+  static uint64_t nextSeq = 0;
+
+  static bool hasEngineWake = false;
+  static uint64_t engineWake = 0;
+  static bool frameRequested = false;
+  static uint64_t lastFrame = 0;
+  static bool windowVisible = true;
+
+  // 64-bit ms clock; SDL_GetTicks wraps after 49 days, which a kiosk can
+  // outlive
+  static uint64_t now() {
+    static const uint64_t perMs = std::max<uint64_t>(1, SDL_GetPerformanceFrequency() / 1000);
+    return SDL_GetPerformanceCounter() / perMs;
+  }
+
+  void Init() {
+    lastFrame = now();
+  }
+
+  void ShutDown(lua_State* L) {
+    for (auto& pair : timers) {
+      luaL_unref(L, LUA_REGISTRYINDEX, pair.second.ref);
+    }
+    timers.clear();
+    frameCallbacks.clear();
+    deadlines = {};
+  }
+
+  static void schedule(int id, uint64_t at) {
+    deadlines.push({at, nextSeq++, id});
+  }
+
+  static void callTimer(lua_State* L, int ref, const char* what) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    if (lua_isfunction(L, -1)) {
+      lua_pushinteger(L, (lua_Integer)now());
+      if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+        std::cerr << what << " Error: " << lua_tostring(L, -1) << std::endl;
+        lua_pop(L, 1);
+      }
+    } else {
+      lua_pop(L, 1);
+    }
+  }
+
+  bool ProcessQueue(lua_State* L) {
+    bool ran = false;
+    uint64_t t = now();
+
+    // timers created by the callbacks below wait for the next pass, so a
+    // zero-delay interval can't spin this loop forever
+    uint64_t seqLimit = nextSeq;
+
+    while (!deadlines.empty() && deadlines.top().at <= t && deadlines.top().seq < seqLimit) {
+      Deadline due = deadlines.top();
+      deadlines.pop();
+
+      auto it = timers.find(due.id);
+      if (it == timers.end()) continue;
+
+      int ref = it->second.ref;
+      if (it->second.interval > 0) {
+        // a late interval skips the ticks it missed instead of bursting
+        uint64_t next = due.at + it->second.interval;
+        schedule(due.id, next > t ? next : t + it->second.interval);
+        callTimer(L, ref, "setInterval");
+      } else {
+        timers.erase(it);
+        callTimer(L, ref, "setTimeout");
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+      }
+      ran = true;
+    }
+
+    if (windowVisible && !frameCallbacks.empty()) {
+      std::vector<int> pending;
+      pending.swap(frameCallbacks);
+      for (int id : pending) {
+        auto it = timers.find(id);
+        if (it == timers.end()) continue;
+        int ref = it->second.ref;
+        timers.erase(it);
+        callTimer(L, ref, "requestFrame");
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+        ran = true;
+      }
+    }
+
+    return ran;
+  }
+
+  void WakeIn(uint32_t ms) {
+    uint64_t at = now() + ms;
+    if (!hasEngineWake || at < engineWake) {
+      engineWake = at;
+      hasEngineWake = true;
+    }
+  }
+
+  void RequestFrame() {
+    frameRequested = true;
+  }
+
+  void FrameDone() {
+    lastFrame = now();
+  }
+
+  void SetWindowVisible(bool visible) {
+    windowVisible = visible;
+  }
+
+  int NextWaitTimeout() {
+    bool found = false;
+    uint64_t wake = 0;
+    auto consider = [&](uint64_t at) {
+      if (!found || at < wake) {
+        wake = at;
+        found = true;
+      }
+    };
+
+    while (!deadlines.empty() && timers.find(deadlines.top().id) == timers.end()) {
+      deadlines.pop();
+    }
+    if (!deadlines.empty()) consider(deadlines.top().at);
+
+    // nothing is drawn while hidden, so nothing that only feeds a frame
+    // is allowed to wake us
+    if (windowVisible) {
+      if (frameRequested || !frameCallbacks.empty()) consider(lastFrame + FRAME_INTERVAL_MS);
+      if (hasEngineWake) consider(engineWake);
+    }
+
+    hasEngineWake = false;
+    frameRequested = false;
+
+    if (!found) return -1;
+
+    uint64_t t = now();
+    return wake <= t ? 0 : (int)std::min<uint64_t>(wake - t, 0x7fffffff);
+  }
+
+  void WakeMainThread() {
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = SDL_USEREVENT;
+    SDL_PushEvent(&event);
+  }
+
+  // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+  // ╏ LUA BINDINGS FOR TIMERS ╏
+  // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+
+  static int addTimer(lua_State* L, bool repeat) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_Integer delay = luaL_optinteger(L, 2, 0);
+    if (delay < 0) delay = 0;
+    // an interval of 0 would fire on every pass
+    if (repeat && delay < 1) delay = 1;
+
+    lua_pushvalue(L, 1);
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    int id = nextId++;
+    timers[id] = {ref, repeat ? (uint64_t)delay : 0};
+    schedule(id, now() + (uint64_t)delay);
+
+    lua_pushinteger(L, id);
+    return 1;
+  }
+
+  int SetTimeout(lua_State* L) {
+    return addTimer(L, false);
+  }
+
+  int SetInterval(lua_State* L) {
+    return addTimer(L, true);
+  }
+
+  int ClearTimer(lua_State* L) {
+    int id = (int)luaL_checkinteger(L, 1);
+    auto it = timers.find(id);
+    if (it != timers.end()) {
+      luaL_unref(L, LUA_REGISTRYINDEX, it->second.ref);
+      timers.erase(it);
+    }
+    return 0;
+  }
+
+  int LuaRequestFrame(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_pushvalue(L, 1);
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    int id = nextId++;
+    timers[id] = {ref, 0};
+    frameCallbacks.push_back(id);
+
+    lua_pushinteger(L, id);
+    return 1;
+  }
+
+  AutoRegisterLua regSetTimeout("setTimeout", SetTimeout);
+  AutoRegisterLua regSetInterval("setInterval", SetInterval);
+  AutoRegisterLua regClearTimer("clearTimer", ClearTimer);
+  AutoRegisterLua regClearTimeout("clearTimeout", ClearTimer);
+  AutoRegisterLua regClearInterval("clearInterval", ClearTimer);
+  AutoRegisterLua regRequestFrame("requestFrame", LuaRequestFrame);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <lua.hpp>
+#include <cstdint>
+
+// Everything that needs the main loop to wake up without an input event
+// goes through here: Lua timers (setTimeout / setInterval / requestFrame)
+// and the engine's own animations (smooth scrolling, caret blink, loading
+// images, on_tick). The loop sleeps until the nearest deadline, or until
+// the next event when there is none.
+namespace Timers {
+  // Engine lifecycle
+  void Init();
+  void ShutDown(lua_State* L);
+
+  // runs every Lua timer that is due and the pending requestFrame
+  // callbacks; true if any ran
+  bool ProcessQueue(lua_State* L);
+
+  // engine-side wake requests; they only hold for the next sleep, so
+  // anything still animating asks again every iteration
+  void WakeIn(uint32_t ms);
+  void RequestFrame(); // wake one frame interval after the last frame
+
+  // call once a frame has been presented; frame requests are paced from it
+  void FrameDone();
+
+  // frame requests and requestFrame callbacks are held while hidden
+  void SetWindowVisible(bool visible);
+
+  // ms the loop may sleep, or -1 to wait for the next event; consumes the
+  // engine-side wake requests
+  int NextWaitTimeout();
+
+  // wakes a loop blocked in SDL_WaitEvent; safe from any thread
+  void WakeMainThread();
+
+  // Lua API
+  int SetTimeout(lua_State* L);
+  int SetInterval(lua_State* L);
+  int ClearTimer(lua_State* L);
+  int LuaRequestFrame(lua_State* L);
+}
@@ -0,0 +1,119 @@
+#include "worker_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace WorkerPool {
+  // main and render threads are busy as well, so leave them their cores
+  static constexpr unsigned MAX_WORKERS = 7;
+
+  struct Batch {
+    const std::function<void(size_t)>* fn = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+  };
+
+  static std::vector<std::thread> workers;
+  static std::mutex poolMutex;
+  static std::condition_variable wakeCV;
+  static std::condition_variable doneCV;
+  static Batch* current = nullptr;
+  static uint64_t generation = 0;
+  static int activeWorkers = 0; // workers holding a pointer to `current`
+  static bool stopping = false;
+
+  // one batch at a time; also keeps a nested call from publishing a batch
+  static std::mutex submitMutex;
+  static thread_local bool insideJob = false;
+
+  // claims indices until the batch is exhausted
+  static void runIndices(Batch& batch) {
+    insideJob = true;
+    while (true) {
+      size_t i = batch.next.fetch_add(1);
+      if (i >= batch.count) break;
+      (*batch.fn)(i);
+      batch.done.fetch_add(1);
+    }
+    insideJob = false;
+  }
+
+  static void workerLoop() {
+    uint64_t seen = 0;
+    while (true) {
+      Batch* batch;
+      {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        wakeCV.wait(lock, [&] { return stopping || (current && generation != seen); });
+        if (stopping) return;
+        seen = generation;
+        batch = current;
+        activeWorkers++;
+      }
+
+      runIndices(*batch);
+
+      std::lock_guard<std::mutex> lock(poolMutex);
+      activeWorkers--;
+      doneCV.notify_all();
+    }
+  }
+
+  void Init() {
+    unsigned hw = std::thread::hardware_concurrency();
+    unsigned count = hw > 2 ? std::min(hw - 2, MAX_WORKERS) : 0;
+
+    stopping = false;
+    for (unsigned i = 0; i < count; i++) {
+      workers.emplace_back(workerLoop);
+    }
+  }
+
+  void ShutDown() {
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      stopping = true;
+    }
+    wakeCV.notify_all();
+    for (std::thread& t : workers) t.join();
+    workers.clear();
+  }
+
+  int WorkerCount() {
+    return (int)workers.size();
+  }
+
+  void ParallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0) return;
+    if (workers.empty() || count == 1 || insideJob) {
+      for (size_t i = 0; i < count; i++) fn(i);
+      return;
+    }
+
+    std::lock_guard<std::mutex> submit(submitMutex);
+
+    Batch batch;
+    batch.fn = &fn;
+    batch.count = count;
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      current = &batch;
+      generation++;
+    }
+    wakeCV.notify_all();
+
+    runIndices(batch);
+
+    // `batch` lives on this stack, so wait until every index ran and no
+    // worker still holds it; clearing `current` under the same lock keeps
+    // late wakers from picking it up
+    std::unique_lock<std::mutex> lock(poolMutex);
+    doneCV.wait(lock, [&] { return batch.done.load() == count && activeWorkers == 0; });
+    current = nullptr;
+  }
+}
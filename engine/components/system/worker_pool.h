@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// A few long-lived threads for splitting one frame's CPU work (command
+// generation, text wrapping) across cores. The calling thread works too and
+// ParallelFor returns only when every index ran, so callers can treat it
+// like a plain loop whose iterations must not touch shared state.
+namespace WorkerPool {
+  void Init();
+  void ShutDown();
+
+  // helper threads; 0 means ParallelFor runs everything on the caller
+  int WorkerCount();
+
+  // calls fn(i) for every i in [0, count). Nested calls from inside a job
+  // run serially on the thread that made them.
+  void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+}
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <freetype/fttypes.h>
 #include <iostream>
 #include <ft2build.h>
@@ -14,6 +15,7 @@
 #include <ostream>
 #include <sys/types.h>
 #include <utility>
+#include <unordered_set>
 #include <vector>
 #include "../ui/ui.h"
 #include FT_FREETYPE_H
@@ -21,6 +23,8 @@
 
 
 #include "../system/pathUtils.h"
+#include "../renderer/render_thread.h"
+#include "../system/worker_pool.h"
 #include "../../scripting/regsitry.h"
 
 // file local global font storage
@@ -157,21 +161,24 @@ std::pair<int, Font*> UI_LoadFont(const std::string &path, int logicalSize, int
 
 
 void Font::AllocateAtlasPage() {
-  if (atlasArrayID == 0) {
-    glGenTextures(1, &atlasArrayID);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, atlasArrayID);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    std::vector<unsigned char> emptyData(atlasWidth * atlasHeight * maxLayers, 0);
-  
-    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, atlasWidth, atlasHeight, maxLayers, 0, GL_RED, GL_UNSIGNED_BYTE, emptyData.data());
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE); 
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  if (!atlasCreated) {
+    atlasCreated = true;
+    RenderThread::RunOnGL([this] {
+      glGenTextures(1, &atlasArrayID);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, atlasArrayID);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+      std::vector<unsigned char> emptyData(atlasWidth * atlasHeight * maxLayers, 0);
+    
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, atlasWidth, atlasHeight, maxLayers, 0, GL_RED, GL_UNSIGNED_BYTE, emptyData.data());
+
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE); 
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    });
   }
 
   currentLayer++;
@@ -307,13 +314,20 @@ const Character* Font::LoadGlyph(uint32_t c) {
   int packY = rect.y;
 
 
-  glBindTexture(GL_TEXTURE_2D_ARRAY, atlasArrayID);
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, std::abs(face->glyph->bitmap.pitch));
+  // FreeType reuses the glyph slot on the next load, so the upload gets its
+  // own tightly packed copy
+  std::vector<unsigned char> pixels((size_t)glyphW * glyphH);
+  int pitch = std::abs(face->glyph->bitmap.pitch);
+  for (unsigned int row = 0; row < glyphH; row++) {
+    std::memcpy(pixels.data() + (size_t)row * glyphW, face->glyph->bitmap.buffer + (size_t)row * pitch, glyphW);
+  }
 
-  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, packX, packY, currentLayer, glyphW, glyphH, 1, GL_RED, GL_UNSIGNED_BYTE, face->glyph->bitmap.buffer);
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  int layer = currentLayer;
+  RenderThread::RunOnGL([this, pixels = std::move(pixels), packX, packY, layer, glyphW, glyphH] {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, atlasArrayID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, packX, packY, layer, glyphW, glyphH, 1, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+  });
 
   float uMin = (float)packX / (float) atlasWidth;
   float vMin = (float)packY / (float) atlasHeight;
@@ -337,6 +351,7 @@ const Character* Font::LoadGlyph(uint32_t c) {
 // ╏ LOGIC FOR LOADING CACHED CHARACTERS ╏
 // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
 const Character* Font::GetCharInternal(uint32_t c)  {
+  std::lock_guard<std::mutex> lock(glyphMutex);
   auto it = characters.find(c);
   if (it != characters.end()) {
     return &it->second;
@@ -360,6 +375,7 @@ const Character& Font::GetCharacter(uint32_t c) {
     if (fbChar) return *fbChar;
   }
 
+  std::lock_guard<std::mutex> lock(glyphMutex);
   auto fb = characters.find('?');
   if (fb != characters.end()) {
     return fb->second;
@@ -381,8 +397,7 @@ const Character& Font::GetCharacter(uint32_t c) {
 // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
 
 int l_load_font(lua_State* L) {
-  const GLubyte* ver = glGetString(GL_VERSION);
-  if (!ver) {
+  if (!RenderThread::IsReady()) {
     return luaL_error(L, "ERROR: load_font() called before OpenGL context is ready");
   }
 
@@ -461,7 +476,8 @@ int l_draw_text(lua_State* L) {
     lua_rawgeti(L, 5, 4); color.a = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
   }
 
-  activeCommandList->push(DrawTextCommand{std::string(str), font, x, y, color});
+  std::vector<uint32_t> codepoints = Font::DecodeUTF8(str);
+  activeCommandList->push(DrawTextCommand{font->ShapeRun(codepoints.data(), codepoints.size()), font, x, y, color});
   return 0;
 }
 
@@ -469,11 +485,15 @@ static AutoRegisterLua _reg_load_font("load_font", l_load_font);
 static AutoRegisterLua _reg_draw_text("draw_text", l_draw_text);
 
 void UI_ShutdownFonts() {
+  UI_ClearWrapCache();
   g_fonts.clear();
   g_nextFontId = 1;
 }
 
-std::vector<TextLine> Font::CalculateWordWrap(const std::vector<uint32_t>& codepoints, float maxWidth) {
+// the line breaker shared by both CalculateWordWrap overloads; `advance`
+// maps a codepoint to its logical advance
+template <typename AdvanceFn>
+static std::vector<TextLine> wrapCodepoints(const std::vector<uint32_t>& codepoints, float maxWidth, AdvanceFn&& advance) {
   std::vector<TextLine> lines;
   if (codepoints.empty()) return lines;
 
@@ -496,7 +516,7 @@ std::vector<TextLine> Font::CalculateWordWrap(const std::vector<uint32_t>& codep
       continue;
     }
 
-    float charWidth = GetLogicalAdvance(c);
+    float charWidth = advance(c);
 
     if (c == ' ') {
       lastSpaceIdx = i;
@@ -528,6 +548,217 @@ std::vector<TextLine> Font::CalculateWordWrap(const std::vector<uint32_t>& codep
 }
 
 
+std::vector<TextLine> Font::CalculateWordWrap(const std::vector<uint32_t>& codepoints, float maxWidth) {
+  return wrapCodepoints(codepoints, maxWidth, [this](uint32_t c) { return GetLogicalAdvance(c); });
+}
+
+std::vector<TextLine> Font::CalculateWordWrap(const AdvanceTable& advances, const std::vector<uint32_t>& codepoints, float maxWidth) {
+  return wrapCodepoints(codepoints, maxWidth, [&advances](uint32_t c) {
+    float adv = 0.0f;
+    advances.find(c, adv);
+    return adv;
+  });
+}
+
+AdvanceTableRef Font::ResolveAdvances(const std::vector<uint32_t>& codepoints) {
+  std::shared_ptr<AdvanceTable> next;
+  for (uint32_t c : codepoints) {
+    if (c == '\n' || c == '\r') continue;
+    float adv;
+    if (advanceTable->find(c, adv) || (next && next->find(c, adv))) continue;
+
+    // copy on first miss only; tables handed out earlier stay as they were
+    if (!next) next = std::make_shared<AdvanceTable>(*advanceTable);
+    adv = GetLogicalAdvance(c);
+    if (c < 128) {
+      next->ascii[c] = adv;
+      next->hasAscii[c] = true;
+    } else {
+      next->other[c] = adv;
+    }
+  }
+  if (next) advanceTable = std::move(next);
+  return advanceTable;
+}
+
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ GLYPH RUN SHAPING ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Glyphs are looked up (and rasterized into the atlas on first use) here,
+// once per line, instead of on every submit. Blank glyphs only advance the pen.
+GlyphRunRef Font::ShapeRun(const uint32_t* codepoints, size_t count) {
+  auto run = std::make_shared<GlyphRun>();
+  run->glyphs.reserve(count);
+
+  float penX = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    const Character& ch = GetCharacter(codepoints[i]);
+
+    if (ch.SizeX > 0 && ch.SizeY > 0) {
+      run->glyphs.push_back({
+          penX + (ch.BearingX / dpiScale),
+          (ch.SizeY - ch.BearingY) / dpiScale,
+          (float)ch.SizeX / dpiScale,
+          (float)ch.SizeY / dpiScale,
+          ch.pageIndex,
+          ch.uMin, ch.vMin,
+          ch.uMax, ch.vMax
+          });
+    }
+
+    penX += ((ch.Advance >> 6) / dpiScale);
+  }
+
+  run->advance = penX;
+  return run;
+}
+
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ WORD WRAP CACHE   ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Fonts live until UI_ShutdownFonts, so the Font pointer is a stable part of
+// the key. The table is simply dropped when it grows past its cap; a list of
+// a few thousand distinct strings re-wraps once and is warm again.
+
+struct WrapKey {
+  uint64_t textHash;
+  Font* font;
+  uint32_t widthBits;
+  uint32_t length;
+
+  bool operator==(const WrapKey& o) const {
+    return textHash == o.textHash && font == o.font && widthBits == o.widthBits && length == o.length;
+  }
+};
+
+struct WrapKeyHash {
+  size_t operator()(const WrapKey& k) const {
+    uint64_t h = k.textHash ^ ((uint64_t)(uintptr_t)k.font * 0x9E3779B97F4A7C15ull);
+    h ^= ((uint64_t)k.widthBits << 32) | k.length;
+    return (size_t)(h ^ (h >> 29));
+  }
+};
+
+static constexpr size_t MAX_WRAP_CACHE_ENTRIES = 4096;
+static std::unordered_map<WrapKey, WrapResultRef, WrapKeyHash> g_wrapCache;
+
+uint64_t UI_HashCodepoints(const std::vector<uint32_t>& codepoints) {
+  uint64_t h = 1469598103934665603ull;
+  for (uint32_t c : codepoints) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static WrapKey makeWrapKey(Font* font, const std::vector<uint32_t>& codepoints, uint64_t textHash, float maxWidth) {
+  uint32_t widthBits;
+  std::memcpy(&widthBits, &maxWidth, sizeof(widthBits));
+  return {textHash, font, widthBits, (uint32_t)codepoints.size()};
+}
+
+// line list to a shared result with its widest line and soft-wrap flag
+static WrapResultRef finishWrap(std::vector<TextLine>&& lines, const std::vector<uint32_t>& codepoints) {
+  auto result = std::make_shared<WrapResult>();
+  result->lines = std::move(lines);
+
+  size_t hardLines = 0;
+  for (uint32_t c : codepoints) {
+    if (c == '\n') hardLines++;
+  }
+  if (!codepoints.empty() && codepoints.back() != '\n') hardLines++;
+
+  for (const auto& line : result->lines) {
+    result->width = std::max(result->width, line.width);
+  }
+  result->softWrapped = result->lines.size() > hardLines;
+  return result;
+}
+
+static void cacheWrap(const WrapKey& key, const WrapResultRef& result) {
+  if (g_wrapCache.size() >= MAX_WRAP_CACHE_ENTRIES) g_wrapCache.clear();
+  g_wrapCache.emplace(key, result);
+}
+
+WrapResultRef UI_WrapText(Font* font, const std::vector<uint32_t>& codepoints, uint64_t textHash, float maxWidth) {
+  if (!font) return nullptr;
+
+  WrapKey key = makeWrapKey(font, codepoints, textHash, maxWidth);
+
+  auto it = g_wrapCache.find(key);
+  if (it != g_wrapCache.end()) return it->second;
+
+  WrapResultRef result = finishWrap(font->CalculateWordWrap(codepoints, maxWidth), codepoints);
+  cacheWrap(key, result);
+  return result;
+}
+
+void UI_WrapTextBatch(std::vector<WrapRequest>& requests) {
+  struct Pending {
+    WrapRequest* request;
+    WrapKey key;
+    AdvanceTableRef advances;
+  };
+  std::vector<Pending> pending;
+  // requests for a text already pending, and the pending entry they share
+  std::vector<std::pair<WrapRequest*, size_t>> duplicates;
+  std::unordered_map<WrapKey, size_t, WrapKeyHash> pendingByKey;
+
+  // every distinct codepoint the batch needs, per font
+  struct FontCodepoints {
+    std::unordered_set<uint32_t> seen;
+    std::vector<uint32_t> codepoints;
+  };
+  std::unordered_map<Font*, FontCodepoints> needed;
+
+  for (WrapRequest& req : requests) {
+    req.result = nullptr;
+    if (!req.font) continue;
+
+    WrapKey key = makeWrapKey(req.font, *req.codepoints, req.textHash, req.maxWidth);
+    auto it = g_wrapCache.find(key);
+    if (it != g_wrapCache.end()) {
+      req.result = it->second;
+      continue;
+    }
+
+    auto slot = pendingByKey.emplace(key, pending.size());
+    if (!slot.second) {
+      duplicates.push_back({&req, slot.first->second});
+      continue;
+    }
+
+    FontCodepoints& fontNeeds = needed[req.font];
+    for (uint32_t c : *req.codepoints) {
+      if (fontNeeds.seen.insert(c).second) fontNeeds.codepoints.push_back(c);
+    }
+    pending.push_back({&req, key, nullptr});
+  }
+
+  // glyph loading touches FreeType and the GL queue, so it stays here; one
+  // resolve per font publishes at most one new table for the whole batch
+  std::unordered_map<Font*, AdvanceTableRef> tables;
+  for (auto& entry : needed) {
+    tables[entry.first] = entry.first->ResolveAdvances(entry.second.codepoints);
+  }
+  for (Pending& p : pending) p.advances = tables[p.request->font];
+
+  WorkerPool::ParallelFor(pending.size(), [&](size_t i) {
+    WrapRequest& req = *pending[i].request;
+    req.result = finishWrap(Font::CalculateWordWrap(*pending[i].advances, *req.codepoints, req.maxWidth), *req.codepoints);
+  });
+
+  for (const Pending& p : pending) cacheWrap(p.key, p.request->result);
+  for (auto& dup : duplicates) dup.first->result = pending[dup.second].request->result;
+}
+
+void UI_ClearWrapCache() {
+  g_wrapCache.clear();
+}
+
+
 
 
 
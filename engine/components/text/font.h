@@ -6,6 +6,7 @@
 #include <glad/glad.h>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 #include <utility>
 #include "../../lua.hpp"
 #include <vector>
@@ -33,6 +34,49 @@ struct TextLine {
   float width;
 };
 
+// A glyph quad resolved against the atlas, relative to the pen origin of
+// its run (x from the start of the line, y from the baseline down to the
+// bottom edge of the quad). Logical pixels.
+struct ShapedGlyph {
+  float x, y;
+  float w, h;
+  float page;
+  float uMin, vMin;
+  float uMax, vMax;
+};
+
+// One line of text shaped once at layout time; draw commands share it so a
+// redraw does no decoding and no glyph lookups.
+struct GlyphRun {
+  std::vector<ShapedGlyph> glyphs;
+  float advance = 0.0f; // pen advance of the whole run
+};
+
+using GlyphRunRef = std::shared_ptr<const GlyphRun>;
+
+// Logical advances of every glyph a font had resolved when the table was
+// built. Immutable, so wrap workers read it without touching the font;
+// codepoints it lacks are resolved on the main thread and a new table is
+// published (see Font::ResolveAdvances).
+struct AdvanceTable {
+  float ascii[128] = {};
+  bool hasAscii[128] = {};
+  std::unordered_map<uint32_t, float> other;
+
+  bool find(uint32_t c, float& out) const {
+    if (c < 128) {
+      out = ascii[c];
+      return hasAscii[c];
+    }
+    auto it = other.find(c);
+    if (it == other.end()) return false;
+    out = it->second;
+    return true;
+  }
+};
+
+using AdvanceTableRef = std::shared_ptr<const AdvanceTable>;
+
 class Font {
   public:
     Font(const std::string& fontPath, unsigned int fontSize, int styleFlags = FONT_STYLE_NORMAL);
@@ -65,6 +109,13 @@ class Font {
   
     std::vector<TextLine> CalculateWordWrap(const std::vector<uint32_t>& codepoints, float maxWidth);
 
+    // main thread: makes sure every codepoint has an entry in the advance
+    // table, loading glyphs as needed, and returns the table to wrap with
+    AdvanceTableRef ResolveAdvances(const std::vector<uint32_t>& codepoints);
+    // thread-safe wrap against a table that holds every codepoint
+    static std::vector<TextLine> CalculateWordWrap(const AdvanceTable& advances, const std::vector<uint32_t>& codepoints, float maxWidth);
+    GlyphRunRef ShapeRun(const uint32_t* codepoints, size_t count);
+
   private:
     unsigned int lineHeight;
     unsigned int ascent;
@@ -72,7 +123,10 @@ class Font {
     unsigned int atlasWidth = 1024;
     unsigned int atlasHeight = 1024;
 
+    // written and read only where the GL context lives; the main thread
+    // tracks creation with atlasCreated
     unsigned int atlasArrayID = 0;
+    bool atlasCreated = false;
     int currentLayer = -1;
     int maxLayers = 8;
 
@@ -86,6 +140,10 @@ class Font {
     // Cache of loaded characters (Key is Unicode Codepoint)
     std::unordered_map<uint32_t, Character> characters;
 
+    // command generation runs on worker threads and may meet a glyph layout
+    // didn't load; guards the cache, the FreeType face and the atlas packer
+    std::mutex glyphMutex;
+
     void* ftLib = nullptr;
     void* ftFace = nullptr;
 
@@ -95,6 +153,8 @@ class Font {
 
     unsigned int logicalSize;
     float dpiScale;
+
+    AdvanceTableRef advanceTable = std::make_shared<AdvanceTable>();
 };
 
 
@@ -103,6 +163,40 @@ struct FontHandle {
   int id;
 };
 
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ WORD WRAP CACHE   ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// One CalculateWordWrap result. Results are immutable and shared between the
+// per-node cache (Node::wrapCache), the global cache below and the node's
+// applied layout, so a hit never copies the line list.
+struct WrapResult {
+  std::vector<TextLine> lines;
+  float width = 0.0f;      // widest line
+  bool softWrapped = false; // broke at least one line that had no '\n'
+};
+
+using WrapResultRef = std::shared_ptr<const WrapResult>;
+
+uint64_t UI_HashCodepoints(const std::vector<uint32_t>& codepoints);
+
+// Wraps through a process-wide cache keyed by (text hash, font, maxWidth), so
+// the same string in the same font is only ever wrapped once per width.
+WrapResultRef UI_WrapText(Font* font, const std::vector<uint32_t>& codepoints, uint64_t textHash, float maxWidth);
+
+// Many wraps at once, ahead of layout: advances are resolved on the calling
+// (main) thread, then the lines are broken on the worker pool. Fills each
+// request's `result` and the shared cache; requests with the same font, text
+// and width share one wrap.
+struct WrapRequest {
+  Font* font;
+  const std::vector<uint32_t>* codepoints;
+  uint64_t textHash;
+  float maxWidth;
+  WrapResultRef result;
+};
+void UI_WrapTextBatch(std::vector<WrapRequest>& requests);
+void UI_ClearWrapCache();
+
 Font* UI_GetFontById(int id);
 std::pair<int, Font*> UI_LoadFont(const std::string& path, int size, int styleFlags);
 void UI_ShutdownFonts();
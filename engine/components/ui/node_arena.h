@@ -0,0 +1,117 @@
+#pragma once
+#ifndef VULPIS_NODE_ARENA_H
+#define VULPIS_NODE_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ NODE ARENA            ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Fixed-size slabs with an intrusive free list. Slots released by freeTree
+// are handed out again (LIFO) to the next buildNode, so list churn and route
+// changes recycle warm memory instead of going through malloc. Slabs are
+// never returned to the system; the UI tree only ever touches them from the
+// main thread, so there is no locking.
+
+template <typename T, size_t SlabSize = 64>
+class ObjectPool {
+public:
+  static ObjectPool& instance() {
+    static ObjectPool pool;
+    return pool;
+  }
+
+  void* allocate() {
+    if (!freeList) grow();
+    Slot* slot = freeList;
+    freeList = slot->next;
+    live++;
+    return slot->storage;
+  }
+
+  void deallocate(void* p) {
+    if (!p) return;
+    Slot* slot = reinterpret_cast<Slot*>(p);
+    slot->next = freeList;
+    freeList = slot;
+    live--;
+  }
+
+  size_t liveCount() const { return live; }
+  size_t capacity() const { return slabs.size() * SlabSize; }
+
+private:
+  union Slot {
+    Slot* next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  std::vector<std::unique_ptr<Slot[]>> slabs;
+  Slot* freeList = nullptr;
+  size_t live = 0;
+
+  void grow() {
+    slabs.emplace_back(new Slot[SlabSize]);
+    Slot* slab = slabs.back().get();
+    // link back to front so the slab is handed out in address order,
+    // siblings built in one pass end up next to each other
+    for (size_t i = SlabSize; i-- > 0;) {
+      slab[i].next = freeList;
+      freeList = &slab[i];
+    }
+  }
+};
+
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ COLD BLOCKS           ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Rarely used node state lives behind one pointer and is only allocated the
+// first time something writes a non-default value. Reads through `->` see
+// the defaults while the block is absent, writes go through edit()/set().
+
+template <typename T>
+class ColdBlock {
+public:
+  ColdBlock() = default;
+  ColdBlock(const ColdBlock&) = delete;
+  ColdBlock& operator=(const ColdBlock&) = delete;
+  ~ColdBlock() { reset(); }
+
+  bool has() const { return block != nullptr; }
+
+  const T& get() const { return block ? *block : defaults(); }
+  const T* operator->() const { return &get(); }
+
+  T& edit() {
+    if (!block) block = new (ObjectPool<T>::instance().allocate()) T();
+    return *block;
+  }
+
+  // writes a field, but never allocates just to store its default
+  template <typename F, typename V>
+  void set(F T::*field, const V& value) {
+    if (!block && defaults().*field == value) return;
+    edit().*field = value;
+  }
+
+  void reset() {
+    if (!block) return;
+    block->~T();
+    ObjectPool<T>::instance().deallocate(block);
+    block = nullptr;
+  }
+
+private:
+  T* block = nullptr;
+
+  static const T& defaults() {
+    static const T value{};
+    return value;
+  }
+};
+
+#endif
@@ -0,0 +1,407 @@
+#include "style.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <lauxlib.h>
+#include <lua.h>
+#include "../color/color.h"
+#include "../text/font.h"
+#include "../../configLogic/engineConf/engine_config.h"
+#include "../../configLogic/font/font_registry.h"
+#include "../../configLogic/images/texture_registry.h"
+
+namespace Style {
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ VALUE READERS ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Each reader returns false when the Lua value has the wrong type, the key
+// is then treated as absent.
+
+  static bool readValue(lua_State* L, int idx, int& out) {
+    if (!lua_isnumber(L, idx)) return false;
+    out = (int)lua_tonumber(L, idx);
+    return true;
+  }
+
+  static bool readValue(lua_State* L, int idx, float& out) {
+    if (!lua_isnumber(L, idx)) return false;
+    out = (float)lua_tonumber(L, idx);
+    return true;
+  }
+
+  static bool readValue(lua_State* L, int idx, bool& out) {
+    out = lua_toboolean(L, idx);
+    return true;
+  }
+
+  static bool readValue(lua_State* L, int idx, std::string& out) {
+    if (lua_type(L, idx) != LUA_TSTRING) return false;
+    size_t len = 0;
+    const char* str = lua_tolstring(L, idx, &len);
+    out.assign(str, len);
+    return true;
+  }
+
+  static bool readValue(lua_State* L, int idx, Length& out) {
+    if (lua_type(L, idx) == LUA_TNUMBER) {
+      out = Length((float)lua_tonumber(L, idx));
+      return true;
+    }
+    if (lua_type(L, idx) != LUA_TSTRING) return false;
+
+    size_t len = 0;
+    const char* str = lua_tolstring(L, idx, &len);
+    if (len > 1 && str[len - 1] == '%') {
+      char* end = nullptr;
+      float val = std::strtof(str, &end);
+      out = (end == str + len - 1) ? Length::Percent(val) : Length(0);
+    } else if (lua_isnumber(L, idx)) {
+      out = Length((float)lua_tonumber(L, idx));
+    } else {
+      out = Length(0);
+    }
+    return true;
+  }
+
+  static bool readValue(lua_State* L, int idx, SDL_Color& out) {
+    if (lua_type(L, idx) == LUA_TSTRING) {
+      out = parseHexColor(lua_tostring(L, idx));
+      return true;
+    }
+    if (!lua_istable(L, idx)) return false;
+
+    lua_rawgeti(L, idx, 1); out.r = (Uint8)luaL_optinteger(L, -1, 0); lua_pop(L, 1);
+    lua_rawgeti(L, idx, 2); out.g = (Uint8)luaL_optinteger(L, -1, 0); lua_pop(L, 1);
+    lua_rawgeti(L, idx, 3); out.b = (Uint8)luaL_optinteger(L, -1, 0); lua_pop(L, 1);
+    lua_rawgeti(L, idx, 4); out.a = (Uint8)luaL_optinteger(L, -1, 255); lua_pop(L, 1);
+    return true;
+  }
+
+  static bool readValue(lua_State* L, int idx, FontRef& out) {
+    FontHandle* h = (FontHandle*)luaL_testudata(L, idx, "FontMeta");
+    if (!h) return false;
+    out.id = h->id;
+    return true;
+  }
+
+  template <typename E>
+  static bool readEnum(lua_State* L, int idx, E& out, E (*parser)(std::string_view)) {
+    if (lua_type(L, idx) != LUA_TSTRING) return false;
+    size_t len = 0;
+    const char* str = lua_tolstring(L, idx, &len);
+    out = parser(std::string_view(str, len));
+    return true;
+  }
+
+  static bool readValue(lua_State* L, int idx, FontStyle& out)      { return readEnum(L, idx, out, parseFontStyle); }
+  static bool readValue(lua_State* L, int idx, FontWeight& out)     { return readEnum(L, idx, out, parseFontWeight); }
+  static bool readValue(lua_State* L, int idx, TextDecoration& out) { return readEnum(L, idx, out, parseTextDecoration); }
+  static bool readValue(lua_State* L, int idx, FlexDirection& out)  { return readEnum(L, idx, out, parseFlexDirection); }
+  static bool readValue(lua_State* L, int idx, FlexWrap& out)       { return readEnum(L, idx, out, parseFlexWrap); }
+  static bool readValue(lua_State* L, int idx, Align& out)          { return readEnum(L, idx, out, parseAlign); }
+  static bool readValue(lua_State* L, int idx, Justify& out)        { return readEnum(L, idx, out, parseJustify); }
+  static bool readValue(lua_State* L, int idx, TextAlign& out)      { return readEnum(L, idx, out, parseTextAlign); }
+  static bool readValue(lua_State* L, int idx, PositionType& out)   { return readEnum(L, idx, out, parsePosition); }
+  static bool readValue(lua_State* L, int idx, ObjectFit& out)      { return readEnum(L, idx, out, parseObjectFit); }
+  static bool readValue(lua_State* L, int idx, Overflow& out)       { return readEnum(L, idx, out, parseOverflow); }
+  static bool readValue(lua_State* L, int idx, AutoScroll& out)     { return readEnum(L, idx, out, parseAutoScroll); }
+
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ KEY DISPATCH    ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// FNV-1a over the key bytes. The hashes of all descriptor names are case
+// labels of one switch, so a collision between two names is a compile error
+// and the dispatch stays perfect; the memcmp only rejects unknown keys.
+
+  static constexpr uint32_t keyHash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+      h ^= (uint8_t)s[i];
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  void parse(lua_State* L, int styleIdx, StyleSheet& out) {
+    if (styleIdx < 0) styleIdx = lua_gettop(L) + styleIdx + 1;
+
+    lua_pushnil(L);
+    while (lua_next(L, styleIdx) != 0) {
+      if (lua_type(L, -2) == LUA_TSTRING) {
+        size_t len = 0;
+        const char* key = lua_tolstring(L, -2, &len);
+
+        switch (keyHash(key, len)) {
+#define VULPIS_STYLE_CASE(name, ...)                                           \
+          case keyHash(#name, sizeof(#name) - 1):                              \
+            if (len == sizeof(#name) - 1 && std::memcmp(key, #name, len) == 0 \
+                && readValue(L, -1, out.name)) {                               \
+              out.present.set((size_t)Prop::name);                             \
+            }                                                                  \
+            break;
+          VULPIS_STYLE_FIELDS(VULPIS_STYLE_CASE)
+          VULPIS_STYLE_INPUTS(VULPIS_STYLE_CASE)
+#undef VULPIS_STYLE_CASE
+          default:
+            break;
+        }
+      }
+      lua_pop(L, 1);
+    }
+  }
+
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ CHANGE DETECTION ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+
+  template <typename T>
+  static bool sameValue(const T& a, const T& b) {
+    return a == b;
+  }
+
+  static bool sameValue(const Length& a, const Length& b) {
+    return a.value == b.value && a.type == b.type && a.isSet == b.isSet;
+  }
+
+  static bool sameValue(const SDL_Color& a, const SDL_Color& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+  }
+
+  static bool sameValue(const Color& a, const Color& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+  }
+
+  static void markDirty(Node* n, Dirty dirty, bool& layoutChanged, bool& paintChanged) {
+    switch (dirty) {
+      case Dirty::Layout:
+        layoutChanged = true;
+        break;
+      case Dirty::Paint:
+        paintChanged = true;
+        break;
+      case Dirty::Subtree:
+        n->invalidateSubtreePaint();
+        paintChanged = true;
+        break;
+      case Dirty::None:
+        break;
+    }
+  }
+
+  template <typename T>
+  static bool applyField(Node* n, T& field, const T& value, Dirty dirty, bool& layoutChanged, bool& paintChanged) {
+    if (sameValue(field, value)) return false;
+    field = value;
+    markDirty(n, dirty, layoutChanged, paintChanged);
+    return true;
+  }
+
+  template <typename T>
+  static T valueOr(const StyleSheet& s, Prop p, const T& value, const T& fallback) {
+    return s.has(p) ? value : fallback;
+  }
+
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ FONT RESOLVING ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Priority: fontFamily from the registry, then an explicit font handle,
+// then the "default" alias. fontSize overrides whatever size that gives.
+
+  static void resolveFont(Node* n, const StyleSheet& s, bool& layoutChanged) {
+    std::string family = valueOr(s, Prop::fontFamily, s.fontFamily, std::string());
+    int fontSize = valueOr(s, Prop::fontSize, s.fontSize, 0);
+    int handleId = valueOr(s, Prop::font, s.font.id, 0);
+    int configVersion = GetFontConfigVersion();
+
+    NodeText& text = n->textState.edit();
+    if (text.font && text.fontFamily == family && text.fontSize == fontSize &&
+        text.fontHandleId == handleId && text.fontConfigVersion == configVersion) {
+      return;
+    }
+
+    if (!family.empty() && family != text.fontFamily && !GetFontConfig(family)) {
+      std::cerr << "Warning: fontFamily '" << family << "' not found in registry.\n";
+    }
+
+    text.fontFamily = family;
+    text.fontSize = fontSize;
+    text.fontHandleId = handleId;
+    text.fontConfigVersion = configVersion;
+
+    text.loadedVariantBold = false;
+    text.loadedVariantItalic = false;
+    text.loadedVariantThin = false;
+
+    Font* font = nullptr;
+    int fontId = 0;
+
+    auto loadFromConfig = [&](const FontConfig* config) {
+      int size = fontSize > 0 ? fontSize : config->size;
+      std::string targetPath = config->path;
+      std::string vKey = getVariantKey(n->fontWeight, n->fontStyle);
+
+      if (!vKey.empty() && config->variants.count(vKey)) {
+        const VariantConfig& v = config->variants.at(vKey);
+        targetPath = v.path;
+
+        // real variants replace the synthetic styling
+        text.loadedVariantBold = vKey.find("bold") != std::string::npos;
+        text.loadedVariantItalic = vKey.find("italics") != std::string::npos;
+        text.loadedVariantThin = vKey == "thin";
+
+        if (fontSize <= 0 && v.size > 0) size = v.size;
+      }
+
+      auto [id, fontPtr] = UI_LoadFont(targetPath, size, getFlags(n));
+      font = fontPtr;
+      fontId = id;
+    };
+
+    const FontConfig* config = family.empty() ? nullptr : GetFontConfig(family);
+    if (config) {
+      loadFromConfig(config);
+    } else if (handleId != 0) {
+      font = UI_GetFontById(handleId);
+      fontId = font ? handleId : 0;
+    }
+
+    if (!font) {
+      const FontConfig* defaultConfig = GetFontConfig("default");
+      if (defaultConfig) {
+        loadFromConfig(defaultConfig);
+      } else {
+        const EngineConfig& ec = GetEngineConfig();
+        static bool warned = false;
+        if (!ec.enableDefaultFonts && !warned) {
+          std::cerr << "WARNING: Text node created without font and default fonts are disabled in VP_ENGINE_CONFIG.lua\n";
+          warned = true;
+        }
+      }
+    }
+
+    if (font && fontSize > 0 && (int)font->GetSize() != fontSize) {
+      auto [id, fontPtr] = UI_LoadFont(font->GetPath(), fontSize, getFlags(n));
+      font = fontPtr;
+      fontId = id;
+    }
+
+    if (text.font != font) {
+      text.font = font;
+      text.fontId = fontId;
+      text.computedLines.clear();
+      layoutChanged = true;
+    }
+  }
+
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ APPLY         ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+
+  void apply(Node* n, const StyleSheet& s, bool& layoutChanged, bool& paintChanged) {
+    // --- direct fields, generated from the descriptor table ---
+    bool fontVariantChanged = false;
+#define VULPIS_STYLE_APPLY(name, type, field, def, dirty)                                  \
+    if (applyField(n, n->field, valueOr<type>(s, Prop::name, s.name, type(def)),            \
+          Dirty::dirty, layoutChanged, paintChanged)) {                                    \
+      if (Prop::name == Prop::fontWeight || Prop::name == Prop::fontStyle) {               \
+        fontVariantChanged = true;                                                         \
+      }                                                                                    \
+    }
+    VULPIS_STYLE_FIELDS(VULPIS_STYLE_APPLY)
+#undef VULPIS_STYLE_APPLY
+
+    // --- absolute offsets ---
+    auto applyOffset = [&](Prop p, float value, bool& has, float& field) {
+      bool newHas = s.has(p);
+      float newVal = newHas ? value : 0.0f;
+      if (has != newHas || field != newVal) {
+        has = newHas;
+        field = newVal;
+        layoutChanged = true;
+      }
+    };
+    applyOffset(Prop::left, s.left, n->hasLeft, n->leftVal);
+    applyOffset(Prop::top, s.top, n->hasTop, n->topVal);
+    applyOffset(Prop::right, s.right, n->hasRight, n->rightVal);
+    applyOffset(Prop::bottom, s.bottom, n->hasBottom, n->bottomVal);
+
+    // --- gap (spacing is the older spelling) ---
+    int gap = valueOr(s, Prop::gap, s.gap, valueOr(s, Prop::spacing, s.spacing, 0));
+    applyField(n, n->spacing, gap, Dirty::Layout, layoutChanged, paintChanged);
+
+    // --- box model: side > axis > all, short names win over long ones ---
+    auto side = [&](Prop shortP, int shortV, Prop longP, int longV, int fallback) {
+      return valueOr(s, shortP, shortV, valueOr(s, longP, longV, fallback));
+    };
+
+    int p = side(Prop::p, s.p, Prop::padding, s.padding, 0);
+    int px = valueOr(s, Prop::px, s.px, p);
+    int py = valueOr(s, Prop::py, s.py, p);
+    applyField(n, n->paddingTop,    side(Prop::pt, s.pt, Prop::paddingTop, s.paddingTop, py),          Dirty::Layout, layoutChanged, paintChanged);
+    applyField(n, n->paddingBottom, side(Prop::pb, s.pb, Prop::paddingBottom, s.paddingBottom, py),    Dirty::Layout, layoutChanged, paintChanged);
+    applyField(n, n->paddingLeft,   side(Prop::pl, s.pl, Prop::paddingLeft, s.paddingLeft, px),        Dirty::Layout, layoutChanged, paintChanged);
+    applyField(n, n->paddingRight,  side(Prop::pr, s.pr, Prop::paddingRight, s.paddingRight, px),      Dirty::Layout, layoutChanged, paintChanged);
+
+    int m = side(Prop::m, s.m, Prop::margin, s.margin, 0);
+    int mx = valueOr(s, Prop::mx, s.mx, m);
+    int my = valueOr(s, Prop::my, s.my, m);
+    applyField(n, n->marginTop,    side(Prop::mt, s.mt, Prop::marginTop, s.marginTop, my),             Dirty::Layout, layoutChanged, paintChanged);
+    applyField(n, n->marginBottom, side(Prop::mb, s.mb, Prop::marginBottom, s.marginBottom, my),       Dirty::Layout, layoutChanged, paintChanged);
+    applyField(n, n->marginLeft,   side(Prop::ml, s.ml, Prop::marginLeft, s.marginLeft, mx),           Dirty::Layout, layoutChanged, paintChanged);
+    applyField(n, n->marginRight,  side(Prop::mr, s.mr, Prop::marginRight, s.marginRight, mx),         Dirty::Layout, layoutChanged, paintChanged);
+
+    // --- overflow ---
+    Overflow overflow = valueOr(s, Prop::overflow, s.overflow, Overflow::Visible);
+    applyField(n, n->overflowHidden, overflow != Overflow::Visible, Dirty::Paint, layoutChanged, paintChanged);
+    applyField(n, n->overflowScroll, overflow == Overflow::Scroll, Dirty::Paint, layoutChanged, paintChanged);
+
+    // --- background ---
+    if (s.has(Prop::BGColor)) {
+      applyField(n, n->color, s.BGColor, Dirty::Paint, layoutChanged, paintChanged);
+    }
+    applyField(n, n->hasBackground, s.has(Prop::BGColor), Dirty::Paint, layoutChanged, paintChanged);
+
+    if (s.has(Prop::BGImage)) {
+      if (n->media->bgImageSrc != s.BGImage || n->media->bgTextureId == 0) {
+        NodeMedia& media = n->media.edit();
+        if (media.bgTextureId != 0) TextureRegistry::ReleaseTexture(media.bgTextureId);
+        media.bgImageSrc = s.BGImage;
+        media.bgTextureId = TextureRegistry::GetTexture(media.bgImageSrc);
+        paintChanged = true;
+      }
+    } else if (n->media->bgTextureId != 0) {
+      NodeMedia& media = n->media.edit();
+      TextureRegistry::ReleaseTexture(media.bgTextureId);
+      media.bgTextureId = 0;
+      media.bgImageSrc = "";
+      paintChanged = true;
+    }
+
+    // --- image fit ---
+    ObjectFit fit = valueOr(s, Prop::fit, s.fit, ObjectFit::Fill);
+    ObjectFit bgFit = valueOr(s, Prop::BGFit, s.BGFit, ObjectFit::Cover);
+    if (n->media->objectFit != fit || n->media->bgImageFit != bgFit) {
+      n->media.set(&NodeMedia::objectFit, fit);
+      n->media.set(&NodeMedia::bgImageFit, bgFit);
+      paintChanged = true;
+    }
+
+    // --- text ---
+    if (n->type == "text") {
+      SDL_Color sc = valueOr(s, Prop::color, s.color, SDL_Color{0, 0, 0, 255});
+      Color textColor = {sc.r, sc.g, sc.b, sc.a};
+      NodeText& text = n->textState.edit();
+      applyField(n, text.textColor, textColor, Dirty::Paint, layoutChanged, paintChanged);
+
+      if (fontVariantChanged) text.fontConfigVersion = -1;
+      resolveFont(n, s, layoutChanged);
+    }
+  }
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+#ifndef VULPIS_STYLE_H
+#define VULPIS_STYLE_H
+
+#include <bitset>
+#include <string>
+#include "ui.h"
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ STYLE PROPERTY DESCRIPTORS ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Every style key the engine understands is listed exactly once below.
+// The parser, the per-key dispatch and the change detection used by both
+// buildNode and patchNode are generated from these tables.
+
+// Keys that map 1:1 onto a Node field.
+//   X(lua key, value type, Node field, default, dirtiness)
+#define VULPIS_STYLE_FIELDS(X) \
+  X(zIndex,         int,            zIndex,         0,                         Paint)   \
+  X(fontStyle,      FontStyle,      fontStyle,      FontStyle::Normal,         Layout)  \
+  X(fontWeight,     FontWeight,     fontWeight,     FontWeight::Normal,        Layout)  \
+  X(textDecoration, TextDecoration, textDecoration, TextDecoration::None,      Paint)   \
+  X(opacity,        float,          opacity,        1.0f,                      Subtree) \
+  X(BGOpacity,      float,          BGOpacity,      1.0f,                      Paint)   \
+  X(borderRadius,   float,          borderRadius,   0.0f,                      Paint)   \
+  X(borderWidth,    float,          borderWidth,    0.0f,                      Paint)   \
+  X(borderColor,    SDL_Color,      borderColor,    (SDL_Color{0, 0, 0, 0}),   Paint)   \
+  X(w,              Length,         widthStyle,     Length(),                  Layout)  \
+  X(h,              Length,         heightStyle,    Length(),                  Layout)  \
+  X(minWidth,       float,          minWidth,       0.0f,                      Layout)  \
+  X(maxWidth,       float,          maxWidth,       99999.0f,                  Layout)  \
+  X(minHeight,      float,          minHeight,      0.0f,                      Layout)  \
+  X(maxHeight,      float,          maxHeight,      99999.0f,                  Layout)  \
+  X(flexGrow,       float,          flexGrow,       0.0f,                      Layout)  \
+  X(flexShrink,     float,          flexShrink,     0.0f,                      Layout)  \
+  X(flexDirection,  FlexDirection,  flexDirection,  FlexDirection::Column,     Layout)  \
+  X(flexWrap,       FlexWrap,       flexWrap,       FlexWrap::NoWrap,          Layout)  \
+  X(alignItems,     Align,          alignItems,     Align::Start,              Layout)  \
+  X(justifyContent, Justify,        justifyContent, Justify::Start,            Layout)  \
+  X(textAlign,      TextAlign,      textAlign,      TextAlign::Left,           Layout)  \
+  X(position,       PositionType,   position,       PositionType::Relative,    Layout)  \
+  X(autoScroll,     AutoScroll,     autoScroll,     AutoScroll::None,          None)    \
+  X(wordWrap,       bool,           wordWrap,       true,                      Layout)  \
+  X(translateX,     float,          translateX,     0.0f,                      Subtree) \
+  X(translateY,     float,          translateY,     0.0f,                      Subtree)
+
+// Keys that feed derived state (shorthand fallbacks, fonts, textures) or
+// live in a node side block.
+//   X(lua key, value type)
+#define VULPIS_STYLE_INPUTS(X) \
+  X(left, float)          X(top, float)           X(right, float)        X(bottom, float)        \
+  X(gap, int)             X(spacing, int)                                                        \
+  X(p, int)               X(padding, int)         X(px, int)             X(py, int)              \
+  X(pt, int)              X(paddingTop, int)      X(pb, int)             X(paddingBottom, int)   \
+  X(pl, int)              X(paddingLeft, int)     X(pr, int)             X(paddingRight, int)    \
+  X(m, int)               X(margin, int)          X(mx, int)             X(my, int)              \
+  X(mt, int)              X(marginTop, int)       X(mb, int)             X(marginBottom, int)    \
+  X(ml, int)              X(marginLeft, int)      X(mr, int)             X(marginRight, int)     \
+  X(overflow, Overflow)   X(BGColor, SDL_Color)   X(BGImage, std::string)                        \
+  X(fit, ObjectFit)       X(BGFit, ObjectFit)                                                    \
+  X(font, FontRef)        X(fontFamily, std::string) X(fontSize, int)    X(color, SDL_Color)
+
+namespace Style {
+
+  // `font = fonts.load(...)` handle, stored by id
+  struct FontRef {
+    int id = 0;
+  };
+
+  enum class Dirty {
+    None,
+    Paint,
+    Layout,
+    Subtree
+  };
+
+  enum class Prop {
+#define VULPIS_STYLE_ENUM(name, ...) name,
+    VULPIS_STYLE_FIELDS(VULPIS_STYLE_ENUM)
+    VULPIS_STYLE_INPUTS(VULPIS_STYLE_ENUM)
+#undef VULPIS_STYLE_ENUM
+    Count
+  };
+
+  // One parsed style table. Only keys flagged in `present` hold a value, the
+  // rest fall back to the descriptor defaults when applied.
+  struct StyleSheet {
+    std::bitset<(size_t)Prop::Count> present;
+
+#define VULPIS_STYLE_MEMBER(name, type, ...) type name{};
+    VULPIS_STYLE_FIELDS(VULPIS_STYLE_MEMBER)
+    VULPIS_STYLE_INPUTS(VULPIS_STYLE_MEMBER)
+#undef VULPIS_STYLE_MEMBER
+
+    bool has(Prop p) const { return present.test((size_t)p); }
+  };
+
+  // single lua_next walk over the table at styleIdx
+  void parse(lua_State* L, int styleIdx, StyleSheet& out);
+
+  // Writes the sheet into the node, reporting what kind of invalidation the
+  // differences need. Used for fresh nodes too, where the flags are ignored.
+  void apply(Node* n, const StyleSheet& s, bool& layoutChanged, bool& paintChanged);
+
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
+#include <iterator>
 #include <lauxlib.h>
 #include <lua.h>
 #include <string>
@@ -17,13 +18,19 @@
 #include <variant>
 #include <vector>
 #include "../color/color.h"
+#include "style.h"
 #include "../vdom/vdom.h"
+#include "../state/state.h"
 #include "../text/font.h"
 #include "../../configLogic/font/font_registry.h"
 #include "../../configLogic/engineConf/engine_config.h"
 #include "../../configLogic/font/font_registry.h"
 #include "../../configLogic/images/texture_registry.h"
 #include "../input/input.h"
+#include "../input/hit_index.h"
+#include "../system/timers.h"
+#include "../system/worker_pool.h"
+#include "../layout/layout.h"
 
 // global pointer for immediate mode
 RenderCommandList* activeCommandList = nullptr;
@@ -64,14 +71,14 @@ void UI_InitTypes(lua_State *L) {
 }
 
 
-Align parseAlign(std::string s) {
+Align parseAlign(std::string_view s) {
   if (s == "center") return Align::Center;
   if (s == "end") return Align::End;
   if (s == "stretch") return Align::Stretch;
   return Align::Start;
 }
 
-Justify parseJustify(std::string s) {
+Justify parseJustify(std::string_view s) {
   if (s == "center") return Justify::Center;
   if (s == "end") return Justify::End;
   if (s == "space-around") return Justify::SpaceAround;
@@ -80,52 +87,55 @@ Justify parseJustify(std::string s) {
   return Justify::Start;
 }
 
-FlexWrap parseFlexWrap(std::string s) {
+FlexWrap parseFlexWrap(std::string_view s) {
   if (s == "wrap") return FlexWrap::Wrap;
   if (s == "wrap-reverse") return FlexWrap::WrapReverse;
   return FlexWrap::NoWrap;
 }
 
-Length getLength(lua_State* L, const char* key) {
-  Length len;
-  lua_getfield(L, -1, key);
-
-  if (lua_isnumber(L, -1)) {
-    len.value = (float)lua_tonumber(L, -1);
-    len.type = PIXEL;
-    len.isSet = true;
-  }
-  else if (lua_isstring(L, -1)) {
-    std::string s = lua_tostring(L, -1);
-    if (!s.empty() && s.back() == '%') {
-      try {
-        float val = std::stof(s.substr(0, s.size() - 1));
-        len = Length::Percent(val);
-      } catch (...) {
-        len = Length(0);
-      }
-    } else {
-      len = Length(0);
-    }
-  }
+PositionType parsePosition(std::string_view s) {
+  if (s == "absolute") return PositionType::Absolute;
+  return PositionType::Relative;
+}
 
-  lua_pop(L, 1);
-  return len;
+FlexDirection parseFlexDirection(std::string_view s) {
+  if (s == "row") return FlexDirection::Row;
+  if (s == "row-reverse") return FlexDirection::RowReverse;
+  if (s == "column-reverse") return FlexDirection::ColumnReverse;
+  return FlexDirection::Column;
+}
+
+ObjectFit parseObjectFit(std::string_view s) {
+  if (s == "cover") return ObjectFit::Cover;
+  if (s == "contain") return ObjectFit::Contain;
+  return ObjectFit::Fill;
+}
+
+Overflow parseOverflow(std::string_view s) {
+  if (s == "visible") return Overflow::Visible;
+  if (s == "scroll" || s == "auto") return Overflow::Scroll;
+  return Overflow::Hidden;
 }
 
-TextAlign parseTextAlign(std::string s) {
+AutoScroll parseAutoScroll(std::string_view s) {
+  if (s == "bottom") return AutoScroll::Bottom;
+  if (s == "top") return AutoScroll::Top;
+  return AutoScroll::None;
+}
+
+TextAlign parseTextAlign(std::string_view s) {
   if (s == "center") return TextAlign::Center;
   if (s == "right") return TextAlign::Right;
   if (s == "left") return TextAlign::Left;
   return TextAlign::Left;
 }
 
-FontStyle parseFontStyle(const std::string& s) {
+FontStyle parseFontStyle(std::string_view s) {
   if (s == "italics") return FontStyle::Italics;
   return FontStyle::Normal;
 }
 
-FontWeight parseFontWeight(const std::string& s) {
+FontWeight parseFontWeight(std::string_view s) {
   if (s == "thin")      return FontWeight::Thin;
   if (s == "semi-bold") return FontWeight::SemiBold;
   if (s == "bold")      return FontWeight::Bold;
@@ -133,7 +143,7 @@ FontWeight parseFontWeight(const std::string& s) {
   return FontWeight::Normal;
 }
 
-TextDecoration parseTextDecoration(const std::string& s) {
+TextDecoration parseTextDecoration(std::string_view s) {
   if (s == "underline")      return TextDecoration::Underline;
   if (s == "strike-through") return TextDecoration::StrikeThrough;
   return TextDecoration::None;
@@ -151,190 +161,45 @@ std::string getVariantKey(FontWeight w, FontStyle s) {
 
 int getFlags(Node* node) {
   int flags = GetFontFlagsFromNode(node);
-  if (node->loadedVariantBold) flags &= ~(FONT_STYLE_BOLD | FONT_STYLE_SEMI_BOLD | FONT_STYLE_VERY_BOLD);
-  if (node->loadedVariantItalic) flags &= ~FONT_STYLE_ITALIC;
-  if (node->loadedVariantThin) flags &= ~FONT_STYLE_THIN;
+  if (node->textState->loadedVariantBold) flags &= ~(FONT_STYLE_BOLD | FONT_STYLE_SEMI_BOLD | FONT_STYLE_VERY_BOLD);
+  if (node->textState->loadedVariantItalic) flags &= ~FONT_STYLE_ITALIC;
+  if (node->textState->loadedVariantThin) flags &= ~FONT_STYLE_THIN;
   return flags;
 };
 
 void parseEvents(lua_State *L, Node *n, int idx) {
-  auto getCallback = [&](const char* key, int& ref) {
+  // side blocks are only allocated for nodes that actually have callbacks
+  auto getCallback = [&](const char* key, auto& block, auto ref) {
     lua_getfield(L, idx, key);
     if (lua_isfunction(L, -1)) {
-      ref = luaL_ref(L, LUA_REGISTRYINDEX);
+      block.edit().*ref = luaL_ref(L, LUA_REGISTRYINDEX);
     } else {
       lua_pop(L, 1);
     }
   };
 
-  getCallback("onClick", n->onClickRef);
-  getCallback("onMouseEnter", n->onMouseEnterRef);
-  getCallback("onMouseLeave", n->onMouseLeaveRef);
-  getCallback("onRightClick", n->onRightClickRef);
-  getCallback("onDragStart", n->onDragStartRef);
-  getCallback("onDragEnd", n->onDragEndRef);
-  getCallback("onDrag", n->onDragRef);
-
-  getCallback("onTextInput", n->onTextInputRef);
-  getCallback("onKeyDown", n->onKeyDownRef);
-  getCallback("onFocus", n->onFocusRef);
-  getCallback("onBlur", n->onBlurRef);
-  getCallback("onScroll", n->onScrollRef);
+  getCallback("onClick", n->events, &NodeEvents::onClickRef);
+  getCallback("onMouseEnter", n->events, &NodeEvents::onMouseEnterRef);
+  getCallback("onMouseLeave", n->events, &NodeEvents::onMouseLeaveRef);
+  getCallback("onRightClick", n->events, &NodeEvents::onRightClickRef);
+  getCallback("onDragStart", n->drag, &NodeDrag::onDragStartRef);
+  getCallback("onDragEnd", n->drag, &NodeDrag::onDragEndRef);
+  getCallback("onDrag", n->drag, &NodeDrag::onDragRef);
+
+  getCallback("onTextInput", n->events, &NodeEvents::onTextInputRef);
+  getCallback("onKeyDown", n->events, &NodeEvents::onKeyDownRef);
+  getCallback("onFocus", n->events, &NodeEvents::onFocusRef);
+  getCallback("onBlur", n->events, &NodeEvents::onBlurRef);
+  getCallback("onScroll", n->events, &NodeEvents::onScrollRef);
 }
 
 
-void NodeParseText(Node* n, lua_State* L) {
-  lua_getfield(L, -1, "fontStyle");
-  if (lua_isstring(L, -1)) n->fontStyle  = parseFontStyle(lua_tostring(L, -1));
-  lua_pop(L, 1);
-
-  lua_getfield(L, -1, "fontWeight");
-  if (lua_isstring(L, -1)) n->fontWeight = parseFontWeight(lua_tostring(L, -1));
-  lua_pop(L, 1);
-
-  lua_getfield(L, -1, "textDecoration");
-  if (lua_isstring(L, -1)) n->textDecoration = parseTextDecoration(lua_tostring(L, -1));
-  lua_pop(L, 1);
-
-
-  lua_getfield(L, -1, "font");
-  if (lua_isuserdata(L, -1)) {
-    FontHandle* h = (FontHandle*)luaL_checkudata(L, -1, "FontMeta");
-    if (h) {
-      n->fontId = h->id;
-      n->font = UI_GetFontById(h->id);
-    }
-  }
-  lua_pop(L, 1);
-
-
-
-  lua_getfield(L, -1, "fontFamily");
-  if (lua_isstring(L, -1)) {
-    std::string alias = lua_tostring(L, -1);
-    const FontConfig* config = GetFontConfig(alias);
-    if (config) {
-      int size = config->size;
-      lua_getfield(L, -2, "fontSize");
-      if (lua_isnumber(L, -1)) {
-        size = (int)lua_tonumber(L, -1);
-        n->fontSize = size;
-      }
-      lua_pop(L, 1);
-
-      std::string targetPath = config->path;
-      std::string vKey = getVariantKey(n->fontWeight, n->fontStyle);
-
-      n->loadedVariantBold = false;
-      n->loadedVariantItalic = false;
-      n->loadedVariantThin = false;
-
-      if (!vKey.empty() && config->variants.count(vKey)) {
-        const VariantConfig& v = config->variants.at(vKey);
-        targetPath = v.path;
-        // Only use variant size if user didn't explicitly override it locally
-
-        if (vKey == "bold-italics") {
-          n->loadedVariantBold = true;
-          n->loadedVariantItalic = true;
-        }
-        else if (vKey == "bold" || vKey == "semi-bold") {
-          n->loadedVariantBold = true;
-        }
-        else if (vKey == "italics") {
-          n->loadedVariantItalic = true;
-        }
-
-        else if (vKey == "thin") {
-          n->loadedVariantThin = true;
-        }
-
-        if (n->fontSize <= 0 && v.size > 0) {
-          size = v.size;
-        }
-      }
-
-      auto [id, fontptr] = UI_LoadFont(targetPath, size, getFlags(n));
-      n->font = fontptr;
-      n->fontId = id;
-    } else {
-      std::cerr << "Warning: fontFamily '" << alias << "' not found in registry.\n";
-    }
-  }
-  lua_pop(L, 1);
-
-  if (n->font == nullptr) {
-    const FontConfig* config = GetFontConfig("default");
-    if (config) {
-      int size = config->size;
-      lua_getfield(L, -1, "fontSize");
-      if (lua_isnumber(L, -1)) {
-        size = (int)lua_tonumber(L, -1);
-      }
-      lua_pop(L, 1);
-
-      std::string targetPath = config->path;
-      std::string vKey = getVariantKey(n->fontWeight, n->fontStyle);
-
-      if (!vKey.empty() && config->variants.count(vKey)) {
-        const VariantConfig& v = config->variants.at(vKey);
-        targetPath = v.path;
-
-        if (vKey.find("bold") != std::string::npos) n->loadedVariantBold = true;
-        if (vKey.find("italics") != std::string::npos) n->loadedVariantItalic = true;
-        if (vKey.find("thin") != std::string::npos) n->loadedVariantThin = true;
-
-        if (n->fontSize <= 0 && v.size > 0) {
-          size = v.size;
-        }
-      }
-
-      auto [id, fontptr] = UI_LoadFont(targetPath, size, getFlags(n));
-      n->font = fontptr;
-      n->fontId = id;
-    } else {
-      const EngineConfig& ec = GetEngineConfig();
-      static bool warned = false;
-      if (!ec.enableDefaultFonts && !warned) {
-        std::cerr << "WARNING: Text node created without font and default fonts are disabled in VP_ENGINE_CONFIG.lua\n";
-        warned = true;
-      }
-    }
-  }
-
-  lua_getfield(L, -1, "fontSize");
-  if (lua_isnumber(L, -1)) {
-    int newSize = (int)lua_tointeger(L, -1);
-    if (n->font && newSize > 0 && n->font->GetSize() != newSize) {
-      auto [id, fontptr] = UI_LoadFont(n->font->GetPath(), newSize, getFlags(n));
-      n->font = fontptr;
-      n->fontId = id;
-    }
-  }
-  lua_pop(L, 1);
-
-
-  lua_getfield(L, -1, "color");
-  if (lua_isstring(L, -1)) {
-    const char* hex = lua_tostring(L, -1);
-    SDL_Color sc = parseHexColor(hex);
-    n->textColor = {(uint8_t)sc.r, (uint8_t)sc.g, (uint8_t)sc.b, (uint8_t)sc.a};
-  }
-  else if (lua_istable(L, -1)) {
-    lua_rawgeti(L, -1, 1); n->textColor.r = luaL_optinteger(L, -1, 0); lua_pop(L, 1);
-    lua_rawgeti(L, -1, 2); n->textColor.g = luaL_optinteger(L, -1, 0); lua_pop(L, 1);
-    lua_rawgeti(L, -1, 3); n->textColor.b = luaL_optinteger(L, -1, 0); lua_pop(L, 1);
-    lua_rawgeti(L, -1, 4); n->textColor.a = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-  }
-  lua_pop(L, 1);
-
-}
-
 void NodeParseImage(Node* n, lua_State* L, int idx) {
   lua_getfield(L, idx, "src");
   if (lua_isstring(L, -1)) {
-    n->src = lua_tostring(L, -1);
-    n->textureId = TextureRegistry::GetTexture(n->src);
+    NodeMedia& media = n->media.edit();
+    media.src = lua_tostring(L, -1);
+    media.textureId = TextureRegistry::GetTexture(media.src);
   }
   lua_pop(L, 1);
 }
@@ -343,7 +208,12 @@ void NodeParseImage(Node* n, lua_State* L, int idx) {
 Node* buildNode(lua_State* L, int idx) {
   luaL_checktype(L, idx, LUA_TTABLE);
 
+  if (VDOM::isComponentTable(L, idx)) {
+    return VDOM::buildComponent(L, idx);
+  }
+
   Node* n = new Node();
+  VDOM::readMemo(L, idx, n->memoRef);
 
   lua_getfield(L, idx, "type");
   if (lua_isstring(L, -1))
@@ -352,8 +222,10 @@ Node* buildNode(lua_State* L, int idx) {
 
   lua_getfield(L, idx, "text");
   if (lua_isstring(L, -1)) {
-    n->text = lua_tostring(L, -1);
-    n->codepoints = Font::DecodeUTF8(n->text);
+    NodeText& text = n->textState.edit();
+    text.text = lua_tostring(L, -1);
+    text.codepoints = Font::DecodeUTF8(text.text);
+    text.textHash = UI_HashCodepoints(text.codepoints);
   }
   lua_pop(L, 1);
 
@@ -365,210 +237,35 @@ Node* buildNode(lua_State* L, int idx) {
   if (lua_isstring(L, -1)) n->id = lua_tostring(L, -1);
   lua_pop(L, 1);
 
+  Style::StyleSheet sheet;
   lua_getfield(L, idx, "style");
-  if (!lua_istable(L, -1)) {
-    lua_pop(L, 1);
-    lua_newtable(L);
-  }
-
-  bool hasStyle = true;
-
-  auto getInt = [&](const char* key, int defaultVal) {
-    int val = defaultVal;
-    if (hasStyle) {
-      lua_getfield(L, -1, key);
-      if (lua_isnumber(L, -1))
-        val = lua_tointeger(L, -1);
-      lua_pop(L, 1);
-    }
-    return val;
-  };
-
-  auto getFloat = [&](const char* key, float defaultVal) {
-    float val = defaultVal;
-    if (hasStyle) {
-      lua_getfield(L, -1, key);
-      if (lua_isnumber(L, -1)) val = (float)lua_tonumber(L, -1);
-      lua_pop(L, 1);
-    }
-    return val;
-  };
-
-  auto getString = [&](const char* key, std::string defaultVal) {
-    std::string val = defaultVal;
-    if (hasStyle) {
-      lua_getfield(L, -1, key);
-      if (lua_isstring(L, -1)) val = lua_tostring(L, -1);
-      lua_pop(L, 1);
-    }
-    return val;
-  };
-
-  if (hasStyle) {
-    if (n->type == "text") {
-      NodeParseText(n, L);
-    }
-
-    n->widthStyle = getLength(L, "w");
-    n->heightStyle = getLength(L, "h");
-
-    auto checkFloat = [&](const char* k, bool& has, float& v) {
-      lua_getfield(L, -1, k);
-      if (!lua_isnil(L, -1)) {
-        has = true;
-        v = (float)lua_tonumber(L, -1);
-      }
-      lua_pop(L, 1);
-    };
-    checkFloat("left", n->hasLeft, n->leftVal);
-    checkFloat("top", n->hasTop, n->topVal);
-    checkFloat("right", n->hasRight, n->rightVal);
-    checkFloat("bottom", n->hasBottom, n->bottomVal);
-    
-    n->opacity = getFloat("opacity", 1.0f);
-    n->BGOpacity = getFloat("BGOpacity", 1.0f);
-
-  }
-
-  n->spacing = getInt("gap", getInt("spacing", 0));
-  n->zIndex = getInt("zIndex", 0);
-
-  // --- PADDING ---
-  // Base values (p falls back to padding, defaults to 0)
-  int p = getInt("p", getInt("padding", 0));
-  int px = getInt("px", p);
-  int py = getInt("py", p);
-
-  // Specific sides (pt falls back to paddingTop, falls back to py)
-  n->paddingTop    = getInt("pt", getInt("paddingTop", py));
-  n->paddingBottom = getInt("pb", getInt("paddingBottom", py));
-  n->paddingLeft   = getInt("pl", getInt("paddingLeft", px));
-  n->paddingRight  = getInt("pr", getInt("paddingRight", px));
-
-
-  // --- MARGIN ---
-  // Base values (m falls back to margin, defaults to 0)
-  int m = getInt("m", getInt("margin", 0));
-  int mx = getInt("mx", m);
-  int my = getInt("my", m);
-
-  // Specific sides (mt falls back to marginTop, falls back to my)
-  n->marginTop    = getInt("mt", getInt("marginTop", my));
-  n->marginBottom = getInt("mb", getInt("marginBottom", my));
-  n->marginLeft   = getInt("ml", getInt("marginLeft", mx));
-  n->marginRight  = getInt("mr", getInt("marginRight", mx));
-
-
-  n->borderRadius = getFloat("borderRadius", 0.0f);
-    n->borderWidth = getFloat("borderWidth", 0.0f);
-
-    if (hasStyle) {
-      lua_getfield(L, -1, "borderColor");
-      if (lua_isstring(L, -1)) {
-        n->borderColor = parseHexColor(lua_tostring(L, -1));
-      } else if (lua_istable(L, -1)) {
-        lua_rawgeti(L, -1, 1); n->borderColor.r = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-        lua_rawgeti(L, -1, 2); n->borderColor.g = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-        lua_rawgeti(L, -1, 3); n->borderColor.b = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-        lua_rawgeti(L, -1, 4); n->borderColor.a = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-      }
-      lua_pop(L, 1);
-    }
-
-
-  n->minHeight = getInt("minHeight", 0);
-  n->maxHeight = getInt("maxHeight", 99999);
-  n->minWidth = getInt("minWidth", 0);
-  n->maxWidth = getInt("maxWidth", 99999);
-
-  n->flexGrow = getFloat("flexGrow", 0.0f);
-  n->flexShrink  = getFloat("flexShrink", 0.0f);
-
-  n->translateX = getFloat("translateX", 0.0f);
-  n->translateY = getFloat("translateY", 0.0f);
-
-  n->flexWrap = parseFlexWrap(getString("flexWrap", "nowrap"));
-
-  n->alignItems = parseAlign(getString("alignItems", "start"));
-  n->justifyContent = parseJustify(getString("justifyContent", "start"));
-  n->textAlign = parseTextAlign(getString("textAlign", "left"));
-  n->objectFit = getString("fit", "fill");
-  std::string pos = getString("position", "relative");
-  if (pos == "absolute") {
-    n->position = PositionType::Absolute;
-  } else {
-    n->position = PositionType::Relative;
-  }
-
-
-  std::string overflow = getString("overflow", "visible");
-  if (overflow == "visible") {
-    n->overflowHidden = false;
-    n->overflowScroll = false;
-  } else if (overflow == "scroll" || overflow == "auto") {
-    n->overflowHidden = true;
-    n->overflowScroll = true;
-  } else {
-    n->overflowScroll = false;
-    n->overflowHidden = true;
-  }
-
-  n->wordWrap = true;
-  if (hasStyle) {
-    lua_getfield(L, -1, "wordWrap");
-    if (lua_isboolean(L, -1)) n->wordWrap = lua_toboolean(L, -1);
-    lua_pop(L, 1);
-  }
-
-  if (hasStyle) {
-    lua_getfield(L, -1, "BGColor");
-    if (lua_isstring(L, -1)) {
-      const char* hex = lua_tostring(L, -1);
-      n->color = parseHexColor(hex);
-      n->hasBackground = true;
-    }
-    else if (lua_istable(L, -1)) {
-      lua_rawgeti(L, -1, 1); n->color.r = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-      lua_rawgeti(L, -1, 2); n->color.g = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-      lua_rawgeti(L, -1, 3); n->color.b = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-      lua_rawgeti(L, -1, 4); n->color.a = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-
-      n->hasBackground = true;
-    }
-    lua_pop(L, 1);
-
-    lua_getfield(L, -1, "BGImage");
-    if (lua_isstring(L, -1)) {
-      n->bgImageSrc = lua_tostring(L, -1);
-      n->bgTextureId = TextureRegistry::GetTexture(n->bgImageSrc);
-    }
-    lua_pop(L, 1);
-
-    n->bgImageFit = getString("BGFit", "cover");
-
-
+  if (lua_istable(L, -1)) {
+    Style::parse(L, lua_gettop(L), sheet);
   }
-
   lua_pop(L, 1);
 
+  // a fresh node is dirty anyway, the change flags are irrelevant here
+  bool layoutChanged = false, paintChanged = false;
+  Style::apply(n, sheet, layoutChanged, paintChanged);
+
   lua_getfield(L, idx, "draggable");
   if (lua_isboolean(L, -1)) {
-    n->isDraggable = lua_toboolean(L, -1);
+    n->drag.set(&NodeDrag::isDraggable, (bool)lua_toboolean(L, -1));
   }
   lua_pop(L, 1);
 
   parseEvents(L, n, idx);
 
   lua_getfield(L, idx, "focusable");
-  if (lua_isboolean(L, -1)) n->isFocusable = lua_toboolean(L, -1);
+  if (lua_isboolean(L, -1)) n->textEdit.set(&NodeTextEdit::isFocusable, (bool)lua_toboolean(L, -1));
   lua_pop(L, 1);
 
   lua_getfield(L, idx, "isFocused");
-  if (lua_isboolean(L, -1)) n->isFocused = lua_toboolean(L, -1);
+  if (lua_isboolean(L, -1)) n->textEdit.set(&NodeTextEdit::isFocused, (bool)lua_toboolean(L, -1));
   lua_pop(L, 1);
 
   lua_getfield(L, idx, "cursorPosition");
-  if (lua_isnumber(L, -1)) n->cursorPosition = lua_tointeger(L, -1);
+  if (lua_isnumber(L, -1)) n->textEdit.set(&NodeTextEdit::cursorPosition, (int)lua_tointeger(L, -1));
   lua_pop(L, 1);
 
 
@@ -577,12 +274,12 @@ Node* buildNode(lua_State* L, int idx) {
   // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
   lua_getfield(L, idx, "allowSelection");
   if (!lua_isnil(L, -1)) {
-    n->allowSelection = lua_toboolean(L, -1);
+    n->textEdit.set(&NodeTextEdit::allowSelection, (bool)lua_toboolean(L, -1));
   }
   lua_pop(L, 1);
 
-  if (n->allowSelection && n->type == "text") {
-    n->isFocusable = true;
+  if (n->textEdit->allowSelection && n->type == "text") {
+    n->textEdit.edit().isFocusable = true;
   }
 
   lua_getfield(L, idx, "children");
@@ -761,47 +458,102 @@ void TranslateRenderCommand(RenderCommand& cmd, float dx, float dy) {
 }
 
 
-static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX,
-    float parentOffsetY, bool isDragPass, bool isInsideDraggedNode, float parentAlpha) {
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ PER-NODE DISPLAY LIST GENERATION  ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// A node's commands are split around its children: everything drawn below
+// them (and the clip that encloses them) and everything drawn on top.
+
+// image UVs are worked out within the image; this moves them onto wherever
+// the registry stored it (its own texture or a rect on an atlas page)
+static void mapToRegion(const TextureRegistry::TextureRegion& r, float& uMin, float& vMin, float& uMax, float& vMax) {
+  float du = r.u1 - r.u0;
+  float dv = r.v1 - r.v0;
+  uMin = r.u0 + uMin * du;
+  uMax = r.u0 + uMax * du;
+  vMin = r.v0 + vMin * dv;
+  vMax = r.v0 + vMax * dv;
+}
 
-  float totalOffsetX = parentOffsetX + n->translateX;
-  float totalOffsetY = parentOffsetY + n->translateY;
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ FLATTEN SIDE EFFECTS    ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Subtrees may be flattened on worker threads, so nothing outside the node
+// being visited is written during the walk. Damage, hit boxes and caret
+// auto-scroll are recorded here instead and applied on the main thread, in
+// paint order, once the walk is done.
+
+struct CaretScroll {
+  Node* text;
+  Node* scroller;
+  float cursorX; // caret in the scroller's content box
+  float cursorY;
+};
 
-  if (isDragPass) {
-    totalOffsetX += n->dragOffsetX;
-    totalOffsetY += n->dragOffsetY;
-  }
-  // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
-  // ╏ IF CLEAN, DUMP CACHE AND RETURN INSTANTLY ╏
-  // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
-  if (!isDragPass && !n->isPaintDirty && n->hasCachedCommands) {
-    float dx = totalOffsetX - n->cachedOffsetX;
-    float dy = totalOffsetY - n->cachedOffsetY;
-
-    if (dx != 0.0f || dy != 0.0f) {
-      for (auto& cmd : n->cachedCommands.commands) {
-        TranslateRenderCommand(cmd, dx, dy);
-      }
+struct HitBox {
+  Node* node;
+  Rect box;
+  bool onTop;
+};
 
-      n->cachedOffsetX = totalOffsetX;
-      n->cachedOffsetY = totalOffsetY;
-    }
-    for (const auto& cmd : n->cachedCommands.commands) {
-      list.push(cmd);
-    }
-    return;
-  }
-  float currentAlpha = parentAlpha * n->opacity;
-  bool treatAsDragged = isInsideDraggedNode || (n->isDragging && n->isDraggable);
-  float alphaMultiplier = (isDragPass && treatAsDragged) ? (currentAlpha * 0.7f) : currentAlpha;
+struct FlattenOutput {
+  std::vector<Rect> damage;
+  std::vector<HitBox> hits;
+  std::vector<CaretScroll> carets;
 
-  if (isDragPass && !treatAsDragged) {
-    for (Node* c : n->children) {
-      renderNodePass(c, list, totalOffsetX - n->scrollX, totalOffsetY - n->scrollY, isDragPass, false, parentAlpha);
-    }
-    return;
+  void append(FlattenOutput& other) {
+    damage.insert(damage.end(), other.damage.begin(), other.damage.end());
+    hits.insert(hits.end(), other.hits.begin(), other.hits.end());
+    carets.insert(carets.end(), other.carets.begin(), other.carets.end());
   }
-  size_t startIndex = list.commands.size();
+};
+
+// keeps the caret a few pixels inside the scroller's visible content
+static void applyCaretScroll(const CaretScroll& c) {
+  Node* n = c.text;
+  Node* scroller = c.scroller;
+  float sContentW = scroller->w - scroller->paddingLeft - scroller->paddingRight;
+  float sContentH = scroller->h - scroller->paddingTop - scroller->paddingBottom;
+
+  // Keep the cursor a few pixels away from the absolute edge so it's clearly visible
+  float cursorThickness = 1.0f;
+
+  float safePaddingX = std::min(5.0f, std::max(0.0f, (sContentW - cursorThickness) / 2.0f));
+  float safePaddingY = std::min(5.0f, std::max(0.0f, (sContentH - n->textState->computedLineHeight) / 2.0f));
+
+  // Horizontal Auto-Scroll mapped to the parent
+  float absoluteCursorX = c.cursorX;
+  if (absoluteCursorX < scroller->targetScrollX) {
+    scroller->targetScrollX = absoluteCursorX - safePaddingX;
+  } else if (absoluteCursorX + cursorThickness > scroller->targetScrollX + sContentW) {
+    float desiredScrollX = absoluteCursorX + cursorThickness - sContentW + safePaddingX;
+    scroller->targetScrollX = std::min(desiredScrollX, absoluteCursorX - safePaddingX);
+  }
+  if (scroller->targetScrollX < 0) scroller->targetScrollX = 0;
+
+  // Vertical Auto-Scroll mapped to absolute layout coordinates
+  float absoluteCursorY = c.cursorY;
+  if (absoluteCursorY < scroller->targetScrollY) {
+    scroller->targetScrollY = absoluteCursorY - safePaddingY; // Push view up
+  } else if (absoluteCursorY + n->textState->computedLineHeight > scroller->targetScrollY + sContentH) {
+    float desiredScrollY = absoluteCursorY + n->textState->computedLineHeight - sContentH + safePaddingY;
+    scroller->targetScrollY = std::min(desiredScrollY, absoluteCursorY - safePaddingY);
+  }
+  if (scroller->targetScrollY < 0) scroller->targetScrollY = 0;
+}
+
+static void applyFlattenOutput(FlattenOutput& out) {
+  for (const Rect& r : out.damage) g_damageTracker.add(r.x, r.y, r.w, r.h);
+  for (const HitBox& h : out.hits) HitIndex::insert(h.node, h.box, h.onTop);
+  for (const CaretScroll& c : out.carets) applyCaretScroll(c);
+  out.damage.clear();
+  out.hits.clear();
+  out.carets.clear();
+}
+
+static void emitOwnCommands(Node* n, RenderCommandList& list, float totalOffsetX,
+    float totalOffsetY, float alphaMultiplier, bool applyClip, FlattenOutput& out) {
+
   // Accumulate offsets
   float renderX = n->x + totalOffsetX;
   float renderY = n->y + totalOffsetY;
@@ -824,8 +576,8 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
   }
 
   // BACKGROUND IMAGE OR SKELETON LOADER
-  if (n->bgTextureId != 0) {
-    if (!TextureRegistry::IsTextureLoaded(n->bgTextureId)) {
+  if (n->media->bgTextureId != 0) {
+    if (!TextureRegistry::IsTextureLoaded(n->media->bgTextureId)) {
       // Draw pulsating skeleton loader
       float pulse = (std::sin(SDL_GetTicks() / 150.0f) + 1.0f) * 0.5f;
       uint8_t v = (uint8_t)(10 + pulse * 10);
@@ -842,13 +594,13 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
       float drawX = renderX, drawY = renderY, drawW = n->w, drawH = n->h;
 
       int texW = 0, texH = 0;
-      TextureRegistry::GetTextureDimensions(n->bgTextureId, texW, texH);
+      TextureRegistry::GetTextureDimensions(n->media->bgTextureId, texW, texH);
 
       if (texW > 0 && texH > 0) {
         float imgAspect = (float)texW / (float)texH;
         float boxAspect = n->w / n->h;
 
-        if (n->bgImageFit == "cover") {
+        if (n->media->bgImageFit == ObjectFit::Cover) {
           if (imgAspect > boxAspect) {
             float scaledW = n->h * imgAspect;
             float crop = (scaledW - n->w) / 2.0f;
@@ -860,7 +612,7 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
             vMin = crop / scaledH;
             vMax = 1.0f - vMin;
           }
-        } else if (n->bgImageFit == "contain") {
+        } else if (n->media->bgImageFit == ObjectFit::Contain) {
           if (imgAspect > boxAspect) {
             drawW = n->w;
             drawH = n->w / imgAspect;
@@ -873,22 +625,19 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
         }
       }
 
-      list.push(DrawImageCommand{
-          {drawX, drawY, drawW, drawH},
-          n->bgTextureId,
-          {255, 255, 255, (uint8_t)(255 * alphaMultiplier * n->BGOpacity)},
-          uMin, vMin, uMax, vMax,
-          n->borderRadius,
-          {renderX, renderY, n->w, n->h},
-          n->borderWidth
-          });
-    }
-  }
-
-  bool applyClip = false;
-  if (n->overflowHidden) {
-    if (!isDragPass || treatAsDragged) {
-      applyClip = true;
+      TextureRegistry::TextureRegion region;
+      if (TextureRegistry::GetTextureRegion(n->media->bgTextureId, region)) {
+        mapToRegion(region, uMin, vMin, uMax, vMax);
+        list.push(DrawImageCommand{
+            {drawX, drawY, drawW, drawH},
+            region.texture,
+            {255, 255, 255, (uint8_t)(255 * alphaMultiplier * n->BGOpacity)},
+            uMin, vMin, uMax, vMax,
+            n->borderRadius,
+            {renderX, renderY, n->w, n->h},
+            n->borderWidth
+            });
+      }
     }
   }
 
@@ -896,8 +645,8 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
     list.push(PushClipCommand{{renderX, renderY, n->w, n->h}, n->borderRadius, n->borderWidth});
   }
 
-  if (n->type == "image" && n->textureId != 0) {
-    if (!TextureRegistry::IsTextureLoaded(n->textureId)) {
+  if (n->type == "image" && n->media->textureId != 0) {
+    if (!TextureRegistry::IsTextureLoaded(n->media->textureId)) {
       // Draw pulsating skeleton loader
       float pulse = (std::sin(SDL_GetTicks() / 150.0f) + 1.0f) * 0.5f;
       uint8_t v = (uint8_t)(10 + pulse * 10);
@@ -916,13 +665,13 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
       float drawX = renderX, drawY = renderY, drawW = n->w, drawH = n->h;
 
       int texW = 0, texH = 0;
-      TextureRegistry::GetTextureDimensions(n->textureId, texW, texH);
+      TextureRegistry::GetTextureDimensions(n->media->textureId, texW, texH);
 
       if (texW > 0 && texH > 0) {
         float imgAspect = (float)texW / (float)texH;
         float boxAspect = n->w / n->h;
 
-        if (n->objectFit == "cover") {
+        if (n->media->objectFit == ObjectFit::Cover) {
           if (imgAspect > boxAspect) {
             float scaledW = n->h * imgAspect;
             float crop = (scaledW - n->w) / 2.0f;
@@ -934,7 +683,7 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
             vMin = crop / scaledH;
             vMax = 1.0f - vMin;
           }
-        } else if (n->objectFit == "contain") {
+        } else if (n->media->objectFit == ObjectFit::Contain) {
           if (imgAspect > boxAspect) {
             drawW = n->w;
             drawH = n->w / imgAspect;
@@ -947,37 +696,42 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
         }
       }
 
-      list.push(DrawImageCommand{
-          {drawX, drawY, drawW, drawH},
-          n->textureId,
-          imageTint,
-          uMin, vMin, uMax, vMax,
-          n->borderRadius,
-          {renderX, renderY, n->w, n->h},
-          n->borderWidth
-          });
+      TextureRegistry::TextureRegion region;
+      if (TextureRegistry::GetTextureRegion(n->media->textureId, region)) {
+        mapToRegion(region, uMin, vMin, uMax, vMax);
+        list.push(DrawImageCommand{
+            {drawX, drawY, drawW, drawH},
+            region.texture,
+            imageTint,
+            uMin, vMin, uMax, vMax,
+            n->borderRadius,
+            {renderX, renderY, n->w, n->h},
+            n->borderWidth
+            });
+      }
     }
   }
 
   if (n->type == "text") {
-    Font* font = n->font ? n->font : UI_GetFontById(n->fontId);
+    Font* font = n->textState->font ? n->textState->font : UI_GetFontById(n->textState->fontId);
     if (font) {
-      n->font = font;
+      n->textState.set(&NodeText::font, font);
+      const NodeText& text = n->textState.get();
       float contentWidth = n->w - (n->paddingLeft + n->paddingRight);
       float contentHeight = n->h - (n->paddingTop + n->paddingBottom);
-      const std::vector<uint32_t>& codepoints = n->codepoints;
+      const std::vector<uint32_t>& codepoints = text.codepoints;
 
       float startX = renderX + n->paddingLeft - n->scrollX;
-      float cursorY = renderY + n->paddingTop + n->font->GetLogicalAscent() - n->scrollY;
+      float cursorY = renderY + n->paddingTop + text.font->GetLogicalAscent() - n->scrollY;
 
       int selMin = -1, selMax = -1;
-      if (n->selectionStart >= 0 && n->selectionEnd >= 0 && n->selectionStart != n->selectionEnd) {
-        selMin = std::min(n->selectionStart, n->selectionEnd);
-        selMax = std::max(n->selectionStart, n->selectionEnd);
+      if (n->textEdit->selectionStart >= 0 && n->textEdit->selectionEnd >= 0 && n->textEdit->selectionStart != n->textEdit->selectionEnd) {
+        selMin = std::min(n->textEdit->selectionStart, n->textEdit->selectionEnd);
+        selMax = std::max(n->textEdit->selectionStart, n->textEdit->selectionEnd);
       }
 
-      for (size_t lineIdx = 0; lineIdx < n->computedLines.size(); ++lineIdx) {
-        const TextLine& line = n->computedLines[lineIdx];
+      for (size_t lineIdx = 0; lineIdx < text.computedLines.size(); ++lineIdx) {
+        const TextLine& line = text.computedLines[lineIdx];
         float lineXOffset = 0;
 
         if (n->wordWrap) {
@@ -1002,61 +756,37 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
             }
 
             list.push(DrawRectCommand{
-                {startX + lineXOffset + selOffsetX, cursorY - font->GetLogicalAscent(), selWidth, n->computedLineHeight},
+                {startX + lineXOffset + selOffsetX, cursorY - font->GetLogicalAscent(), selWidth, text.computedLineHeight},
                 {59, 130, 246, 128} // Blue highlight
                 });
           }
         }
 
         // 2. DRAW BLINKING CURSOR & HANDLE 2D AUTO-SCROLLING
-        if (n->cursorPosition >= 0 && n->cursorPosition >= (int)line.startIndex && n->cursorPosition <= (int)lineEndIdx) {
+        if (n->textEdit->cursorPosition >= 0 && n->textEdit->cursorPosition >= (int)line.startIndex && n->textEdit->cursorPosition <= (int)lineEndIdx) {
           // Prevent drawing the cursor twice if it's at the boundary between two lines
-          bool isLastLine = (lineIdx == n->computedLines.size() - 1);
-          if (n->cursorPosition < (int)lineEndIdx || isLastLine || codepoints[n->cursorPosition-1] == '\n') {
+          bool isLastLine = (lineIdx == text.computedLines.size() - 1);
+          if (n->textEdit->cursorPosition < (int)lineEndIdx || isLastLine || codepoints[n->textEdit->cursorPosition-1] == '\n') {
             float cursorOffsetX = 0;
-            uint32_t localCursor = n->cursorPosition - line.startIndex;
+            uint32_t localCursor = n->textEdit->cursorPosition - line.startIndex;
             for (uint32_t i = 0; i < localCursor; i++) {
               cursorOffsetX += font->GetLogicalAdvance(codepoints[line.startIndex + i]);
             }
 
-            if (n->cursorPosition != n->lastCursorPosition) {
+            if (n->textEdit->cursorPosition != n->textEdit->lastCursorPosition) {
 
               Node* scroller = n;
               while (scroller && !scroller->overflowHidden) {
                 scroller = scroller->parent;
               }
 
+              // the scroller is an ancestor, possibly outside this subtree
               if (scroller) {
-                float sContentW = scroller->w - scroller->paddingLeft - scroller->paddingRight;
-                float sContentH = scroller->h - scroller->paddingTop - scroller->paddingBottom;
-
-                // Keep the cursor a few pixels away from the absolute edge so it's clearly visible
-                float cursorThickness = 1.0f;
-
-                float safePaddingX = std::min(5.0f, std::max(0.0f, (sContentW - cursorThickness) / 2.0f));
-                float safePaddingY = std::min(5.0f, std::max(0.0f, (sContentH - n->computedLineHeight) / 2.0f));
-
-                // Horizontal Auto-Scroll mapped to the parent
-                float absoluteCursorX = (n->x - scroller->x - scroller->paddingLeft) + n->paddingLeft + lineXOffset + cursorOffsetX;
-                if (absoluteCursorX < scroller->targetScrollX) {
-                  scroller->targetScrollX = absoluteCursorX - safePaddingX;
-                } else if (absoluteCursorX + cursorThickness > scroller->targetScrollX + sContentW) {
-                  float desiredScrollX = absoluteCursorX + cursorThickness - sContentW + safePaddingX;
-                  scroller->targetScrollX = std::min(desiredScrollX, absoluteCursorX - safePaddingX);
-                }
-                if (scroller->targetScrollX < 0) scroller->targetScrollX = 0;
-
-                // Vertical Auto-Scroll mapped to absolute layout coordinates
-                float absoluteCursorY = (n->y - scroller->y - scroller->paddingTop) + n->paddingTop + (lineIdx * n->computedLineHeight);
-                if (absoluteCursorY < scroller->targetScrollY) {
-                  scroller->targetScrollY = absoluteCursorY - safePaddingY; // Push view up
-                } else if (absoluteCursorY + n->computedLineHeight > scroller->targetScrollY + sContentH) {
-                  float desiredScrollY = absoluteCursorY + n->computedLineHeight - sContentH + safePaddingY;
-                  scroller->targetScrollY = std::min(desiredScrollY, absoluteCursorY - safePaddingY);
-                }
-                if (scroller->targetScrollY < 0) scroller->targetScrollY = 0;
+                out.carets.push_back({n, scroller,
+                    (n->x - scroller->x - scroller->paddingLeft) + n->paddingLeft + lineXOffset + cursorOffsetX,
+                    (n->y - scroller->y - scroller->paddingTop) + n->paddingTop + (lineIdx * text.computedLineHeight)});
               }
-              n->lastCursorPosition = n->cursorPosition;
+              n->textEdit.edit().lastCursorPosition = n->textEdit->cursorPosition;
             }
 
 
@@ -1064,45 +794,37 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
             bool showCursor = ((SDL_GetTicks() - Input::lastInputTime) % 1000) < 500;
             if (showCursor) {
               list.push(DrawRectCommand{
-                  {startX + lineXOffset + cursorOffsetX, cursorY - font->GetLogicalAscent(), 1.0f, n->computedLineHeight},
-                  {n->textColor.r, n->textColor.g, n->textColor.b, 255}
+                  {startX + lineXOffset + cursorOffsetX, cursorY - font->GetLogicalAscent(), 1.0f, text.computedLineHeight},
+                  {text.textColor.r, text.textColor.g, text.textColor.b, 255}
                   });
             }
           }
         }
 
         // 3. DRAW TEXT LINE
-        std::string lineStr = "";
-        for (uint32_t i = 0; i < line.count; i++) {
-          appendCP(lineStr, codepoints[line.startIndex + i]);
-        }
-
-        Color renderTextColor = {
-          n->textColor.r, n->textColor.g, n->textColor.b,
-          (uint8_t)(n->textColor.a * alphaMultiplier)
-        };
+        if (lineIdx < text.lineRuns.size()) {
+          Color renderTextColor = {
+            text.textColor.r, text.textColor.g, text.textColor.b,
+            (uint8_t)(text.textColor.a * alphaMultiplier)
+          };
 
-        list.push(DrawTextCommand{lineStr, n->font, startX + lineXOffset, cursorY, renderTextColor, n->textDecoration});
+          list.push(DrawTextCommand{text.lineRuns[lineIdx], text.font, startX + lineXOffset, cursorY, renderTextColor, n->textDecoration});
+        }
 
-        cursorY += n->computedLineHeight;
+        cursorY += text.computedLineHeight;
       }
     }
   }
+}
 
-  std::vector<Node*> sortedChildren = n->children;
-  std::stable_sort(sortedChildren.begin(), sortedChildren.end(), [](Node* a, Node* b) {
-      return a->zIndex < b->zIndex;
-      });
-
-  for (Node* c : sortedChildren) {
-    renderNodePass(c, list, totalOffsetX - n->scrollX, totalOffsetY - n->scrollY, isDragPass, treatAsDragged, parentAlpha);
-  }
+static void emitAfterCommands(Node* n, RenderCommandList& list, float totalOffsetX,
+    float totalOffsetY, float alphaMultiplier, bool applyClip) {
 
   // Render Scrollbars
   ScrollbarMetrics sb = n->getScrollbarMetrics();
-  if (n->scrollbarOpacity > 0.0f) {
-    uint8_t trackAlpha = (uint8_t)(180 * n->scrollbarOpacity * alphaMultiplier);
-    uint8_t thumbAlpha = (uint8_t)(255 * n->scrollbarOpacity * alphaMultiplier);
+  if (n->scrollbar->scrollbarOpacity > 0.0f) {
+    uint8_t trackAlpha = (uint8_t)(180 * n->scrollbar->scrollbarOpacity * alphaMultiplier);
+    uint8_t thumbAlpha = (uint8_t)(255 * n->scrollbar->scrollbarOpacity * alphaMultiplier);
     float pad = 2.0f;
 
     if (sb.vVisible) {
@@ -1134,102 +856,387 @@ static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX
   if (applyClip) {
     list.push(PopClipCommand{});
   }
+}
 
-  // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
-  // ╏ CAPTURE GENERATED COMMANDS TO RAM ╏
-  // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
-  if (!isDragPass) {
-    n->cachedCommands.commands.clear();
-    for (size_t i = startIndex; i < list.commands.size(); i++) {
-      n->cachedCommands.commands.push_back(list.commands[i]);
-    }
-    n->hasCachedCommands = true;
-    n->isPaintDirty = false;
-
-    n->cachedOffsetX = totalOffsetX;
-    n->cachedOffsetY = totalOffsetY;
+// children in zIndex order; only copies the list when it is out of order
+template <typename F>
+static void forEachInPaintOrder(Node* n, F&& fn) {
+  auto byZ = [](Node* a, Node* b) { return a->zIndex < b->zIndex; };
+  if (std::is_sorted(n->children.begin(), n->children.end(), byZ)) {
+    for (Node* c : n->children) fn(c);
+    return;
   }
 
+  std::vector<Node*> sortedChildren = n->children;
+  std::stable_sort(sortedChildren.begin(), sortedChildren.end(), byZ);
+  for (Node* c : sortedChildren) fn(c);
 }
 
-void generateRenderCommands(Node *n, RenderCommandList &list, float parentOffsetX, float parentOffsetY) {
-  // PASS 1: Draw the base UI layer normally
-  renderNodePass(n, list, parentOffsetX, parentOffsetY, false, false, 1.0f);
-
-  // PASS 2: Draw the dragged elements on top of everything!
-  renderNodePass(n, list, parentOffsetX, parentOffsetY, true, false, 1.0f);
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ CLIP AND INK CULLING ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// The flatten carries the visible rect down the tree, narrowed at every
+// overflow-hidden node. A command is only appended if it reaches into it,
+// and each node remembers the bounds its subtree drew ("ink") so a clean
+// subtree whose ink misses the rect is skipped without being visited:
+// rows scrolled far out of view cost nothing.
+
+static bool rectsIntersect(const Rect& a, const Rect& b) {
+  return a.x < b.x + b.w && b.x < a.x + a.w &&
+    a.y < b.y + b.h && b.y < a.y + a.h;
 }
 
-void freeTree(lua_State* L, Node* n) {
-  if (!n) return;
+static Rect intersectRects(const Rect& a, const Rect& b) {
+  float x0 = std::max(a.x, b.x);
+  float y0 = std::max(a.y, b.y);
+  float x1 = std::min(a.x + a.w, b.x + b.w);
+  float y1 = std::min(a.y + a.h, b.y + b.h);
+  return {x0, y0, std::max(0.0f, x1 - x0), std::max(0.0f, y1 - y0)};
+}
 
-  Input::clearNodeState(n);
+static void growRect(Rect& r, const Rect& add) {
+  float x1 = std::max(r.x + r.w, add.x + add.w);
+  float y1 = std::max(r.y + r.h, add.y + add.h);
+  r.x = std::min(r.x, add.x);
+  r.y = std::min(r.y, add.y);
+  r.w = x1 - r.x;
+  r.h = y1 - r.y;
+}
 
-  if (n->type == "image" && n->textureId != 0) {
-    TextureRegistry::ReleaseTexture(n->textureId);
-    n->textureId = 0;
+// screen bounds of a draw command; clip push/pop have none
+static bool commandBounds(const RenderCommand& cmd, Rect& out) {
+  if (const auto* r = std::get_if<DrawRectCommand>(&cmd)) {
+    out = r->rect;
+    return true;
   }
-
-  if (n->bgTextureId != 0) {
-    TextureRegistry::ReleaseTexture(n->bgTextureId);
-    n->bgTextureId = 0;
+  if (const auto* img = std::get_if<DrawImageCommand>(&cmd)) {
+    out = img->rect;
+    return true;
   }
-
-  if (n->onClickRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onClickRef);
-    n->onClickRef = -2;
+  if (const auto* t = std::get_if<DrawTextCommand>(&cmd)) {
+    if (!t->font || !t->run) return false;
+    float ascent = t->font->GetLogicalAscent();
+    out = {t->x, t->y - ascent, t->run->advance, t->font->GetLogicalLineHeight()};
+    return true;
   }
-  if (n->onMouseEnterRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onMouseEnterRef);
-    n->onMouseEnterRef = -2;
+  return false;
+}
+
+// appends what `src` draws inside `clip`, widening `ink` by everything it
+// draws; for text this keeps only the lines in view
+static void appendVisible(RenderCommandList& list, const RenderCommandList& src, const Rect& clip, Rect& ink) {
+  for (const RenderCommand& cmd : src.commands) {
+    Rect bounds;
+    if (!commandBounds(cmd, bounds)) {
+      list.commands.push_back(cmd);
+      continue;
+    }
+    growRect(ink, bounds);
+    if (rectsIntersect(bounds, clip)) {
+      list.commands.push_back(cmd);
+    }
   }
-  if (n->onMouseLeaveRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onMouseLeaveRef);
-    n->onMouseLeaveRef = -2;
+}
+
+// what the base pass carries down besides the offsets
+struct FlattenScope {
+  Rect clip;               // visible area, narrowed at overflow-hidden nodes
+  Rect* parentInk;         // grown by what the subtree draws; null below a clip
+  Rect hitClip;            // like clip, but where hit boxes are cut
+  float hitDX, hitDY;      // drag offset of an enclosing dragged node
+  bool dragged;            // inside the dragged subtree: hits stack on top
+  FlattenOutput* out;      // side effects of the subtree
+  bool canSplit;           // children may still be handed to workers
+};
+
+static const Rect NO_CLIP = {-1.0e6f, -1.0e6f, 2.0e6f, 2.0e6f};
+
+static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX,
+    float parentOffsetY, bool isDragPass, bool isInsideDraggedNode, float parentAlpha,
+    const FlattenScope& scope);
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ PARALLEL SUBTREE FLATTENING ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// At the first node (from the root down) with several children to
+// regenerate, each child subtree is flattened on the worker pool into its
+// own list, ink and side effects. They are stitched together in paint
+// order, so the result is what a serial walk would have produced. Clean
+// subtrees only copy cached commands and aren't worth a split.
+static constexpr int MIN_PARALLEL_SUBTREES = 4;
+
+struct SubtreeJob {
+  Node* node;
+  RenderCommandList list;
+  FlattenOutput out;
+  Rect ink;
+};
+
+static void flattenChildren(Node* n, RenderCommandList& list, float childOffsetX,
+    float childOffsetY, float parentAlpha, const FlattenScope& childScope, Rect& ink) {
+  int dirtyChildren = 0;
+  if (childScope.canSplit && WorkerPool::WorkerCount() > 0) {
+    for (Node* c : n->children) {
+      if (c->isPaintDirty) dirtyChildren++;
+    }
   }
-  if (n->onRightClickRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onRightClickRef);
-    n->onRightClickRef = -2;
+
+  if (dirtyChildren < MIN_PARALLEL_SUBTREES) {
+    forEachInPaintOrder(n, [&](Node* c) {
+      renderNodePass(c, list, childOffsetX, childOffsetY, false, false, parentAlpha, childScope);
+    });
+    return;
   }
 
-  if (n->onDragStartRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onDragStartRef);
-    n->onDragStartRef = -2;
+  std::vector<SubtreeJob> jobs;
+  jobs.reserve(n->children.size());
+  forEachInPaintOrder(n, [&](Node* c) {
+    jobs.push_back({c, {}, {}, ink});
+  });
+
+  WorkerPool::ParallelFor(jobs.size(), [&](size_t i) {
+    SubtreeJob& job = jobs[i];
+    FlattenScope scope = childScope;
+    scope.out = &job.out;
+    scope.canSplit = false;
+    // starts from the parent's ink, so growing the parent by every job's
+    // ink afterwards gives the union a serial walk builds
+    if (scope.parentInk) scope.parentInk = &job.ink;
+    renderNodePass(job.node, job.list, childOffsetX, childOffsetY, false, false, parentAlpha, scope);
+  });
+
+  for (SubtreeJob& job : jobs) {
+    list.commands.insert(list.commands.end(),
+        std::make_move_iterator(job.list.commands.begin()),
+        std::make_move_iterator(job.list.commands.end()));
+    if (childScope.parentInk) growRect(ink, job.ink);
+    childScope.out->append(job.out);
   }
-  if (n->onDragRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onDragRef);
-    n->onDragRef = -2;
+}
+
+static void renderNodePass(Node* n, RenderCommandList& list, float parentOffsetX,
+    float parentOffsetY, bool isDragPass, bool isInsideDraggedNode, float parentAlpha,
+    const FlattenScope& scope) {
+  const Rect& clip = scope.clip;
+  Rect* parentInk = scope.parentInk;
+
+  float totalOffsetX = parentOffsetX + n->translateX;
+  float totalOffsetY = parentOffsetY + n->translateY;
+
+  if (isDragPass) {
+    totalOffsetX += n->drag->dragOffsetX;
+    totalOffsetY += n->drag->dragOffsetY;
   }
-  if (n->onDragEndRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onDragEndRef);
-    n->onDragEndRef = -2;
+
+  float childOffsetX = totalOffsetX - n->scrollX;
+  float childOffsetY = totalOffsetY - n->scrollY;
+
+  // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+  // ╏ BASE PASS: FLATTEN THE RETAINED DISPLAY LIST ╏
+  // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+  // Only nodes whose own state changed regenerate; a clean node that moved
+  // with a scrolled or translated ancestor just shifts its own commands.
+  if (!isDragPass) {
+    // a clean subtree draws what it drew last time, shifted with its offset
+    if (!n->isPaintDirty && n->hasInkBounds) {
+      Rect ink = {n->inkBounds.x + totalOffsetX, n->inkBounds.y + totalOffsetY,
+        n->inkBounds.w, n->inkBounds.h};
+      if (!rectsIntersect(ink, clip)) {
+        if (n->inkOnScreen) {
+          // nothing draws over where it was last frame otherwise
+          scope.out->damage.push_back({n->inkBounds.x + n->cachedOffsetX, n->inkBounds.y + n->cachedOffsetY,
+              n->inkBounds.w, n->inkBounds.h});
+          n->inkOnScreen = false;
+        }
+        if (parentInk) growRect(*parentInk, ink);
+        return;
+      }
+    }
+
+    // set when the node is drawn somewhere new; its ink is damaged once the
+    // children have been flattened into it
+    bool inkMoved = false;
+    if (!n->hasCachedCommands) {
+      float alphaMultiplier = parentAlpha * n->opacity;
+      n->displayOwn.clear();
+      n->displayAfter.clear();
+      emitOwnCommands(n, n->displayOwn, totalOffsetX, totalOffsetY, alphaMultiplier, n->overflowHidden, *scope.out);
+      emitAfterCommands(n, n->displayAfter, totalOffsetX, totalOffsetY, alphaMultiplier, n->overflowHidden);
+
+      n->hasCachedCommands = true;
+      n->cachedOffsetX = totalOffsetX;
+      n->cachedOffsetY = totalOffsetY;
+
+      // the old ink was damaged when the node was invalidated
+      inkMoved = true;
+    } else {
+      float dx = totalOffsetX - n->cachedOffsetX;
+      float dy = totalOffsetY - n->cachedOffsetY;
+
+      if (dx != 0.0f || dy != 0.0f) {
+        for (auto& cmd : n->displayOwn.commands) TranslateRenderCommand(cmd, dx, dy);
+        for (auto& cmd : n->displayAfter.commands) TranslateRenderCommand(cmd, dx, dy);
+
+        if (n->hasInkBounds) {
+          scope.out->damage.push_back({n->inkBounds.x + n->cachedOffsetX, n->inkBounds.y + n->cachedOffsetY,
+              n->inkBounds.w, n->inkBounds.h});
+        }
+        inkMoved = true;
+
+        n->cachedOffsetX = totalOffsetX;
+        n->cachedOffsetY = totalOffsetY;
+      }
+    }
+
+    Rect box = {n->x + totalOffsetX, n->y + totalOffsetY, n->w, n->h};
+
+    // descendants of a clipping node can't draw outside it
+    Rect ink = box;
+    FlattenScope childScope = scope;
+    if (n->overflowHidden) {
+      childScope.clip = intersectRects(clip, box);
+      childScope.parentInk = nullptr;
+    } else {
+      childScope.parentInk = &ink;
+    }
+
+    // hit boxes sit where the node is seen: a dragged subtree floats above
+    // everything, unclipped by its ancestors, like the drag pass draws it
+    bool startsDrag = !scope.dragged && n->drag->isDragging && n->drag->isDraggable;
+    childScope.dragged = scope.dragged || startsDrag;
+    childScope.hitDX += n->drag->dragOffsetX;
+    childScope.hitDY += n->drag->dragOffsetY;
+
+    Rect hitBox = {box.x + childScope.hitDX, box.y + childScope.hitDY, box.w, box.h};
+    Rect hitClip = startsDrag ? NO_CLIP : scope.hitClip;
+    scope.out->hits.push_back({n, intersectRects(hitBox, hitClip), childScope.dragged});
+    childScope.hitClip = n->overflowHidden ? intersectRects(hitClip, hitBox) : hitClip;
+
+    appendVisible(list, n->displayOwn, clip, ink);
+    flattenChildren(n, list, childOffsetX, childOffsetY, parentAlpha, childScope, ink);
+    appendVisible(list, n->displayAfter, clip, ink);
+
+    n->inkBounds = {ink.x - totalOffsetX, ink.y - totalOffsetY, ink.w, ink.h};
+    n->hasInkBounds = true;
+    n->inkOnScreen = true;
+    if (inkMoved) scope.out->damage.push_back(ink);
+    if (parentInk) growRect(*parentInk, ink);
+
+    n->isPaintDirty = false;
+    return;
   }
-  if (n->onTextInputRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onTextInputRef);
-    n->onTextInputRef = -2;
+
+  // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+  // ╏ DRAG PASS: DRAGGED SUBTREES, UNCACHED  ╏
+  // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+  float currentAlpha = parentAlpha * n->opacity;
+  bool treatAsDragged = isInsideDraggedNode || (n->drag->isDragging && n->drag->isDraggable);
+
+  if (!treatAsDragged) {
+    for (Node* c : n->children) {
+      renderNodePass(c, list, childOffsetX, childOffsetY, true, false, parentAlpha, scope);
+    }
+    return;
   }
-  if (n->onKeyDownRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onKeyDownRef);
-    n->onKeyDownRef = -2;
+
+  if (!isInsideDraggedNode) {
+    scope.out->damage.push_back({n->x + totalOffsetX, n->y + totalOffsetY, n->w, n->h});
   }
-  if (n->onFocusRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onFocusRef);
-    n->onFocusRef = -2;
+
+  float alphaMultiplier = currentAlpha * 0.7f;
+  emitOwnCommands(n, list, totalOffsetX, totalOffsetY, alphaMultiplier, n->overflowHidden, *scope.out);
+  forEachInPaintOrder(n, [&](Node* c) {
+    renderNodePass(c, list, childOffsetX, childOffsetY, true, true, parentAlpha, scope);
+  });
+  emitAfterCommands(n, list, totalOffsetX, totalOffsetY, alphaMultiplier, n->overflowHidden);
+}
+
+void generateRenderCommands(Node *n, RenderCommandList &list, const Rect& viewport, float parentOffsetX, float parentOffsetY) {
+  // PASS 1: Draw the base UI layer normally, collecting hit boxes on the way
+  FlattenOutput out;
+  FlattenScope scope = {viewport, nullptr, viewport, 0.0f, 0.0f, false, &out, true};
+  renderNodePass(n, list, parentOffsetX, parentOffsetY, false, false, 1.0f, scope);
+
+  HitIndex::begin(viewport);
+  applyFlattenOutput(out);
+  HitIndex::end();
+
+  // PASS 2: Draw the dragged elements on top of everything!
+  // Only one node can be dragged; start at it instead of walking the tree.
+  Node* dragged = Input::getActiveDragNode();
+  if (!dragged || !dragged->drag->isDragging || !dragged->drag->isDraggable) return;
+
+  float offsetX = parentOffsetX;
+  float offsetY = parentOffsetY;
+  bool inTree = dragged == n;
+  for (Node* a = dragged->parent; a && !inTree; a = a->parent) {
+    offsetX += a->translateX - a->scrollX;
+    offsetY += a->translateY - a->scrollY;
+    inTree = a == n;
+  }
+  if (!inTree) return;
+
+  renderNodePass(dragged, list, offsetX, offsetY, true, false, 1.0f, scope);
+  applyFlattenOutput(out);
+}
+
+void freeTree(lua_State* L, Node* n) {
+  if (!n) return;
+
+  Input::clearNodeState(n);
+
+  if (n->media.has()) {
+    NodeMedia& media = n->media.edit();
+    if (n->type == "image" && media.textureId != 0) {
+      TextureRegistry::ReleaseTexture(media.textureId);
+      media.textureId = 0;
+    }
+
+    if (media.bgTextureId != 0) {
+      TextureRegistry::ReleaseTexture(media.bgTextureId);
+      media.bgTextureId = 0;
+    }
   }
-  if (n->onBlurRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onBlurRef);
-    n->onBlurRef = -2;
+
+  auto unref = [&](int& ref) {
+    if (ref != -2) {
+      luaL_unref(L, LUA_REGISTRYINDEX, ref);
+      ref = -2;
+    }
+  };
+
+  if (n->events.has()) {
+    NodeEvents& ev = n->events.edit();
+    unref(ev.onClickRef);
+    unref(ev.onMouseEnterRef);
+    unref(ev.onMouseLeaveRef);
+    unref(ev.onRightClickRef);
+    unref(ev.onTextInputRef);
+    unref(ev.onKeyDownRef);
+    unref(ev.onFocusRef);
+    unref(ev.onBlurRef);
+    unref(ev.onScrollRef);
   }
 
-  if (n->onScrollRef != -2) {
-    luaL_unref(L, LUA_REGISTRYINDEX, n->onScrollRef);
-    n->onScrollRef = -2;
+  if (n->drag.has()) {
+    NodeDrag& drag = n->drag.edit();
+    unref(drag.onDragStartRef);
+    unref(drag.onDragRef);
+    unref(drag.onDragEndRef);
   }
 
+  unref(n->renderRef);
+  unref(n->propsRef);
+  unref(n->memoRef);
+  StateManager::instance().unsubscribe(n);
+  VDOM::forgetNode(n);
+
   for (Node* c : n->children) {
     freeTree(L, c);
   }
 
+  Layout::releaseNode(n);
+
   delete n;
 }
 
@@ -1344,83 +1351,154 @@ TextLayoutResult calculateTextLayout(const std::string& text, Font* font, float
 
 
 void computeTextLayout(Node* n) {
-  Font* font = n->font ? n->font : UI_GetFontById(n->fontId);
-  n->font = font;
-
-  if (n->type != "text" || !n->font) {
-    n->computedLines.clear();
+  Font* font = n->textState->font ? n->textState->font : UI_GetFontById(n->textState->fontId);
+  n->textState.set(&NodeText::font, font);
+
+  if (n->type != "text" || !font) {
+    if (n->textState.has()) {
+      NodeText& text = n->textState.edit();
+      text.computedLines.clear();
+      text.appliedWrap.reset();
+      text.lineRuns.clear();
+    }
     return;
   }
 
-  n->computedLineHeight = (float)n->font->GetLogicalLineHeight();
+  NodeText& text = n->textState.edit();
+  text.computedLineHeight = (float)font->GetLogicalLineHeight();
 
   float innerW = n->w - (n->paddingLeft + n->paddingRight);
   float maxWidth = (n->wordWrap && innerW > 0) ? innerW : 999999.0f;
 
-  const auto& codepoints = n->codepoints;
-  n->computedLines = n->font->CalculateWordWrap(codepoints, maxWidth);
+  WrapResultRef wrap = wrapNodeText(n, maxWidth);
+  if (wrap != text.appliedWrap) {
+    text.computedLines = wrap->lines;
+    text.appliedWrap = wrap;
 
-  float maxLineWidth = 0.0f;
-  for (const auto& line : n->computedLines) {
-    if (line.width > maxLineWidth) maxLineWidth = line.width;
+    text.lineRuns.clear();
+    text.lineRuns.reserve(text.computedLines.size());
+    for (const TextLine& line : text.computedLines) {
+      text.lineRuns.push_back(font->ShapeRun(text.codepoints.data() + line.startIndex, line.count));
+    }
   }
-  n->contentW = maxLineWidth + n->paddingLeft + n->paddingRight;
-  n->contentH = (n->computedLines.size() * n->computedLineHeight) + n->paddingTop + n->paddingBottom;
+
+  n->contentW = wrap->width + n->paddingLeft + n->paddingRight;
+  n->contentH = (text.computedLines.size() * text.computedLineHeight) + n->paddingTop + n->paddingBottom;
 
 }
 
-void updateTextLayout(Node* n) {
-  if (!n) return;
+// Returns the node's text wrapped at maxWidth, re-wrapping only when text,
+// font or width changed. A wrap with no soft breaks is also valid for any
+// wider width, which covers most "measure at max, lay out at natural" pairs.
+static int findWrapSlot(Node* n, float maxWidth) {
+  const NodeText& text = n->textState.get();
+  for (int i = 0; i < 2; i++) {
+    const TextWrapSlot& slot = text.wrapCache[i];
+    if (!slot.result || slot.font != text.font || slot.textHash != text.textHash) continue;
 
-  float maxChildRight = 0.0f;
-  float maxChildBottom = 0.0f;
+    bool fits = slot.maxWidth == maxWidth ||
+      (!slot.result->softWrapped && maxWidth >= slot.result->width);
+    if (fits) return i;
+  }
+  return -1;
+}
 
-  for (Node* c : n->children) {
-    updateTextLayout(c);
+static void storeWrapSlot(Node* n, float maxWidth, WrapResultRef result) {
+  NodeText& text = n->textState.edit();
+  text.wrapCache[1] = std::move(text.wrapCache[0]);
+  text.wrapCache[0] = {text.font, text.textHash, maxWidth, std::move(result)};
+}
+
+WrapResultRef wrapNodeText(Node* n, float maxWidth) {
+  int i = findWrapSlot(n, maxWidth);
+  NodeText& text = n->textState.edit();
+  if (i >= 0) {
+    if (i == 1) std::swap(text.wrapCache[0], text.wrapCache[1]);
+    return text.wrapCache[0].result;
+  }
 
-    float childLocalX = c->x - n->x;
-    float childLocalY = c->y - n->y;
+  WrapResultRef result = UI_WrapText(text.font, text.codepoints, text.textHash, maxWidth);
+  storeWrapSlot(n, maxWidth, result);
+  return result;
+}
 
-    float childTrueW = std::max(c->w, c->contentW);
-    float childTrueH = std::max(c->h, c->contentH);
+// Below this much text the batch costs more than it saves; the measure
+// callback wraps it lazily as before.
+static constexpr size_t MIN_PREWRAP_CODEPOINTS = 4096;
+
+// Wraps, on the worker pool, what layout is about to ask for: the natural
+// width (no soft breaks, so it also answers any wider constraint) and, for
+// wrapping text, the width it had last layout. A width Yoga only settles on
+// during the solve still misses and is wrapped in the measure callback.
+void prewrapText(const std::vector<Node*>& nodes) {
+  std::vector<WrapRequest> requests;
+  std::vector<Node*> owners;
+  size_t total = 0;
+
+  for (Node* n : nodes) {
+    Font* font = n->textState->font ? n->textState->font : UI_GetFontById(n->textState->fontId);
+    n->textState.set(&NodeText::font, font);
+    if (!font || n->textState->text.empty()) continue;
+
+    const NodeText& text = n->textState.get();
+    auto want = [&](float maxWidth) {
+      if (findWrapSlot(n, maxWidth) >= 0) return;
+      requests.push_back({font, &text.codepoints, text.textHash, maxWidth, nullptr});
+      owners.push_back(n);
+      total += text.codepoints.size();
+    };
 
-    maxChildRight = std::max(maxChildRight, childLocalX + childTrueW);
-    maxChildBottom = std::max(maxChildBottom, childLocalY + childTrueH);
+    want(999999.0f);
+    float innerW = n->w - (n->paddingLeft + n->paddingRight);
+    if (n->wordWrap && innerW > 0) want(innerW);
   }
 
-  if (n->type == "text") {
-    computeTextLayout(n);
-  } else if (!n->children.empty()) {
-    n->contentW = maxChildRight + n->paddingRight;
-    n->contentH = maxChildBottom + n->paddingBottom;
+  if (total < MIN_PREWRAP_CODEPOINTS) return;
+
+  UI_WrapTextBatch(requests);
+  for (size_t i = 0; i < requests.size(); i++) {
+    if (requests[i].result) storeWrapSlot(owners[i], requests[i].maxWidth, requests[i].result);
   }
 }
 
-
 void UI_UpdateSmoothScrolling(Node *n, float dt) {
   if (!n) return;
 
-  if (n->bgTextureId != 0 && !TextureRegistry::IsValidTexture(n->bgTextureId)) {
-    n->bgTextureId = TextureRegistry::GetTexture(n->bgImageSrc);
+  if (n->media->bgTextureId != 0 && !TextureRegistry::IsValidTexture(n->media->bgTextureId)) {
+    n->media.edit().bgTextureId = TextureRegistry::GetTexture(n->media->bgImageSrc);
     n->makePaintDirty();
   }
-  if (n->type == "image" && n->textureId != 0 && !TextureRegistry::IsValidTexture(n->textureId)) {
-    n->textureId = TextureRegistry::GetTexture(n->src);
+  if (n->type == "image" && n->media->textureId != 0 && !TextureRegistry::IsValidTexture(n->media->textureId)) {
+    n->media.edit().textureId = TextureRegistry::GetTexture(n->media->src);
     n->makePaintDirty();
   }
 
   bool isLoading = false;
-  if (n->type == "image" && n->textureId != 0 && !TextureRegistry::IsTextureLoaded(n->textureId)) {
+  if (n->type == "image" && n->media->textureId != 0 && !TextureRegistry::IsTextureLoaded(n->media->textureId)) {
     isLoading = true;
   }
 
-  if (n->bgTextureId != 0 && !TextureRegistry::IsTextureLoaded(n->bgTextureId)) {
+  if (n->media->bgTextureId != 0 && !TextureRegistry::IsTextureLoaded(n->media->bgTextureId)) {
     isLoading = true;
   }
 
   if (isLoading) {
+    if (!n->media->awaitingTexture) n->media.edit().awaitingTexture = true;
+    n->makePaintDirty();
+    // keep the skeleton pulsing
+    Timers::RequestFrame();
+  } else if (n->media->awaitingTexture) {
+    n->media.edit().awaitingTexture = false;
     n->makePaintDirty();
-    g_damageTracker.add(n->x, n->y, n->w, n->h);
+  }
+
+  if (n->media->textureId != 0 || n->media->bgTextureId != 0) {
+    // compaction moved atlas images; their baked UVs are stale
+    uint32_t generation = TextureRegistry::GetAtlasGeneration();
+    if (n->media->atlasGeneration != generation) {
+      n->media.edit().atlasGeneration = generation;
+      n->makePaintDirty();
+    }
   }
 
   if (n->overflowHidden) {
@@ -1440,19 +1518,23 @@ void UI_UpdateSmoothScrolling(Node *n, float dt) {
     n->targetScrollY = std::clamp(n->targetScrollY, 0.0f, maxScrollY);
     n->targetScrollX = std::clamp(n->targetScrollX, 0.0f, maxScrollX);
 
-    if (n->overflowScroll) { 
-      float previousOpacity = n->scrollbarOpacity;
-      if (n->scrollbarTimer > 0.0f) {
-        n->scrollbarTimer -= dt;
-        n->scrollbarOpacity += 8.0f * dt;
-        if (n->scrollbarOpacity > 1.0f) n->scrollbarOpacity = 1.0f;
+    // the scrollbar block only exists once the node has been scrolled
+    if (n->overflowScroll && n->scrollbar.has()) {
+      NodeScrollbar& sb = n->scrollbar.edit();
+      float previousOpacity = sb.scrollbarOpacity;
+      if (sb.scrollbarTimer > 0.0f) {
+        sb.scrollbarTimer -= dt;
+        sb.scrollbarOpacity += 8.0f * dt;
+        if (sb.scrollbarOpacity > 1.0f) sb.scrollbarOpacity = 1.0f;
       } else {
-        n->scrollbarOpacity -= 2.0f * dt; // Fade out slower
-        if (n->scrollbarOpacity < 0.0f) n->scrollbarOpacity = 0.0f;
+        sb.scrollbarOpacity -= 2.0f * dt; // Fade out slower
+        if (sb.scrollbarOpacity < 0.0f) sb.scrollbarOpacity = 0.0f;
       }
-      if (n->scrollbarOpacity != previousOpacity) {
+      if (sb.scrollbarOpacity != previousOpacity) {
         n->makePaintDirty();
-        g_damageTracker.add(n->x, n->y, n->w, n->h);
+      }
+      if (sb.scrollbarTimer > 0.0f || sb.scrollbarOpacity > 0.0f) {
+        Timers::RequestFrame();
       }
     }
 
@@ -1480,7 +1562,7 @@ void UI_UpdateSmoothScrolling(Node *n, float dt) {
 
     if (needsLayout) {
       n->makePaintDirty();
-      g_damageTracker.add(n->x, n->y, n->w, n->h);
+      Timers::RequestFrame();
     }
   }
   for (Node* c : n->children) {
@@ -1544,49 +1626,118 @@ ScrollbarMetrics Node::getScrollbarMetrics() {
   return m;
 }
 
-DamageRect g_damageTracker;
+DamageTracker g_damageTracker;
+
+static float rectArea(const Rect& r) {
+  return r.w * r.h;
+}
+
+static Rect rectUnion(const Rect& a, const Rect& b) {
+  float x0 = std::min(a.x, b.x);
+  float y0 = std::min(a.y, b.y);
+  float x1 = std::max(a.x + a.w, b.x + b.w);
+  float y1 = std::max(a.y + a.h, b.y + b.h);
+  return {x0, y0, x1 - x0, y1 - y0};
+}
 
-void DamageRect::add(float nx, float ny, float nw, float nh) {
+// The rects are kept pairwise disjoint: the renderer replays the frame once
+// per rect, so any overlap would blend its translucent pixels twice.
+void DamageRegion::add(const Rect& r) {
+  if (fullScreen || r.w <= 0.0f || r.h <= 0.0f) return;
+
+  Rect merged = r;
+
+  while (true) {
+    // fold in every rect that overlaps this one, or is cheaper to redraw
+    // together with it than on its own (the union covers at most a little
+    // more than the two areas summed)
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (int i = 0; i < count; i++) {
+        Rect u = rectUnion(rects[i], merged);
+        if (rectsIntersect(rects[i], merged) || rectArea(u) <= (rectArea(rects[i]) + rectArea(merged)) * 1.25f) {
+          merged = u;
+          rects[i] = rects[--count];
+          changed = true;
+          break;
+        }
+      }
+    }
+
+    if (count < MAX_RECTS) {
+      rects[count++] = merged;
+      return;
+    }
+
+    // out of slots: absorb whichever rect grows the least, then fold the
+    // grown rect in again, since it may now overlap others
+    int best = 0;
+    float bestGrowth = 0.0f;
+    for (int i = 0; i < count; i++) {
+      float growth = rectArea(rectUnion(rects[i], merged)) - rectArea(rects[i]);
+      if (i == 0 || growth < bestGrowth) {
+        best = i;
+        bestGrowth = growth;
+      }
+    }
+    merged = rectUnion(rects[best], merged);
+    rects[best] = rects[--count];
+  }
+}
+
+void DamageRegion::add(const DamageRegion& other) {
   if (fullScreen) return;
+  if (other.fullScreen) {
+    fullScreen = true;
+    count = 0;
+    return;
+  }
+  for (int i = 0; i < other.count; i++) {
+    add(other.rects[i]);
+  }
+}
 
+void DamageTracker::add(float nx, float ny, float nw, float nh) {
   // expand the region a little bit for better result
-  nx -= 2.0f; ny -= 2.0f; nw += 4.0f; nh += 4.0f;
-
-  if (!active) {
-    x = nx; y = ny; w = nw; h = nh;
-    active = true;
-  } else {
-    float right = std::max(x + w, nx + nw);
-    float bottom = std::max(y + h, ny + nh);
-    x = std::min(x, nx);
-    y = std::min(y, ny);
-    w = right - x;
-    h = bottom - y;
-  }
-  framesLeft = 2;
+  current.add(Rect{nx - 2.0f, ny - 2.0f, nw + 4.0f, nh + 4.0f});
 }
 
-void DamageRect::damageAll() {
-  fullScreen = true;
-  active = true;
-  framesLeft = 2;
+void DamageTracker::damageAll() {
+  current.fullScreen = true;
+  current.count = 0;
 }
 
-void DamageRect::update() {
-  if (framesLeft > 0) framesLeft--;
-  if (framesLeft == 0) {
-    active = false;
-    fullScreen = false;
+DamageRegion DamageTracker::regionForAge(int bufferAge) const {
+  DamageRegion region = current;
+
+  if (bufferAge <= 0 || bufferAge - 1 > historyCount) {
+    region.fullScreen = true;
+    region.count = 0;
+    return region;
   }
 
+  for (int i = 0; i < bufferAge - 1; i++) {
+    region.add(history[i]);
+  }
+  return region;
+}
+
+void DamageTracker::update() {
+  for (int i = HISTORY - 1; i > 0; i--) {
+    history[i] = history[i - 1];
+  }
+  history[0] = current;
+  historyCount = std::min(historyCount + 1, HISTORY);
+  current.clear();
 }
 
 void UI_FireScrollEvents(lua_State *L, Node *n) {
   if (!n) return;
-  if (n->onScrollRef != -2 && std::abs(n->scrollY - n->lastReportedScrollY) >= 1.0f) {
-    n->lastReportedScrollY = n->scrollY;
+  if (n->events->onScrollRef != -2 && std::abs(n->scrollY - n->scrollbar->lastReportedScrollY) >= 1.0f) {
+    n->scrollbar.edit().lastReportedScrollY = n->scrollY;
 
-    lua_rawgeti(L, LUA_REGISTRYINDEX, n->onScrollRef);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, n->events->onScrollRef);
     if (lua_isfunction(L, -1)) {
       lua_pushnumber(L, n->scrollX);
       lua_pushnumber(L, n->scrollY);
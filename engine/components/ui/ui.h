@@ -4,10 +4,12 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <SDL2/SDL.h>
 #include "../renderer/commands.h"
 #include "../text/font.h"
+#include "node_arena.h"
 
 enum UnitType {
   PIXEL,
@@ -87,18 +89,45 @@ struct ScrollbarMetrics {
   float maxScrollX;
 };
 
-struct DamageRect {
-  bool active = true;
-  bool fullScreen = true;
-  float x = 0, y = 0, w = 0, h = 0;
-  int framesLeft = 2;
+// The parts of the window that changed, as a handful of rects. Separate
+// updates (a caret in one corner, a spinner in another) stay separate
+// until there are too many of them or merging barely grows the area.
+struct DamageRegion {
+  static constexpr int MAX_RECTS = 8;
+
+  bool fullScreen = false;
+  int count = 0;
+  Rect rects[MAX_RECTS];
+
+  void add(const Rect& r);
+  void add(const DamageRegion& other);
+  void clear() { fullScreen = false; count = 0; }
+  bool empty() const { return !fullScreen && count == 0; }
+};
+
+// Collects this frame's damage and remembers the last few frames', so a
+// back buffer that is N swaps old can be repaired with exactly what
+// changed since it was last drawn.
+struct DamageTracker {
+  static constexpr int HISTORY = 4;
+
+  DamageRegion current;
+  DamageRegion history[HISTORY]; // [0] is the previous frame
+  int historyCount = 0;
 
   void add(float nx, float ny, float nw, float nh);
   void damageAll();
+  bool hasDamage() const { return !current.empty(); }
+
+  // what has to be redrawn into a back buffer of this age; 0 means its
+  // contents are undefined
+  DamageRegion regionForAge(int bufferAge) const;
+
+  // call once the frame was presented
   void update();
 };
 
-extern DamageRect g_damageTracker;
+extern DamageTracker g_damageTracker;
 
 enum class FlexWrap {
   NoWrap,
@@ -120,55 +149,157 @@ enum class FlexDirection {
     RowReverse
 };
 
+enum class ObjectFit {
+  Fill,
+  Cover,
+  Contain
+};
 
-struct Node {
-  std::string type;
-  std::string key;
-  std::string id = "";
-  std::vector<Node*> children;
+enum class Overflow {
+  Visible,
+  Hidden,
+  Scroll
+};
+
+
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ COLD NODE STATE       ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Only a handful of nodes carry callbacks, drag or editing state, so these
+// live in side blocks that are allocated on first non-default write.
+
+struct NodeEvents {
+  int onClickRef = -2;
+  int onMouseEnterRef = -2;
+  int onMouseLeaveRef = -2;
+  int onRightClickRef = -2;
+  int onScrollRef = -2;
+
+  int onTextInputRef = -2;
+  int onKeyDownRef = -2;
+  int onFocusRef = -2;
+  int onBlurRef = -2;
+};
+
+struct NodeDrag {
+  bool isDraggable = false;
+  bool isDragging = false;
+
+  float dragOffsetX = 0.0f;
+  float dragOffsetY = 0.0f;
+
+  int onDragStartRef = -2;
+  int onDragRef = -2;
+  int onDragEndRef = -2;
+};
+
+struct NodeTextEdit {
+  bool isFocusable = false;
+  bool isFocused = false;
+
+  // allowSelection enables text selection (enabled by default)
+  bool allowSelection = false;
+
+  // Cursor state for rendering
+  int cursorPosition = -1; // -1 means no cursor/unfocused
+  int lastCursorPosition = -1;
+  int selectionStart = -1;
+  int selectionEnd = -1;
+};
 
+struct NodeScrollbar {
+  float scrollbarOpacity = 0.0f;
+  float scrollbarTimer = 0.0f;
+  float lastReportedScrollY = -1.0f;
+};
+
+struct NodeMedia {
   std::string src;
   uint32_t textureId = 0;
-  bool autoScrollBottom = false;
+  ObjectFit objectFit = ObjectFit::Fill;
+
+  std::string bgImageSrc = "";
+  uint32_t bgTextureId = 0;
+  ObjectFit bgImageFit = ObjectFit::Cover;
 
+  // a skeleton was drawn; the node repaints once the texture arrives
+  bool awaitingTexture = false;
+  // atlas generation the cached draw used; see TextureRegistry::GetAtlasGeneration
+  uint32_t atlasGeneration = 0;
+};
+
+
+struct Node;
+namespace Layout {
+  void scheduleBoundary(Node* n);
+}
+
+// one remembered wrap of a node's text; see wrapNodeText
+struct TextWrapSlot {
+  Font* font = nullptr;
+  uint64_t textHash = 0;
+  float maxWidth = 0.0f;
+  WrapResultRef result;
+};
+
+// text content, resolved font and shaping results; only "text" nodes
+// allocate this
+struct NodeText {
   std::string text;
   std::vector<uint32_t> codepoints;
-  std::string objectFit = "fill";
+  uint64_t textHash = 0; // UI_HashCodepoints(codepoints)
   int fontId = 0;
   Font* font = nullptr;
   Color textColor = {0, 0, 0, 255};
 
   std::string fontFamily;
   int fontSize = 0;
-  FontStyle fontStyle = FontStyle::Normal;
-  FontWeight fontWeight = FontWeight::Normal;
-  TextDecoration textDecoration = TextDecoration::None;
+  // font inputs the current `font` was resolved from
+  int fontHandleId = 0;
+  int fontConfigVersion = -1;
 
   bool loadedVariantBold = false;
   bool loadedVariantItalic = false;
   bool loadedVariantThin = false;
 
-  TextAlign textAlign = TextAlign::Left;
-
   std::vector<TextLine> computedLines;
   float computedLineHeight = 0.0f;
 
-  float flexShrink = 0.0f;
+  // Yoga usually measures a text node at two widths (min-content probe and
+  // the final size), so two slots keep both warm across solves
+  TextWrapSlot wrapCache[2];
+  WrapResultRef appliedWrap; // the wrap computedLines was copied from
+  std::vector<GlyphRunRef> lineRuns; // one shaped run per computed line
+};
+
+// Nodes are carved out of ObjectPool<Node> slabs (see node_arena.h); `new`
+// and `delete` on a Node go through the pool. Fields read by every layout
+// and paint walk come first so a walk touches as few cache lines as possible.
+struct Node {
+  // --- tree + geometry ---
+  Node* parent = nullptr;
+  std::vector<Node*> children;
 
   float x = 0, y = 0;
   float w = 0, h = 0;
 
-  Length widthStyle;
-  Length heightStyle;
+  bool isLayoutDirty = true;
+  bool isPaintDirty = true;
+  bool isHovered = false;
 
-  bool overflowHidden = true;
-  bool overflowScroll = false;
+  // persistent Yoga mirror, owned by the layout module
+  struct YGNode* yogaNode = nullptr;
+  // stand-in for a relayout boundary inside its parent's Yoga tree
+  struct YGNode* yogaProxy = nullptr;
+  bool isStyleDirty = true;      // layout style changed since the last solve
+  bool isChildListDirty = true;  // children were inserted, moved or removed
 
   // cached offset for nodes position change
   float cachedOffsetX = 0.0f;
   float cachedOffsetY = 0.0f;
 
-  bool wordWrap = true;
+  float translateX = 0.0f;
+  float translateY = 0.0f;
 
   float scrollX = 0.0f;
   float scrollY = 0.0f;
@@ -177,76 +308,36 @@ struct Node {
   float contentW = 0.0f;
   float contentH = 0.0f;
 
-  // attributes for dragging
-  bool isDraggable = false;
-  bool isDragging = false;
-
-  float dragOffsetX = 0.0f;
-  float dragOffsetY = 0.0f;
-
-  int onDragStartRef = -2;
-  int onDragRef = -2;
-  int onDragEndRef = -2;
-
-  bool isFocusable = false;
-  bool isFocused = false;
-  int onTextInputRef = -2;
-  int onKeyDownRef = -2;
-  int onFocusRef = -2;
-  int onBlurRef = -2;
-
-  // allowSelection enables text selection (enabled by default)
-  bool allowSelection = false;
-
-  // Cursor state for rendering
-  int cursorPosition = -1; // -1 means no cursor/unfocused
-  int lastCursorPosition = -1;
-  int selectionStart = -1;
-  int selectionEnd = -1;
-
-  AutoScroll autoScroll = AutoScroll::None;
-  float lastContentH = 0.0f;
-
-  int spacing = 0;
-  float opacity = 1.0f;
-  float BGOpacity = 1.0f;
-  int margin = 0;
-  int marginTop = 0, marginBottom = 0, marginLeft = 0, marginRight = 0;
-  int padding = 0;
-  int paddingTop = 0, paddingBottom = 0, paddingLeft = 0, paddingRight = 0;
-
-  int zIndex = 0;
+  // --- layout style ---
+  Length widthStyle;
+  Length heightStyle;
 
   float minWidth = 0, maxWidth = 99999.0f;
   float minHeight = 0, maxHeight = 99999.0f;
 
   float flexGrow = 0.0f;
+  float flexShrink = 0.0f;
   Align alignItems = Align::Start;
   Justify justifyContent = Justify::Start;
+  FlexWrap flexWrap = FlexWrap::NoWrap;
+  FlexDirection flexDirection = FlexDirection::Column;
+  PositionType position = PositionType::Relative;
 
-  int onClickRef = -2;
-  int onMouseEnterRef = -2;
-  int onMouseLeaveRef = -2;
-  int onRightClickRef = -2;
-  bool isHovered = false;
-
+  int spacing = 0;
+  int margin = 0;
+  int marginTop = 0, marginBottom = 0, marginLeft = 0, marginRight = 0;
+  int padding = 0;
+  int paddingTop = 0, paddingBottom = 0, paddingLeft = 0, paddingRight = 0;
 
   bool hasLeft = false; float leftVal = 0.0f;
   bool hasTop = false; float topVal = 0.0f;
   bool hasRight = false; float rightVal = 0.0f;
   bool hasBottom = false; float bottomVal = 0.0f;
 
-  FlexWrap flexWrap = FlexWrap::NoWrap;
-  FlexDirection flexDirection = FlexDirection::Column;
-
-  float scrollbarOpacity = 0.0f;
-  float scrollbarTimer = 0.0f;
-
-  int onScrollRef = -2;
-  float lastReportedScrollY = -1.0f;
-
-
-  ScrollbarMetrics getScrollbarMetrics();
+  // --- paint style ---
+  int zIndex = 0;
+  float opacity = 1.0f;
+  float BGOpacity = 1.0f;
 
   SDL_Color color = {255, 255, 255, 255};
   bool hasBackground = false;
@@ -256,14 +347,70 @@ struct Node {
   float borderWidth = 0.0f;
   SDL_Color borderColor = {0,0,0,0};
 
-  std::string bgImageSrc = "";
-  uint32_t bgTextureId = 0;
-  std::string bgImageFit = "cover";
+  bool overflowHidden = true;
+  bool overflowScroll = false;
 
-  Node* parent = nullptr;
-  bool isLayoutDirty = true;
-  bool isPaintDirty = true;
+  AutoScroll autoScroll = AutoScroll::None;
+  bool autoScrollBottom = false;
+  float lastContentH = 0.0f;
 
+  // --- identity ---
+  std::string type;
+  std::string key;
+  std::string id = "";
+
+  // --- text style ---
+  FontStyle fontStyle = FontStyle::Normal;
+  FontWeight fontWeight = FontWeight::Normal;
+  TextDecoration textDecoration = TextDecoration::None;
+  TextAlign textAlign = TextAlign::Left;
+  bool wordWrap = true;
+
+  // component boundary: the node was produced by a { type = "component" }
+  // table and can re-run its render function on its own
+  int renderRef = -2;
+  int propsRef = -2;
+  bool isComponent() const { return renderRef != -2; }
+
+  // registry ref to a copy of the table's `memo` deps from the last
+  // build/patch, compared entry by entry with lua_rawequal
+  int memoRef = -2;
+
+  // --- cold side blocks ---
+  ColdBlock<NodeEvents> events;
+  ColdBlock<NodeDrag> drag;
+  ColdBlock<NodeTextEdit> textEdit;
+  ColdBlock<NodeScrollbar> scrollbar;
+  ColdBlock<NodeMedia> media;
+  ColdBlock<NodeText> textState;
+
+  // Retained display list: only this node's own commands, split around its
+  // children. generateRenderCommands flattens the tree by appending each
+  // node's lists once, so nothing is duplicated per ancestor.
+  RenderCommandList displayOwn;   // background, images, clip push, text
+  RenderCommandList displayAfter; // scrollbars, clip pop
+  bool hasCachedCommands = false; // display lists match the node's state
+
+  // everything the subtree drew last time it was flattened, relative to
+  // cachedOffsetX/Y; lets a clean subtree outside the clip be skipped
+  Rect inkBounds = {0, 0, 0, 0};
+  bool hasInkBounds = false;
+  // the subtree was on screen at inkBounds when last flattened; culling it
+  // has to damage that spot
+  bool inkOnScreen = false;
+
+  static void* operator new(size_t) {
+    return ObjectPool<Node>::instance().allocate();
+  }
+
+  static void operator delete(void* p) {
+    ObjectPool<Node>::instance().deallocate(p);
+  }
+
+  ScrollbarMetrics getScrollbarMetrics();
+
+  // isPaintDirty on an ancestor only means "something below repaints";
+  // its own display lists stay valid unless hasCachedCommands is cleared
   void markTreePaintDirty() {
     isPaintDirty = true;
     if (parent) {
@@ -271,9 +418,22 @@ struct Node {
     }
   }
 
+  // A node with a fixed pixel width and height cannot change size because of
+  // its content, so its subtree is laid out on its own and changes inside
+  // stop here instead of re-solving from the root.
+  bool isLayoutBoundary() const {
+    return parent && widthStyle.type == PIXEL && widthStyle.value > 0 &&
+      heightStyle.type == PIXEL && heightStyle.value > 0;
+  }
+
   void markTreeLayoutDirty() {
     isLayoutDirty = true;
     isPaintDirty = true;
+    if (yogaProxy) {
+      Layout::scheduleBoundary(this);
+      if (parent) parent->markTreePaintDirty();
+      return;
+    }
     if (parent) {
       parent->markTreeLayoutDirty();
     }
@@ -287,26 +447,22 @@ struct Node {
     }
   }
 
-  float translateX = 0.0f;
-  float translateY = 0.0f;
-
   void makePaintDirty() {
     g_damageTracker.add(
-        this->x + this->cachedOffsetX + this->dragOffsetX + this->translateX,
-        this->y + this->cachedOffsetY + this->dragOffsetY + this->translateY,
+        this->x + this->cachedOffsetX + this->drag->dragOffsetX,
+        this->y + this->cachedOffsetY + this->drag->dragOffsetY,
         this->w, this->h);
+    // text and children may draw past the box
+    if (hasInkBounds) {
+      g_damageTracker.add(inkBounds.x + cachedOffsetX, inkBounds.y + cachedOffsetY, inkBounds.w, inkBounds.h);
+    }
     isPaintDirty = true;
+    hasCachedCommands = false;
     if (parent) {
       parent->markTreePaintDirty();
     }
   }
 
-  PositionType position = PositionType::Relative;
-
-  // Cache Storage
-  RenderCommandList cachedCommands;
-  bool hasCachedCommands = false;
-
   // subtree invalidator
   void invalidateSubtreePaint() {
     isPaintDirty = true;
@@ -330,19 +486,24 @@ TextLayoutResult calculateTextLayout(const std::string& text, Font* font, float
 
 
 Node* buildNode(lua_State* L, int idx);
-void generateRenderCommands(Node* n, RenderCommandList& list, float parentOffsetX = 0.0f, float parentOffsetY = 0.0f);
+// `viewport` is the visible part of the window; subtrees and commands
+// outside it (or outside an enclosing clip) are left out of the list
+void generateRenderCommands(Node* n, RenderCommandList& list, const Rect& viewport, float parentOffsetX = 0.0f, float parentOffsetY = 0.0f);
 void freeTree(lua_State* L, Node* n);
 void resolveStyles(Node* n, int parentW, int parentH);
 void reconcile(lua_State* L, Node* current, int idx);
 
-Length getLength(lua_State* L, const char* key);
-Align parseAlign(std::string s);
-Justify parseJustify(std::string s);
-TextAlign parseTextAlign(std::string s);
+Align parseAlign(std::string_view s);
+Justify parseJustify(std::string_view s);
+TextAlign parseTextAlign(std::string_view s);
+PositionType parsePosition(std::string_view s);
+FlexDirection parseFlexDirection(std::string_view s);
+ObjectFit parseObjectFit(std::string_view s);
+Overflow parseOverflow(std::string_view s);
+AutoScroll parseAutoScroll(std::string_view s);
 
 void UI_RegisterLuaFunctions(lua_State* L);
 void UI_SetRenderCommandList(RenderCommandList* list);
-void updateTextLayout(Node* root);
 
 void UI_FireScrollEvents(lua_State* L, Node* n);
 
@@ -350,10 +511,10 @@ extern RenderCommandList* activeCommandList;
 
 void UI_InitTypes(lua_State *L);
 
-FontStyle parseFontStyle(const std::string& s);
-FontWeight parseFontWeight(const std::string& s);
-TextDecoration parseTextDecoration(const std::string& s);
-FlexWrap parseFlexWrap(std::string s);
+FontStyle parseFontStyle(std::string_view s);
+FontWeight parseFontWeight(std::string_view s);
+TextDecoration parseTextDecoration(std::string_view s);
+FlexWrap parseFlexWrap(std::string_view s);
 void parseEvents(lua_State* L, Node* n, int idx);
 
 std::string getVariantKey(FontWeight w, FontStyle s);
@@ -363,4 +524,7 @@ void UI_UpdateSmoothScrolling(Node* n, float dt);
 static void appendCP(std::string& s, uint32_t cp);
 
 void computeTextLayout(Node* n);
+WrapResultRef wrapNodeText(Node* n, float maxWidth);
+// pre-layout: fills the wrap caches of these text nodes in parallel
+void prewrapText(const std::vector<Node*>& nodes);
 #endif
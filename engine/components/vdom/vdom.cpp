@@ -1,81 +1,21 @@
 #include "vdom.h"
 #include <lauxlib.h>
 #include <lua.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
+#include "../state/state.h"
+#include "../ui/style.h"
 #include "../text/font.h"
 #include "../../configLogic/font/font_registry.h"
 #include "../../configLogic/images/texture_registry.h"
 
 namespace VDOM {
 
-  PositionType parsePosition(std::string s) {
-    if (s == "absolute") return PositionType::Absolute;
-    return PositionType::Relative;
-  }
-
-  FlexDirection parseFlexDirection(std::string s) {
-    if (s == "row") return FlexDirection::Row;
-    if (s == "row-reverse") return FlexDirection::RowReverse;
-    if (s == "column-reverse") return FlexDirection::ColumnReverse;
-    return FlexDirection::Column;
-  }
-
-  bool operator!=(const Length& a, const Length& b) {
-    return a.value != b.value || a.type != b.type || a.isSet != b.isSet; 
-  }
-
-  bool operator!=(const SDL_Color& a, const SDL_Color b) {
-    return a.a != b.a || a.r != b.r || a.g != b.g || a.b != b.b;
-  }
-
-  bool operator!=(const Color& a, const Color& b) {
-    return a.a != b.a || a.r != b.r || a.g != b.g || a.b != b.b;
-  }
-
-  template <typename T> 
-    void update(T& field, const T& newVal, bool& dirtyFlag) {
-      if (field != newVal) {
-        field = newVal;
-        dirtyFlag = true;
-      }
-    }
-
-  int getIntProp(lua_State* L, const char* key, int defaultVal) {
-    // assumes stlye in already on top of lua stack
-    int val = defaultVal;
-    lua_getfield(L, -1, key);
-    if (lua_isnumber(L, -1)) {
-      val = (int)lua_tonumber(L, -1);
-    }
-    lua_pop(L, 1);
-    return val;
-  }
-
-  float getFloatProp(lua_State* L, const char* key, float defaultVal) {
-    // assumes stlye in already on top of lua stack
-    float val = defaultVal;
-    lua_getfield(L, -1, key);
-    if (lua_isnumber(L, -1)) {
-      val = (float)lua_tonumber(L, -1);
-    }
-    lua_pop(L, 1);
-    return val;
-  }
-
-
-  std::string getStringProp(lua_State* L, const char* key, std::string defaultVal) {
-    // assumes stlye in already on top of lua stack
-    std::string val = defaultVal;
-    lua_getfield(L, -1, key);
-    if (lua_isstring(L, -1)) {
-      val = lua_tostring(L, -1);
-    }
-    lua_pop(L, 1);
-    return val;
-  }
-
   void updateCallback(lua_State* L, int tableIdx, const char* key, int& ref) {
     lua_getfield(L, tableIdx, key);
     if (lua_isfunction(L, -1)) {
@@ -93,6 +33,20 @@ namespace VDOM {
   }
 
 
+  // same, for a callback stored in a node side block: a node without the
+  // block and without the callback stays without the block
+  template <typename T>
+  static void updateCallback(lua_State* L, int tableIdx, const char* key, ColdBlock<T>& block, int T::*ref) {
+    if (!block.has()) {
+      lua_getfield(L, tableIdx, key);
+      bool isFunction = lua_isfunction(L, -1);
+      lua_pop(L, 1);
+      if (!isFunction) return;
+    }
+    updateCallback(L, tableIdx, key, block.edit().*ref);
+  }
+
+
 // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
 // ╏ NODE PATCHER ╏
 // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
@@ -104,11 +58,14 @@ namespace VDOM {
     lua_getfield(L, idx, "text");
     if (lua_isstring(L, -1)) {
       std::string newText = lua_tostring(L, -1);
-      if (n->text != newText) {
-        n->text = newText;
+      if (n->textState->text != newText) {
+        NodeText& text = n->textState.edit();
+        text.text = newText;
+        n->isStyleDirty = true;
         n->makeLayoutDirty();
         n->hasCachedCommands = false;
-        n->codepoints = Font::DecodeUTF8(newText);
+        text.codepoints = Font::DecodeUTF8(newText);
+        text.textHash = UI_HashCodepoints(text.codepoints);
 
       }
     }
@@ -127,622 +84,660 @@ namespace VDOM {
     if (lua_isstring(L, -1)) n->key = lua_tostring(L, -1);
     lua_pop(L, 1);
 
+    Style::StyleSheet sheet;
     lua_getfield(L, idx, "style");
-    if (!lua_istable(L, -1)) {
-      lua_pop(L, 1);
-      lua_newtable(L);
+    if (lua_istable(L, -1)) {
+      Style::parse(L, lua_gettop(L), sheet);
     }
+    lua_pop(L, 1);
+    Style::apply(n, sheet, layoutChanged, paintChanged);
 
-    update(n->zIndex, getIntProp(L, "zIndex", 0), paintChanged);
-
-    if (n->type == "text") {
-
-      std::string fStyleStr = getStringProp(L, "fontStyle", "normal");
-      update(n->fontStyle, parseFontStyle(fStyleStr), layoutChanged);
-
-      std::string fWeightStr = getStringProp(L, "fontWeight", "normal");
-      update(n->fontWeight, parseFontWeight(fWeightStr), layoutChanged);
-
-      std::string fDecorStr = getStringProp(L, "textDecoration", "none");
-      update(n->textDecoration, parseTextDecoration(fDecorStr), paintChanged);
-
-      auto getFlags = [](Node* n) {
-        int flags = FONT_STYLE_NORMAL;
-        if (n->fontWeight == FontWeight::VeryBold) flags |= FONT_STYLE_VERY_BOLD;
-        else if (n->fontWeight == FontWeight::Bold) flags |= FONT_STYLE_BOLD;
-        else if (n->fontWeight == FontWeight::SemiBold) flags |= FONT_STYLE_SEMI_BOLD;
-        else if (n->fontWeight == FontWeight::Thin) flags |= FONT_STYLE_THIN;
-        if (n->fontStyle == FontStyle::Italics) flags |= FONT_STYLE_ITALIC;
-
-        // Don't apply fake styles if real variants were loaded
-        if (n->loadedVariantBold) flags &= ~(FONT_STYLE_BOLD | FONT_STYLE_SEMI_BOLD | FONT_STYLE_VERY_BOLD);
-        if (n->loadedVariantItalic) flags &= ~FONT_STYLE_ITALIC;
-        if (n->loadedVariantThin) flags &= ~FONT_STYLE_THIN;
-        return flags;
-      };
-
-      lua_getfield(L, -1, "font");
-      if (lua_isuserdata(L, -1)) {
-        FontHandle* h = (FontHandle*)luaL_checkudata(L, -1, "FontMeta");
-        if (h) {
-          Font* fontPtr = UI_GetFontById(h->id);
-          // If new font is valid and different, update
-          if (fontPtr && n->font != fontPtr) {
-            n->font = fontPtr;
-            n->fontId = h->id;
-            n->computedLines.clear();
-            layoutChanged = true;
-          }
-        }
-      }
-      lua_pop(L, 1);
-
-      lua_getfield(L, -1, "fontFamily");
+    if (n->type == "image") {
+      lua_getfield(L, idx, "src");
       if (lua_isstring(L, -1)) {
-        std::string alias = lua_tostring(L, -1);
-        const FontConfig* config = GetFontConfig(alias);
-
-        if (config) {
-          int targetSize = config->size;
-
-          // Check if fontSize overrides the config size locally
-          lua_getfield(L, -2, "fontSize");
-          if (lua_isnumber(L, -1)) {
-            targetSize = (int)lua_tonumber(L, -1);
-          }
-          lua_pop(L, 1);
-
-          // Load/Get the font from the cache
-          auto [id, fontPtr] = UI_LoadFont(config->path, targetSize, getFlags(n));
-
-          // If the resolved font is different, update the node
-          if (n->font != fontPtr) {
-            n->font = fontPtr;
-            n->fontId = id;
-            n->computedLines.clear();
-            layoutChanged = true;
-          }
-        } else {
-          if (n->font != nullptr) {
-            n->font = nullptr;
-            n->fontId = 0;
-            n->computedLines.clear();
-            layoutChanged = true;
-          }
+        std::string newSrc = lua_tostring(L, -1);
+        if (n->media->src != newSrc) {
+          NodeMedia& media = n->media.edit();
+          TextureRegistry::ReleaseTexture(media.textureId);
+          media.src = newSrc;
+          media.textureId = TextureRegistry::GetTexture(media.src);
+          paintChanged = true;
         }
       }
       lua_pop(L, 1);
+    }
 
-      bool explicitFont = (n->font != nullptr && n->fontId != 0);
-
-      if (!explicitFont) {
-        const FontConfig* config = GetFontConfig("default");
-        if (config) {
-          int targetSize = config->size;
-          lua_getfield(L, -1, "fontSize");
-          if (lua_isnumber(L, -1)) targetSize = (int)lua_tonumber(L, -1);
-          lua_pop(L, 1);
-
-          auto [id, fontPtr] = UI_LoadFont(config->path, targetSize, getFlags(n));
-          if (n->font != fontPtr) {
-            n->font = fontPtr;
-            n->fontId = id;
-            n->computedLines.clear();
-            layoutChanged = true;
-          }
-        } else {
-          if (n->font != nullptr) {
-            n->font = nullptr;
-            n->fontId = 0;
-            layoutChanged = true;
-          }
-        }
-      }
-
-      lua_getfield(L, -1, "fontSize");
-      if (lua_isnumber(L, -1)) {
-        int newSize = (int)lua_tointeger(L, -1);
+    lua_getfield(L, idx, "focusable");
+    n->textEdit.set(&NodeTextEdit::isFocusable, !lua_isnil(L, -1) && lua_toboolean(L, -1));
+    lua_pop(L, 1);
 
-        // If the size changed, we need to request a new font handle from the cache
-        if (n->font && newSize > 0 && (int)n->font->GetSize() != newSize) {
-          auto [id, fontPtr] = UI_LoadFont(n->font->GetPath(), newSize, getFlags(n));
+    lua_getfield(L, idx, "draggable");
+    n->drag.set(&NodeDrag::isDraggable, !lua_isnil(L, -1) && lua_toboolean(L, -1));
+    lua_pop(L, 1);
 
-          if (n->font != fontPtr) {
-            n->font = fontPtr;
-            n->fontId = id;
-            n->computedLines.clear(); // Text needs re-measuring
-            layoutChanged = true;
-          }
-        }
-      }
-      lua_pop(L, 1);
 
-      const FontConfig* conf = GetFontConfig(n->fontFamily);
-      if (conf) {
-        std::string vkey = getVariantKey(n->fontWeight, n->fontStyle);
-        int targetSize = (n->fontSize > 0) ? n->fontSize : conf->size;
-        std::string targetPath = conf->path;
-
-        n->loadedVariantBold = false;
-        n->loadedVariantItalic = false;
-
-        if (vkey.empty() && conf->variants.count(vkey)) {
-          const VariantConfig& v = conf->variants.at(vkey);
-          targetPath = v.path;
-
-          if (vkey == "bold-italics") {
-            n->loadedVariantBold = true;
-            n->loadedVariantItalic = true;
-          } 
-          else if (vkey == "bold" || vkey == "semi-bold") {
-            n->loadedVariantBold = true;
-          } 
-          else if (vkey == "italics") {
-            n->loadedVariantItalic = true;
-          }
-          else if (vkey == "thin") {
-            n->loadedVariantThin = true;
-          }
-
-          if (n->fontSize <= 0 && v.size > 0) targetSize = v.size;
-        }
+    // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+    // ╏ text selection flag ╏
+    // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+    lua_getfield(L, idx, "allowSelection");
+    if (!lua_isnil(L, -1)) {
+      n->textEdit.set(&NodeTextEdit::allowSelection, (bool)lua_toboolean(L, -1));
+    }
+    lua_pop(L, 1);
 
-        auto [id, fontPtr] = UI_LoadFont(targetPath, targetSize, getFlags(n));
-        if (n->font != fontPtr) {
-          n->font = fontPtr;
-          n->fontId = id;
-          n->computedLines.clear();
-          layoutChanged = true;
-        }
-      }
+    if (n->textEdit->allowSelection && n->type == "text") {
+      n->textEdit.edit().isFocusable = true;
+    }
 
-      lua_getfield(L, -1, "color");
-      if (!lua_isnil(L, -1)) {
-        Color newTextColor = n->textColor;
-
-        if (lua_isstring(L, -1)) {
-          SDL_Color sc = parseHexColor(lua_tostring(L, -1));
-          newTextColor = {sc.r, sc.g, sc.b, sc.a};
-        } 
-        else if (lua_istable(L, -1)) {
-          lua_rawgeti(L, -1, 1); int r = luaL_optinteger(L, -1, 0); lua_pop(L, 1);
-          lua_rawgeti(L, -1, 2); int g = luaL_optinteger(L, -1, 0); lua_pop(L, 1);
-          lua_rawgeti(L, -1, 3); int b = luaL_optinteger(L, -1, 0); lua_pop(L, 1);
-          lua_rawgeti(L, -1, 4); int a = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-          newTextColor = {(Uint8)r, (Uint8)g, (Uint8)b, (Uint8)a};
-        }
 
-        if (n->textColor != newTextColor) {
-          n->textColor = newTextColor;
-          paintChanged = true;
-        }
-      } else {
-        Color defaultTextColor = {0, 0, 0, 255}; 
-        if (n->textColor != defaultTextColor) {
-          n->textColor = defaultTextColor;
-          paintChanged = true;
-        }
+    lua_getfield(L, idx, "isFocused");
+    if (!lua_isnil(L, -1)) {
+      bool newFocused = lua_toboolean(L, -1);
+      if (n->textEdit->isFocused != newFocused) {
+        n->textEdit.edit().isFocused = newFocused;
+        paintChanged = true;
       }
-      lua_pop(L, 1);
     }
+    lua_pop(L, 1);
 
-    if (n->type == "image") {
-      lua_getfield(L, idx, "src");
-      if (lua_isstring(L, -1)) {
-        std::string newSrc = lua_tostring(L, -1);
-        if (n->src != newSrc) {
-          TextureRegistry::ReleaseTexture(n->textureId);
-          n->src = newSrc;
-          n->textureId = TextureRegistry::GetTexture(n->src);
-          paintChanged = true;
-        }
+    lua_getfield(L, idx, "cursorPosition");
+    if (lua_isnumber(L, -1)) {
+      int newCursorPos = lua_tointeger(L, -1);
+      if (n->textEdit->cursorPosition != newCursorPos) {
+        n->textEdit.edit().cursorPosition = newCursorPos;
+        paintChanged = true;
       }
-      lua_pop(L, 1);
     }
+    lua_pop(L, 1);
 
-    float newOpacity = getFloatProp(L, "opacity", 1.0f);
-    if (n->opacity != newOpacity) {
-      n->opacity = newOpacity;
-      n->invalidateSubtreePaint();
-      paintChanged = true;
+    lua_getfield(L, idx, "selectionStart");
+    if (lua_isnumber(L, -1)) {
+      int newSelectionStart = lua_tointeger(L, -1);
+      if (n->textEdit->selectionStart != newSelectionStart) {
+        n->textEdit.edit().selectionStart = newSelectionStart;
+        paintChanged = true;
+      }
     }
+    lua_pop(L, 1);
 
-    float newBgOpacity = getFloatProp(L, "BGOpacity", 1.0f);
-    if (n->BGOpacity != newBgOpacity) {
-      n->BGOpacity = newBgOpacity;
-      paintChanged = true; 
+    lua_getfield(L, idx, "selectionEnd");
+    if (lua_isnumber(L, -1)) {
+      int newSelectionEnd = lua_tointeger(L, -1);
+      if (n->textEdit->selectionEnd != newSelectionEnd) {
+        n->textEdit.edit().selectionEnd = newSelectionEnd;
+        paintChanged = true;
+      }
     }
+    lua_pop(L, 1);
 
-    update(n->borderRadius, getFloatProp(L, "borderRadius", 0.0f), paintChanged);
-    update(n->borderWidth, getFloatProp(L, "borderWidth", 0.0f), paintChanged);
+    updateCallback(L, idx, "onTextInput", n->events, &NodeEvents::onTextInputRef);
+    updateCallback(L, idx, "onKeyDown", n->events, &NodeEvents::onKeyDownRef);
+    updateCallback(L, idx, "onFocus", n->events, &NodeEvents::onFocusRef);
+    updateCallback(L, idx, "onBlur", n->events, &NodeEvents::onBlurRef);
 
-    lua_getfield(L, -1, "borderColor");
-    if (lua_isstring(L, -1)) {
-      SDL_Color newCol = parseHexColor(lua_tostring(L, -1));
-      update(n->borderColor, newCol, paintChanged);
-    } else if (lua_istable(L, -1)) {
-      lua_rawgeti(L, -1, 1); int r = luaL_optinteger(L, -1, 0); lua_pop(L, 1);
-      lua_rawgeti(L, -1, 2); int g = luaL_optinteger(L, -1, 0); lua_pop(L, 1);
-      lua_rawgeti(L, -1, 3); int b = luaL_optinteger(L, -1, 0); lua_pop(L, 1);
-      lua_rawgeti(L, -1, 4); int a = luaL_optinteger(L, -1, 255); lua_pop(L, 1);
-      SDL_Color newCol = {(Uint8)r, (Uint8)g, (Uint8)b, (Uint8)a};
-      update(n->borderColor, newCol, paintChanged);
-    } else if (lua_isnil(L, -1)) {
-      SDL_Color newCol = {0,0,0,0};
-      update(n->borderColor, newCol, paintChanged);
-    }
-    lua_pop(L, 1);
 
-    // comparing % w and h 
-    update(n->widthStyle, getLength(L, "w"), layoutChanged);
-    update(n->heightStyle, getLength(L, "h"), layoutChanged);
+    updateCallback(L, idx, "onDragStart", n->drag, &NodeDrag::onDragStartRef);
+    updateCallback(L, idx, "onDrag", n->drag, &NodeDrag::onDragRef);
+    updateCallback(L, idx, "onDragEnd", n->drag, &NodeDrag::onDragEndRef);
 
-    auto updatePos = [&](const char* k, bool& has, float& v) {
-      lua_getfield(L, -1, k);
-      bool newHas = !lua_isnil(L, -1);
-      float newVal = newHas ? (float)lua_tonumber(L, -1) : 0.0f;
-      lua_pop(L, 1);
+    updateCallback(L, idx, "onClick", n->events, &NodeEvents::onClickRef);
+    updateCallback(L, idx, "onMouseEnter", n->events, &NodeEvents::onMouseEnterRef);
+    updateCallback(L, idx, "onMouseLeave", n->events, &NodeEvents::onMouseLeaveRef);
+    updateCallback(L, idx, "onRightClick", n->events, &NodeEvents::onRightClickRef);
 
-      if (has != newHas || (newHas && v != newVal)) {
-        has = newHas;
-        v = newVal;
-        layoutChanged = true;
-      }
-    };
+    updateCallback(L, idx, "onScroll", n->events, &NodeEvents::onScrollRef);
 
-    updatePos("left", n->hasLeft, n->leftVal);
-    updatePos("top", n->hasTop, n->topVal);
-    updatePos("right", n->hasRight, n->rightVal);
-    updatePos("bottom", n->hasBottom, n->bottomVal);
-
-
-    // min max height width
-    update(n->minWidth, getFloatProp(L, "minWidth", 0.0f), layoutChanged);
-    update(n->maxWidth,  getFloatProp(L, "maxWidth", 99999.0f),  layoutChanged);
-    update(n->minHeight, getFloatProp(L, "minHeight", 0.0f),     layoutChanged);
-    update(n->maxHeight, getFloatProp(L, "maxHeight", 99999.0f), layoutChanged);
-
-    // flexbox - alignItems - justifyContent
-    update(n->flexGrow, getFloatProp(L, "flexGrow", 0.0f), layoutChanged);
-    update(n->flexShrink, getFloatProp(L, "flexShrink", 0.0f), layoutChanged);
-    update(n->flexDirection, parseFlexDirection(getStringProp(L, "flexDirection", "column")), layoutChanged);
-    update(n->alignItems, parseAlign(getStringProp(L, "alignItems", "start")), layoutChanged);
-    update(n->textAlign, parseTextAlign(getStringProp(L, "textAlign", "left")), layoutChanged);
-
-    update(n->flexWrap, ::parseFlexWrap(getStringProp(L, "flexWrap", "nowrap")), layoutChanged);
-
-    update(n->justifyContent, parseJustify(getStringProp(L, "justifyContent", "start")), layoutChanged);
-    update(n->position, parsePosition(getStringProp(L, "position", "relative")), layoutChanged);
-    // we have support for both gap and spacing
-    int gapVal = getIntProp(L, "gap", getIntProp(L, "spacing", 0));
-    update(n->spacing, gapVal, layoutChanged);
-
-    // Box Model (margin / padding)
-    auto applyBoxModel = [&](
-        const char* longAll, const char* shortAll,
-        const char* shortX, const char* shortY,
-        const char* longT, const char* shortT,
-        const char* longB, const char* shortB,
-        const char* longL, const char* shortL,
-        const char* longR, const char* shortR,
-        int& vT, int& vB, int& vL, int& vR) {
-
-      // 1. Resolve base fallbacks
-      int baseVal = getIntProp(L, shortAll, getIntProp(L, longAll, 0));
-      int valX = getIntProp(L, shortX, baseVal);
-      int valY = getIntProp(L, shortY, baseVal);
-
-      // 2. Resolve specific sides and apply updates
-      update(vT, getIntProp(L, shortT, getIntProp(L, longT, valY)), layoutChanged);
-      update(vB, getIntProp(L, shortB, getIntProp(L, longB, valY)), layoutChanged);
-      update(vL, getIntProp(L, shortL, getIntProp(L, longL, valX)), layoutChanged);
-      update(vR, getIntProp(L, shortR, getIntProp(L, longR, valX)), layoutChanged);
-    };
+    if (layoutChanged) {
+      n->isStyleDirty = true;
+      n->makeLayoutDirty();
+    } else if (paintChanged) {
+      n->makePaintDirty();
+    }
 
-    // Apply Padding
-    applyBoxModel(
-        "padding", "p", "px", "py", 
-        "paddingTop", "pt", "paddingBottom", "pb", 
-        "paddingLeft", "pl", "paddingRight", "pr", 
-        n->paddingTop, n->paddingBottom, n->paddingLeft, n->paddingRight
-        );
+  }
 
-    // Apply Margin
-    applyBoxModel(
-        "margin", "m", "mx", "my", 
-        "marginTop", "mt", "marginBottom", "mb", 
-        "marginLeft", "ml", "marginRight", "mr", 
-        n->marginTop, n->marginBottom, n->marginLeft, n->marginRight
-        );
 
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ MEMO SNAPSHOTS ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
 
-    std::string newFit = getStringProp(L, "fit", "fill");
-    if (n->objectFit != newFit) {
-      n->objectFit = newFit;
-      paintChanged = true;
+  // `memo` is either a single value or an array of dependencies. Pushes it as
+  // an array (a single value becomes a one-element one) or returns false
+  // when the table has no memo field at all.
+  static bool pushMemoDeps(lua_State* L, int idx) {
+    lua_getfield(L, idx, "memo");
+    if (lua_isnil(L, -1)) {
+      lua_pop(L, 1);
+      return false;
     }
+    if (!lua_istable(L, -1)) {
+      lua_createtable(L, 1, 0);
+      lua_insert(L, -2);
+      lua_rawseti(L, -2, 1);
+    }
+    return true;
+  }
 
-    std::string overflow = getStringProp(L, "overflow", "visible");
-    bool newOverflowHidden = (overflow != "visible");
-    bool newOverflowScroll = (overflow == "scroll" || overflow == "auto");
+  // copies the deps on top of the stack into a fresh array held by `ref` and
+  // pops them; the ref keeps tables and functions alive, so comparing them by
+  // identity later cannot hit a reused address
+  static void storeMemo(lua_State* L, int& ref) {
+    int depsIdx = lua_gettop(L);
+    lua_Integer count = (lua_Integer)lua_rawlen(L, depsIdx);
+    lua_createtable(L, (int)count, 0);
+    for (lua_Integer i = 1; i <= count; i++) {
+      lua_rawgeti(L, depsIdx, i);
+      lua_rawseti(L, -2, i);
+    }
+    if (ref != -2) luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_pop(L, 1);
+  }
 
-    if (n->overflowHidden != newOverflowHidden || n->overflowScroll != newOverflowScroll) {
-      n->overflowHidden = newOverflowHidden;
-      n->overflowScroll = newOverflowScroll;
-      n->makePaintDirty();
+  void readMemo(lua_State* L, int idx, int& ref) {
+    if (!pushMemoDeps(L, idx)) {
+      if (ref != -2) luaL_unref(L, LUA_REGISTRYINDEX, ref);
+      ref = -2;
+      return;
     }
+    storeMemo(L, ref);
+  }
 
-    std::string autoScrollStr = getStringProp(L, "autoScroll", "none");
-    AutoScroll newAutoScroll = AutoScroll::None;
+  // compares the deps entry by entry against the snapshot from the last pass,
+  // keeps the snapshot current and reports whether the subtree can be skipped
+  static bool memoUnchanged(lua_State* L, int idx, Node* n) {
+    if (n->memoRef == -2) {
+      readMemo(L, idx, n->memoRef);
+      return false;
+    }
+    if (!pushMemoDeps(L, idx)) {
+      luaL_unref(L, LUA_REGISTRYINDEX, n->memoRef);
+      n->memoRef = -2;
+      return false;
+    }
 
-    if (autoScrollStr == "bottom") newAutoScroll = AutoScroll::Bottom;
-    else if (autoScrollStr == "top") newAutoScroll = AutoScroll::Top;
+    int depsIdx = lua_gettop(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, n->memoRef);
+    int prevIdx = lua_gettop(L);
 
-    if (n->autoScroll != newAutoScroll) {
-      n->autoScroll = newAutoScroll;
+    size_t count = lua_rawlen(L, depsIdx);
+    bool unchanged = count == lua_rawlen(L, prevIdx);
+    for (size_t i = 1; unchanged && i <= count; i++) {
+      lua_rawgeti(L, depsIdx, (lua_Integer)i);
+      lua_rawgeti(L, prevIdx, (lua_Integer)i);
+      unchanged = lua_rawequal(L, -1, -2);
+      lua_pop(L, 2);
     }
+    lua_pop(L, 1);
 
-    lua_getfield(L, -1, "wordWrap");
-    if (!lua_isnil(L, -1)) {
-      bool newWordWrap = lua_toboolean(L, -1);
-      if (n->wordWrap != newWordWrap) {
-        n->wordWrap = newWordWrap;
-        layoutChanged = true;
-      }
+    if (unchanged) {
+      lua_pop(L, 1);
+    } else {
+      storeMemo(L, n->memoRef);
     }
-    lua_pop(L, 1);
+    return unchanged;
+  }
 
-    lua_getfield(L, -1, "BGColor");
-    if (lua_isstring(L, -1)) {
-      const char* hex = lua_tostring(L, -1);
-      SDL_Color newCol = parseHexColor(hex);
-      update(n->color, newCol, paintChanged);
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ COMPONENTS ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍┛
 
-      if (!n->hasBackground) {
-        n->hasBackground = true;
-        paintChanged = true;
-      }
-    } else if (lua_isnil(L, -1)) {
-      if (n->hasBackground) {
-        n->hasBackground = false;
-        paintChanged = true;
-      }
-    }
+  bool isComponentTable(lua_State* L, int idx) {
+    lua_getfield(L, idx, "type");
+    bool result = lua_isstring(L, -1) && std::strcmp(lua_tostring(L, -1), "component") == 0;
     lua_pop(L, 1);
+    return result;
+  }
 
+  // same as updateCallback, but keeps any non-nil value (props are tables)
+  static void updateValueRef(lua_State* L, int tableIdx, const char* key, int& ref) {
+    if (ref != -2) {
+      luaL_unref(L, LUA_REGISTRYINDEX, ref);
+      ref = -2;
+    }
+    lua_getfield(L, tableIdx, key);
+    if (!lua_isnil(L, -1)) {
+      ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    } else {
+      lua_pop(L, 1);
+    }
+  }
 
-    lua_getfield(L, -1, "BGImage");
-    if (lua_isstring(L, -1)) {
-      std::string newSrc = lua_tostring(L, -1);
-      if (n->bgImageSrc != newSrc) {
-        if (n->bgTextureId != 0) TextureRegistry::ReleaseTexture(n->bgTextureId);
-        n->bgImageSrc = newSrc;
-        n->bgTextureId = TextureRegistry::GetTexture(n->bgImageSrc);
-        paintChanged = true;
+  // Runs render(props) while recording every useState() key it touches.
+  // Leaves the returned table on the stack, or nil when the render failed.
+  static bool callRender(lua_State* L, int renderRef, int propsRef, std::vector<std::string>& keys) {
+    StateManager& sm = StateManager::instance();
+    sm.beginTracking();
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, renderRef);
+    if (propsRef != -2) lua_rawgeti(L, LUA_REGISTRYINDEX, propsRef);
+    else lua_newtable(L);
+    int status = lua_pcall(L, 1, 1, 0);
+
+    // a render function may hand back another component directly, its reads
+    // are attributed to the outer one
+    int depth = 0;
+    while (status == LUA_OK && lua_istable(L, -1) && isComponentTable(L, lua_gettop(L)) && depth++ < 16) {
+      lua_getfield(L, -1, "render");
+      lua_getfield(L, -2, "props");
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
       }
-    } else if (lua_isnil(L, -1) && n->bgTextureId != 0) {
-      // If the user dynamically removes the BGImage in Lua
-      TextureRegistry::ReleaseTexture(n->bgTextureId);
-      n->bgTextureId = 0;
-      n->bgImageSrc = "";
-      paintChanged = true;
+      lua_remove(L, -3);
+      status = lua_pcall(L, 1, 1, 0);
     }
-    lua_pop(L, 1);
 
-    std::string newBgFit = getStringProp(L, "BGFit", "cover");
-    if (n->bgImageFit != newBgFit) {
-      n->bgImageFit = newBgFit;
-      paintChanged = true;
+    keys = sm.endTracking();
+
+    if (status != LUA_OK) {
+      std::cerr << "Component Render Error: " << lua_tostring(L, -1) << std::endl;
+      lua_pop(L, 1);
+      lua_pushnil(L);
+      return false;
+    }
+    if (!lua_istable(L, -1)) {
+      std::cerr << "Component Render Error: render function did not return a table" << std::endl;
+      lua_pop(L, 1);
+      lua_pushnil(L);
+      return false;
     }
+    return true;
+  }
 
+  Node* buildComponent(lua_State* L, int idx) {
+    int renderRef = -2;
+    int propsRef = -2;
+    updateCallback(L, idx, "render", renderRef);
+    if (renderRef == -2) {
+      luaL_error(L, "component node requires a render function");
+      return nullptr;
+    }
+    updateValueRef(L, idx, "props", propsRef);
 
-    lua_getfield(L, idx, "focusable");
-    if (!lua_isnil(L, -1)) n->isFocusable = lua_toboolean(L, -1);
-    else n->isFocusable = false;
+    std::string key = "";
+    lua_getfield(L, idx, "key");
+    if (lua_isstring(L, -1)) key = lua_tostring(L, -1);
     lua_pop(L, 1);
 
-    lua_getfield(L, idx, "draggable");
-    if (!lua_isnil(L, -1)) {
-      bool newDraggable = lua_toboolean(L, -1);
-      if (n->isDraggable != newDraggable) {
-        n->isDraggable = newDraggable;
-      }
+    std::vector<std::string> keys;
+    Node* n = nullptr;
+    if (callRender(L, renderRef, propsRef, keys)) {
+      n = buildNode(L, lua_gettop(L));
     } else {
-      n->isDraggable = false;
+      n = new Node();
+      n->type = "vbox";
     }
     lua_pop(L, 1);
 
+    n->renderRef = renderRef;
+    n->propsRef = propsRef;
+    n->key = key;
+    readMemo(L, idx, n->memoRef);
+    StateManager::instance().subscribe(n, keys);
+    return n;
+  }
 
-    // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
-    // ╏ text selection flag ╏
-    // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
-    lua_getfield(L, idx, "allowSelection");
-    if (!lua_isnil(L, -1)) {
-      n->allowSelection = lua_toboolean(L, -1);
-    }
-    lua_pop(L, 1);
+  void reconcileChildren(lua_State* L, Node* current, int childrenIdx);
+  static void logPatch(PatchOp op, Node* parent, Node* child, Node* before);
+
+  Node* renderComponent(lua_State* L, Node* component) {
+    StateManager& sm = StateManager::instance();
+    sm.consumeDirty(component);
 
-    if (n->allowSelection && n->type == "text") {
-      n->isFocusable = true;
+    std::vector<std::string> keys;
+    if (!callRender(L, component->renderRef, component->propsRef, keys)) {
+      lua_pop(L, 1);
+      sm.subscribe(component, keys);
+      return component;
     }
+    int idx = lua_gettop(L);
 
+    std::string newType = "";
+    lua_getfield(L, idx, "type");
+    if (lua_isstring(L, -1)) newType = lua_tostring(L, -1);
+    lua_pop(L, 1);
 
-    lua_getfield(L, idx, "isFocused");
-    if (!lua_isnil(L, -1)) {
-      bool newFocused = lua_toboolean(L, -1);
-      if (n->isFocused != newFocused) {
-        n->isFocused = newFocused;
-        paintChanged = true;
+    Node* result = component;
+    if (component->parent && component->type != newType) {
+      // different element kind: build the new subtree and hand the component
+      // identity over to it
+      Node* fresh = buildNode(L, idx);
+      fresh->parent = component->parent;
+      fresh->renderRef = component->renderRef;
+      fresh->propsRef = component->propsRef;
+      fresh->key = component->key;
+      std::swap(fresh->memoRef, component->memoRef);
+      component->renderRef = -2;
+      component->propsRef = -2;
+
+      std::vector<Node*>& siblings = component->parent->children;
+      auto it = std::find(siblings.begin(), siblings.end(), component);
+      *it = fresh;
+      logPatch(PatchOp::Insert, fresh->parent, fresh, it + 1 != siblings.end() ? *(it + 1) : nullptr);
+      logPatch(PatchOp::Remove, fresh->parent, component, nullptr);
+      fresh->parent->isChildListDirty = true;
+      fresh->makeLayoutDirty();
+      component->makePaintDirty();
+      freeTree(L, component);
+      result = fresh;
+    } else {
+      if (component->type != newType) {
+        component->type = newType;
+        component->isStyleDirty = true;
+        component->makeLayoutDirty();
       }
-    }
-    lua_pop(L, 1);
 
-    lua_getfield(L, idx, "cursorPosition");
-    if (lua_isnumber(L, -1)) {
-      int newCursorPos = lua_tointeger(L, -1);
-      if (n->cursorPosition != newCursorPos) {
-        n->cursorPosition = newCursorPos;
-        paintChanged = true;
+      std::string key = component->key;
+      patchNode(L, component, idx);
+      component->key = key;
+
+      lua_getfield(L, idx, "children");
+      if (lua_istable(L, -1)) {
+        reconcileChildren(L, component, lua_gettop(L));
       }
+      lua_pop(L, 1);
     }
     lua_pop(L, 1);
 
-    lua_getfield(L, idx, "selectionStart");
-    if (lua_isnumber(L, -1)) {
-      int newSelectionStart = lua_tointeger(L, -1);
-      if (n->selectionStart != newSelectionStart) {
-        n->selectionStart = newSelectionStart;
-        paintChanged = true;
-      }
+    sm.subscribe(result, keys);
+    return result;
+  }
+
+  // the batch renderDirtyComponents is working through; freeTree clears the
+  // entries it frees so a node later built at the same address isn't taken
+  // for them
+  static std::vector<std::pair<int, Node*>> g_pendingRenders;
+
+  static std::vector<ChildPatch> g_patchLog;
+
+  void forgetNode(Node* n) {
+    for (auto& entry : g_pendingRenders) {
+      if (entry.second == n) entry.second = nullptr;
     }
-    lua_pop(L, 1);
 
-    lua_getfield(L, idx, "selectionEnd");
-    if (lua_isnumber(L, -1)) {
-      int newSelectionEnd = lua_tointeger(L, -1);
-      if (n->selectionEnd != newSelectionEnd) {
-        n->selectionEnd = newSelectionEnd;
-        paintChanged = true;
+    if (g_patchLog.empty()) return;
+    auto stale = [n](const ChildPatch& p) {
+      if (p.parent == n) return true;
+      if (p.op == PatchOp::Remove) return false;
+      if (p.child == n) return true;
+      if (p.before == n) {
+        // the anchor is gone; the consumer's full child pass places it
+        p.parent->isChildListDirty = true;
+        return true;
       }
-    }
-    lua_pop(L, 1);
+      return false;
+    };
+    g_patchLog.erase(std::remove_if(g_patchLog.begin(), g_patchLog.end(), stale), g_patchLog.end());
+  }
 
-    float newTranslateX = getFloatProp(L, "translateX", 0.0f);
-    if (n->translateX != newTranslateX) {
-      n->translateX = newTranslateX;
-      n->invalidateSubtreePaint(); 
-      paintChanged = true;
-    }
+  void renderDirtyComponents(lua_State* L) {
+    StateManager& sm = StateManager::instance();
 
-    float newTranslateY = getFloatProp(L, "translateY", 0.0f);
-    if (n->translateY != newTranslateY) {
-      n->translateY = newTranslateY;
-      n->invalidateSubtreePaint(); 
-      paintChanged = true;
+    std::vector<std::pair<int, Node*>>& pending = g_pendingRenders;
+    pending.clear();
+    for (Node* n : sm.dirtyComponentList()) {
+      int depth = 0;
+      for (Node* p = n->parent; p; p = p->parent) depth++;
+      pending.push_back({depth, n});
     }
 
-    lua_pop(L, 1);
+    // outermost first: re-rendering an ancestor already re-renders (or frees)
+    // the dirty components below it, which drops them from the pending set
+    std::sort(pending.begin(), pending.end(),
+        [](const std::pair<int, Node*>& a, const std::pair<int, Node*>& b) { return a.first < b.first; });
 
-    updateCallback(L, idx, "onTextInput", n->onTextInputRef);
-    updateCallback(L, idx, "onKeyDown", n->onKeyDownRef);
-    updateCallback(L, idx, "onFocus", n->onFocusRef);
-    updateCallback(L, idx, "onBlur", n->onBlurRef);
+    for (size_t i = 0; i < pending.size(); i++) {
+      Node* n = pending[i].second;
+      if (!n || !sm.consumeDirty(n)) continue;
+      renderComponent(L, n);
+    }
+    pending.clear();
+  }
 
+// ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+// ╏ KEYED CHILD DIFF  ╏
+// ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+// Children are matched by key (or by index when unkeyed). The matched old
+// indices, read in new order, are a permutation with gaps. The longest
+// increasing subsequence of it is the set of children that can stay where
+// they are, and everything else becomes an explicit Move. Structural edits
+// are recorded in the patch log, which the Yoga mirror replays instead of
+// re-deriving the child order.
+
+  const std::vector<ChildPatch>& patchLog() {
+    return g_patchLog;
+  }
 
-    updateCallback(L, idx, "onDragStart", n->onDragStartRef);
-    updateCallback(L, idx, "onDrag", n->onDragRef);
-    updateCallback(L, idx, "onDragEnd", n->onDragEndRef);
+  void clearPatchLog() {
+    g_patchLog.clear();
+  }
 
-    updateCallback(L, idx, "onClick", n->onClickRef);
-    updateCallback(L, idx, "onMouseEnter", n->onMouseEnterRef);
-    updateCallback(L, idx, "onMouseLeave", n->onMouseLeaveRef);
-    updateCallback(L, idx, "onRightClick", n->onRightClickRef);
+  static void logPatch(PatchOp op, Node* parent, Node* child, Node* before) {
+    g_patchLog.push_back({op, parent, child, before});
+  }
 
-    updateCallback(L, idx, "onScroll", n->onScrollRef);
+  // marks the positions (in `seq`) of one longest strictly increasing run,
+  // entries < 0 are skipped
+  static void longestIncreasing(const std::vector<int>& seq, std::vector<bool>& keep) {
+    std::vector<int> tails;       // index into seq of the smallest tail per length
+    std::vector<int> prev(seq.size(), -1);
 
-    if (layoutChanged) {
-      n->makeLayoutDirty();
-    } else if (paintChanged) {
-      n->makePaintDirty();
+    for (int i = 0; i < (int)seq.size(); i++) {
+      if (seq[i] < 0) continue;
+      auto it = std::lower_bound(tails.begin(), tails.end(), seq[i],
+          [&](int tailIdx, int value) { return seq[tailIdx] < value; });
+      if (it != tails.begin()) prev[i] = *(it - 1);
+      if (it == tails.end()) tails.push_back(i);
+      else *it = i;
     }
 
+    keep.assign(seq.size(), false);
+    for (int i = tails.empty() ? -1 : tails.back(); i >= 0; i = prev[i]) {
+      keep[i] = true;
+    }
   }
 
   void reconcileChildren(lua_State* L, Node* current, int childrenIdx) {
     int luaCount = lua_rawlen(L, childrenIdx);
-    size_t oldLen = current->children.size();
+    std::vector<Node*>& oldChildren = current->children;
+    size_t oldLen = oldChildren.size();
 
     std::vector<bool> reused(oldLen, false);
-    std::vector<Node*> newChildren;
-    newChildren.reserve(luaCount);
-
-    std::unordered_map<std::string, size_t> keyedChildren;
+    std::vector<Node*> newChildren(luaCount, nullptr);
+    std::vector<int> oldIndex(luaCount, -1);
+    std::vector<bool> isComponentChild(luaCount, false);
+
+    // scratch index of the old keys; it is only used before any recursion,
+    // so one table serves every level
+    static std::unordered_map<std::string_view, size_t> keyedChildren;
+    keyedChildren.clear();
     for (size_t i = 0; i < oldLen; ++i) {
-      if (!current->children[i]->key.empty()) {
-        keyedChildren[current->children[i]->key] = i; 
+      if (!oldChildren[i]->key.empty()) {
+        keyedChildren.emplace(oldChildren[i]->key, i);
       }
     }
 
+    // --- pass 1: match or build ---
     for (int i = 0; i < luaCount; ++i) {
       lua_rawgeti(L, childrenIdx, i + 1);
       int childIdx = lua_gettop(L);
 
-      std::string key = "";
+      size_t keyLen = 0;
+      const char* key = nullptr;
       lua_getfield(L, childIdx, "key");
-      if (lua_isstring(L, -1)) key = lua_tostring(L, -1);
-      lua_pop(L, 1);
+      if (lua_type(L, -1) == LUA_TSTRING) key = lua_tolstring(L, -1, &keyLen);
 
-      std::string newType = "";
+      std::string_view newType;
       lua_getfield(L, childIdx, "type");
-      if (lua_isstring(L, -1)) newType = lua_tostring(L, -1);
-      lua_pop(L, 1);
+      if (lua_type(L, -1) == LUA_TSTRING) {
+        size_t len = 0;
+        const char* type = lua_tolstring(L, -1, &len);
+        newType = std::string_view(type, len);
+      }
 
-      Node* matchedNode = nullptr;
+      // component tables only ever match component nodes, whatever element
+      // their last render produced
+      bool newIsComponent = newType == "component";
+      auto sameKind = [&](Node* old) {
+        if (newIsComponent) return old->isComponent();
+        return !old->isComponent() && old->type == newType;
+      };
 
-      if (!key.empty()) {
-        auto it = keyedChildren.find(key);
-        if (it != keyedChildren.end()) {
-          size_t oldIdx = it->second;
-          if (!reused[oldIdx] && current->children[oldIdx]->type == newType) {
-            matchedNode = current->children[oldIdx];
-            reused[oldIdx] = true;
-          }
+      int matched = -1;
+      if (keyLen > 0 && !keyedChildren.empty()) {
+        auto it = keyedChildren.find(std::string_view(key, keyLen));
+        if (it != keyedChildren.end() && !reused[it->second] && sameKind(oldChildren[it->second])) {
+          matched = (int)it->second;
         }
       }
 
-      if (!matchedNode && i < oldLen) {
-        if (!reused[i] && current->children[i]->key.empty() && current->children[i]->type == newType) {
-          matchedNode = current->children[i];
-          reused[i] = true;
+      if (matched < 0 && (size_t)i < oldLen) {
+        if (!reused[i] && oldChildren[i]->key.empty() && sameKind(oldChildren[i])) {
+          matched = i;
         }
       }
+      lua_pop(L, 2);
 
-      if (!matchedNode) {
-        matchedNode = buildNode(L, childIdx);
-        matchedNode->parent = current;
-        matchedNode->makeLayoutDirty();
-      }
-
-      patchNode(L, matchedNode, childIdx);
-
-      lua_getfield(L, childIdx, "children");
-      if (lua_istable(L, -1)) {
-        reconcileChildren(L, matchedNode, lua_gettop(L));
+      isComponentChild[i] = newIsComponent;
+      if (matched >= 0) {
+        reused[matched] = true;
+        oldIndex[i] = matched;
+        newChildren[i] = oldChildren[matched];
+      } else {
+        // freshly built nodes already carry everything the table describes
+        newChildren[i] = buildNode(L, childIdx);
+        newChildren[i]->parent = current;
       }
-      lua_pop(L, 1);
 
-      newChildren.push_back(matchedNode);
       lua_pop(L, 1);
     }
+    keyedChildren.clear();
+
+    // --- structural diff ---
+    std::vector<bool> stays;
+    longestIncreasing(oldIndex, stays);
 
+    bool structureChanged = false;
+    std::vector<Node*> removed;
     for (size_t i = 0; i < oldLen; i++) {
       if (!reused[i]) {
-        freeTree(L, current->children[i]);
-        current->makeLayoutDirty();
+        removed.push_back(oldChildren[i]);
+        structureChanged = true;
       }
     }
 
-    current->children = newChildren;
+    // walking backwards, the anchor sibling is already in its final place
+    for (int i = luaCount - 1; i >= 0; --i) {
+      Node* before = (i + 1 < luaCount) ? newChildren[i + 1] : nullptr;
+      if (oldIndex[i] < 0) {
+        logPatch(PatchOp::Insert, current, newChildren[i], before);
+        structureChanged = true;
+      } else if (!stays[i]) {
+        logPatch(PatchOp::Move, current, newChildren[i], before);
+        structureChanged = true;
+      }
+    }
+
+    current->children = std::move(newChildren);
+
+    for (Node* n : removed) {
+      logPatch(PatchOp::Remove, current, n, nullptr);
+      // nothing draws over where it was unless its box is damaged
+      n->makePaintDirty();
+      freeTree(L, n);
+    }
+
+    if (structureChanged) {
+      // moved subtrees keep their caches, only the parent needs a new layout
+      current->isChildListDirty = true;
+      current->makeLayoutDirty();
+    }
+
+    // --- pass 2: patch the matched children ---
+    for (int i = 0; i < luaCount; ++i) {
+      if (oldIndex[i] < 0) continue;
+
+      Node* matchedNode = current->children[i];
+      lua_rawgeti(L, childrenIdx, i + 1);
+      int childIdx = lua_gettop(L);
+
+      // a component whose own state changed re-renders whatever its memo says
+      bool stateDirty = StateManager::instance().isComponentDirty(matchedNode);
+      if (memoUnchanged(L, childIdx, matchedNode) && !stateDirty) {
+        // same deps as last pass: the whole subtree is kept as is
+      } else if (isComponentChild[i]) {
+        updateCallback(L, childIdx, "render", matchedNode->renderRef);
+        updateValueRef(L, childIdx, "props", matchedNode->propsRef);
+        renderComponent(L, matchedNode);
+      } else {
+        patchNode(L, matchedNode, childIdx);
+
+        lua_getfield(L, childIdx, "children");
+        if (lua_istable(L, -1)) {
+          reconcileChildren(L, matchedNode, lua_gettop(L));
+        }
+        lua_pop(L, 1);
+      }
+
+      lua_pop(L, 1);
+    }
+  }
+
+  // puts `fresh` where `current` stands and frees the old subtree
+  static Node* replaceNode(lua_State* L, Node* current, Node* fresh) {
+    fresh->parent = current->parent;
+    if (current->parent) {
+      std::vector<Node*>& siblings = current->parent->children;
+      auto it = std::find(siblings.begin(), siblings.end(), current);
+      *it = fresh;
+      logPatch(PatchOp::Insert, current->parent, fresh, it + 1 != siblings.end() ? *(it + 1) : nullptr);
+      logPatch(PatchOp::Remove, current->parent, current, nullptr);
+      current->parent->isChildListDirty = true;
+    }
+    fresh->makeLayoutDirty();
+    current->makePaintDirty();
+    freeTree(L, current);
+    return fresh;
   }
 
-  void reconcile(lua_State *L, Node *current, int idx) {
-    if (!current) return;
+  Node* reconcile(lua_State *L, Node *current, int idx) {
+    if (!current) return nullptr;
+
+    bool stateDirty = StateManager::instance().isComponentDirty(current);
+    if (memoUnchanged(L, idx, current) && !stateDirty) return current;
+
+    if (isComponentTable(L, idx)) {
+      if (current->isComponent()) {
+        updateCallback(L, idx, "render", current->renderRef);
+        updateValueRef(L, idx, "props", current->propsRef);
+        return renderComponent(L, current);
+      }
+
+      // a plain node has no render function or subscriptions to take over:
+      // build the component from scratch and swap it in
+      return replaceNode(L, current, buildComponent(L, idx));
+    }
+
+    if (current->isComponent()) {
+      // patching in place would keep the render function and its
+      // subscriptions, and a later setState would re-run it over this tree
+      return replaceNode(L, current, buildNode(L, idx));
+    }
 
     float savedScrollX = current->scrollX;
     float savedScrollY = current->scrollY;
     float savedTargetScrollX = current->targetScrollX;
     float savedTargetScrollY = current->targetScrollY;
-    float savedScrollbarTimer = current->scrollbarTimer;
-    float savedScrollbarOpacity = current->scrollbarOpacity;
+    float savedScrollbarTimer = current->scrollbar->scrollbarTimer;
+    float savedScrollbarOpacity = current->scrollbar->scrollbarOpacity;
 
     float savedCachedOffsetX = current->cachedOffsetX;
     float savedCachedOffsetY = current->cachedOffsetY;
-    bool savedHasCache = current->hasCachedCommands;
-    RenderCommandList savedCache = current->cachedCommands;
 
-    bool savedIsDragging = current->isDragging;
-    float savedDragOffsetX = current->dragOffsetX;
-    float savedDragOffsetY = current->dragOffsetY;
+    bool savedIsDragging = current->drag->isDragging;
+    float savedDragOffsetX = current->drag->dragOffsetX;
+    float savedDragOffsetY = current->drag->dragOffsetY;
 
     patchNode(L, current, idx);
 
@@ -750,23 +745,22 @@ namespace VDOM {
     current->scrollY = savedScrollY;
     current->targetScrollX = savedTargetScrollX;
     current->targetScrollY = savedTargetScrollY;
-    current->scrollbarTimer = savedScrollbarTimer;
-    current->scrollbarOpacity = savedScrollbarOpacity;
+    current->scrollbar.set(&NodeScrollbar::scrollbarTimer, savedScrollbarTimer);
+    current->scrollbar.set(&NodeScrollbar::scrollbarOpacity, savedScrollbarOpacity);
 
     current->cachedOffsetX = savedCachedOffsetX;
     current->cachedOffsetY = savedCachedOffsetY;
-    current->hasCachedCommands = savedHasCache;
-    current->cachedCommands = savedCache;
 
-    current->isDragging = savedIsDragging;
-    current->dragOffsetX = savedDragOffsetX;
-    current->dragOffsetY = savedDragOffsetY;
+    current->drag.set(&NodeDrag::isDragging, savedIsDragging);
+    current->drag.set(&NodeDrag::dragOffsetX, savedDragOffsetX);
+    current->drag.set(&NodeDrag::dragOffsetY, savedDragOffsetY);
 
     lua_getfield(L, idx, "children");
     if (lua_istable(L, -1)) {
       reconcileChildren(L, current, lua_gettop(L));
     }
     lua_pop(L, 1);
+    return current;
   }
 
 
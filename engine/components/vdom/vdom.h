@@ -2,8 +2,41 @@
 #include "../ui/ui.h"
 #include "../../lua.hpp"
 #include "../color/color.h"
+#include <vector>
 
 namespace VDOM {
-  void reconcile(lua_State *L, Node *current, int idx);
+  // Structural child edits made while reconciling, in the order they were
+  // made. `before` is the sibling the child now precedes (nullptr: last).
+  // A Remove is logged just before its child is freed and only names it;
+  // its `child` must not be dereferenced. Freeing a node drops the Insert
+  // and Move entries that mention it, so those always point at live nodes.
+  enum class PatchOp {
+    Insert,
+    Move,
+    Remove
+  };
+
+  struct ChildPatch {
+    PatchOp op;
+    Node* parent;
+    Node* child;
+    Node* before;
+  };
+
+  const std::vector<ChildPatch>& patchLog();
+  void clearPatchLog();
+
+  // returns the node now standing where `current` was; it differs when the
+  // table turned `current` into a component or back into a plain node
+  Node* reconcile(lua_State *L, Node *current, int idx);
   void updateCallback(lua_State* L, int tableIdx, const char* key, int& ref);
+
+  void readMemo(lua_State* L, int idx, int& ref);
+
+  bool isComponentTable(lua_State* L, int idx);
+  Node* buildComponent(lua_State* L, int idx);
+  Node* renderComponent(lua_State* L, Node* component);
+  void renderDirtyComponents(lua_State* L);
+  // called by freeTree for every node it frees
+  void forgetNode(Node* n);
 }
@@ -43,6 +43,12 @@ void loadEngineConfig(lua_State *L) {
   }
   lua_pop(L, 1);
 
+  lua_getglobal(L, "enable_render_thread");
+  if (lua_isboolean(L, -1)) {
+    g_config.enableRenderThread = lua_toboolean(L, -1);
+  }
+  lua_pop(L, 1);
+
   lua_settop(L, top);
 
 }
@@ -5,6 +5,7 @@
 struct EngineConfig {
   bool enableDefaultFonts = true;
   bool enableStatsLogging = false;
+  bool enableRenderThread = true;
 };
 
 const EngineConfig& GetEngineConfig();
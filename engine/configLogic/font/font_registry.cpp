@@ -13,6 +13,7 @@
 #include "../../scripting/regsitry.h"
 
 static std::unordered_map<std::string, FontConfig> g_fontRegistry;
+static int g_fontConfigVersion = 0;
 namespace fs = std::filesystem;
 
 const FontConfig* GetFontConfig(const std::string& alias) {
@@ -24,6 +25,10 @@ const FontConfig* GetFontConfig(const std::string& alias) {
   return nullptr;
 }
 
+int GetFontConfigVersion() {
+  return g_fontConfigVersion;
+}
+
 static bool g_canLoadTextures = false;
 
 static void RebuildFallbackList() {
@@ -46,11 +51,13 @@ static void RebuildFallbackList() {
 void RegisterFontInternal(const std::string& alias, const std::string& path, int size, bool fallback) {
   FontConfig conf = {path, size, fallback};
   g_fontRegistry[alias] = conf;
+  g_fontConfigVersion++;
 }
 
 void RegisterFontsFromTable(lua_State* L, int tableIndex) {
   if (tableIndex < 0) tableIndex = lua_gettop(L) + tableIndex + 1;
   luaL_checktype(L, tableIndex, LUA_TTABLE);
+  g_fontConfigVersion++;
   
   lua_pushnil(L);
   while (lua_next(L, tableIndex) != 0) {
@@ -278,6 +285,8 @@ int l_update_font_config(lua_State* L) {
     RegisterFontInternal(alias, newPath, size, fallback);
   }
 
+  g_fontConfigVersion++;
+
   // Important: Refresh the engine's fallback cache immediately
   RebuildFallbackList(); 
   return 0;
@@ -17,6 +17,8 @@ struct FontConfig {
 
 void LoadFontConfig(lua_State* L);
 const FontConfig* GetFontConfig(const std::string& alias);
+// bumped whenever an alias is (re)registered, nodes re-resolve their font
+int GetFontConfigVersion();
 
 
 void AutoRegisterAllFonts();
@@ -17,12 +17,14 @@
 #include <iostream>
 #include <mutex>
 #include <vector>
-#include <thread>
 #include <cpr/cpr.h>
 
 #include "../../scripting/regsitry.h"
 #include "../../lua.hpp"
 #include "../../components/system/pathUtils.h"
+#include "../../components/system/timers.h"
+#include "../../components/renderer/render_thread.h"
+#include "../../components/system/jobs.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../../../third_party/stb_image/stb_image.h"
@@ -30,6 +32,8 @@
 #define STB_DXT_IMPLEMENTATION
 #include "../../../third_party/stb_image/stb_dxt.h"
 
+#include <stb_rect_pack.h>
+
 #ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
 #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
 #endif
@@ -46,19 +50,55 @@ namespace TextureRegistry {
     bool isCompressed = false;
   };
 
+  // `id` is a registry handle. The GL storage behind it is decided when the
+  // pixels arrive: its own texture, or a rect on a shared atlas page.
   struct TextureInfo {
     GLuint id;
     int refCount;
     int width;
     int height;
     bool isLoaded;
+
+    GLuint glTexture = 0;
+    int page = -1; // atlas page index, -1 when standalone
+    int atlasX = 0, atlasY = 0;
+    float u0 = 0.0f, v0 = 0.0f, u1 = 1.0f, v1 = 1.0f;
   };
   static std::unordered_map<std::string, TextureInfo> textureCache;
   static std::unordered_map<GLuint, std::string> idToPath;
+  static GLuint nextHandle = 1;
 
   static std::vector<UploadTask> uploadQueue;
   static std::mutex queueMutex;
 
+  // loads still in flight, so releasing the last reference can stop them;
+  // main thread only
+  static std::unordered_map<GLuint, Jobs::CancelToken> loadTokens;
+
+  // called from the loader jobs; wakes the main loop so the upload
+  // doesn't wait for some unrelated event
+  static void queueUpload(const UploadTask& task) {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      uploadQueue.push_back(task);
+    }
+    Timers::WakeMainThread();
+  }
+
+  // frees what an upload owns without placing it; GL thread only
+  static void discardUpload(const UploadTask& task) {
+    if (task.pbo != 0) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, task.pbo);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glDeleteBuffers(1, &task.pbo);
+    }
+    if (task.rawPixels != nullptr) {
+      if (task.isCompressed) delete [] task.rawPixels; 
+      else stbi_image_free(task.rawPixels);
+    }
+  }
+
   void CompressToDXT5(const unsigned char* rgba, int w, int h, unsigned char* out_dxt) {
     int blocksW = (w + 3) / 4;
     int blocksH = (h + 3) / 4;
@@ -79,6 +119,290 @@ namespace TextureRegistry {
     }
   }
 
+  // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+  // ╏ ATLAS PAGES FOR SMALL IMAGES        ╏
+  // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+  // Icons, avatars and thumbnails are packed into shared pages so a grid of
+  // them draws as one batch. Baked local assets go to DXT5 pages and web
+  // images to RGBA8 pages. Rects are padded to 4 px, which keeps every DXT
+  // block aligned and leaves a gutter between neighbours. stb_rect_pack
+  // cannot free single rects, so released rects are counted as dead area;
+  // once enough of a page is dead its survivors are re-packed onto a fresh
+  // page. Handles are indirect, so only their UVs change. The page count per
+  // format is capped and images past it get their own texture.
+
+  constexpr int ATLAS_PAGE_SIZE = 2048;
+  constexpr int ATLAS_MAX_IMAGE = 256;
+  constexpr int ATLAS_GUTTER = 4;
+  constexpr int ATLAS_MAX_PAGES = 8;
+  // a page is compacted once a quarter of it is dead and dead rects
+  // outweigh the live ones
+  constexpr int ATLAS_COMPACT_AREA = ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE / 4;
+
+  struct AtlasPage {
+    GLuint texture = 0;
+    bool compressed = false;
+    int live = 0;
+    int usedArea = 0; // every rect packed so far, released ones included
+    int deadArea = 0;
+    stbrp_context packer;
+    std::vector<stbrp_node> nodes;
+  };
+  static std::vector<std::unique_ptr<AtlasPage>> atlasPages;
+  static bool compactPending = false;
+  static uint32_t atlasGeneration = 0;
+
+  static int align4(int v) { return (v + 3) & ~3; }
+
+  static int slotWidth(int w) { return align4(w) + ATLAS_GUTTER; }
+
+  static int createAtlasPage(bool compressed) {
+    size_t slot = 0;
+    while (slot < atlasPages.size() && atlasPages[slot]) slot++;
+    if (slot == atlasPages.size()) atlasPages.emplace_back();
+
+    auto page = std::make_unique<AtlasPage>();
+    page->compressed = compressed;
+    page->nodes.resize(ATLAS_PAGE_SIZE);
+    stbrp_init_target(&page->packer, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, page->nodes.data(), (int)page->nodes.size());
+
+    // called mid-upload, when a PBO may be bound as the pixel source
+    GLint boundPbo = 0;
+    glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &boundPbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glGenTextures(1, &page->texture);
+    glBindTexture(GL_TEXTURE_2D, page->texture);
+    if (compressed) {
+      GLsizei size = (ATLAS_PAGE_SIZE / 4) * (ATLAS_PAGE_SIZE / 4) * 16;
+      glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 0, size, nullptr);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, (GLuint)boundPbo);
+
+    atlasPages[slot] = std::move(page);
+    return (int)slot;
+  }
+
+  // finds room for a w x h image; returns the page index or -1
+  static int allocateInAtlas(bool compressed, int w, int h, int& outX, int& outY) {
+    stbrp_rect rect = {};
+    rect.w = slotWidth(w);
+    rect.h = slotWidth(h);
+
+    int pageCount = 0;
+    for (size_t i = 0; i < atlasPages.size(); i++) {
+      AtlasPage* page = atlasPages[i].get();
+      if (!page || page->compressed != compressed) continue;
+      pageCount++;
+      rect.was_packed = 0;
+      if (stbrp_pack_rects(&page->packer, &rect, 1) && rect.was_packed) {
+        outX = rect.x;
+        outY = rect.y;
+        page->live++;
+        page->usedArea += rect.w * rect.h;
+        return (int)i;
+      }
+    }
+    if (pageCount >= ATLAS_MAX_PAGES) return -1;
+
+    int index = createAtlasPage(compressed);
+    rect.was_packed = 0;
+    if (stbrp_pack_rects(&atlasPages[index]->packer, &rect, 1) && rect.was_packed) {
+      outX = rect.x;
+      outY = rect.y;
+      atlasPages[index]->live++;
+      atlasPages[index]->usedArea += rect.w * rect.h;
+      return index;
+    }
+    return -1;
+  }
+
+  // queued behind any frame already handed to the renderer, so a frame in
+  // flight never samples a deleted texture
+  static void deleteTexture(GLuint texture) {
+    RenderThread::RunOnGL([texture] { glDeleteTextures(1, &texture); });
+  }
+
+  static bool needsCompaction(const AtlasPage& page) {
+    return page.deadArea >= ATLAS_COMPACT_AREA && page.deadArea * 2 >= page.usedArea;
+  }
+
+  static void releaseAtlasSlot(int index, int w, int h) {
+    if (index < 0 || index >= (int)atlasPages.size() || !atlasPages[index]) return;
+    AtlasPage* page = atlasPages[index].get();
+    if (--page->live > 0) {
+      page->deadArea += slotWidth(w) * slotWidth(h);
+      if (needsCompaction(*page)) compactPending = true;
+      return;
+    }
+
+    deleteTexture(page->texture);
+    atlasPages[index].reset();
+  }
+
+  static void setAtlasRect(TextureInfo& info, int index, int x, int y) {
+    // half-texel inset so linear filtering never reaches the gutter
+    float size = (float)ATLAS_PAGE_SIZE;
+    info.glTexture = atlasPages[index]->texture;
+    info.page = index;
+    info.atlasX = x;
+    info.atlasY = y;
+    info.u0 = (x + 0.5f) / size;
+    info.v0 = (y + 0.5f) / size;
+    info.u1 = (x + info.width - 0.5f) / size;
+    info.v1 = (y + info.height - 0.5f) / size;
+  }
+
+  // re-packs the images still on page `index` onto a fresh page and drops the
+  // old one. The old page is read back once and each survivor copied over;
+  // GL 3.3 has no texture-to-texture copy that covers DXT pages.
+  static bool compactAtlasPage(int index) {
+    AtlasPage* old = atlasPages[index].get();
+
+    std::vector<TextureInfo*> survivors;
+    for (auto& pair : textureCache) {
+      if (pair.second.page == index) survivors.push_back(&pair.second);
+    }
+
+    std::vector<stbrp_rect> rects(survivors.size());
+    for (size_t i = 0; i < survivors.size(); i++) {
+      rects[i] = {};
+      rects[i].id = (int)i;
+      rects[i].w = slotWidth(survivors[i]->width);
+      rects[i].h = slotWidth(survivors[i]->height);
+    }
+
+    int freshIndex = createAtlasPage(old->compressed);
+    AtlasPage* fresh = atlasPages[freshIndex].get();
+    if (!stbrp_pack_rects(&fresh->packer, rects.data(), (int)rects.size())) {
+      deleteTexture(fresh->texture);
+      atlasPages[freshIndex].reset();
+      return false;
+    }
+
+    GLint boundPbo = 0;
+    glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &boundPbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    const int blocksPerRow = ATLAS_PAGE_SIZE / 4;
+    std::vector<unsigned char> pixels;
+    glBindTexture(GL_TEXTURE_2D, old->texture);
+    if (old->compressed) {
+      pixels.resize((size_t)blocksPerRow * blocksPerRow * 16);
+      glGetCompressedTexImage(GL_TEXTURE_2D, 0, pixels.data());
+    } else {
+      pixels.resize((size_t)ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * 4);
+      glPixelStorei(GL_PACK_ALIGNMENT, 4);
+      glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    }
+
+    glBindTexture(GL_TEXTURE_2D, fresh->texture);
+    std::vector<unsigned char> blocks;
+    for (const stbrp_rect& rect : rects) {
+      TextureInfo& info = *survivors[rect.id];
+      if (old->compressed) {
+        // gather the image's block rows into one tightly packed run
+        int bw = align4(info.width) / 4;
+        int bh = align4(info.height) / 4;
+        blocks.resize((size_t)bw * bh * 16);
+        for (int row = 0; row < bh; row++) {
+          size_t src = ((size_t)(info.atlasY / 4 + row) * blocksPerRow + info.atlasX / 4) * 16;
+          std::memcpy(&blocks[(size_t)row * bw * 16], &pixels[src], (size_t)bw * 16);
+        }
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, bw * 4, bh * 4, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, (GLsizei)blocks.size(), blocks.data());
+      } else {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, ATLAS_PAGE_SIZE);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, info.atlasX);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, info.atlasY);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, info.width, info.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+      }
+      setAtlasRect(info, freshIndex, rect.x, rect.y);
+      fresh->usedArea += rect.w * rect.h;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, (GLuint)boundPbo);
+
+    fresh->live = (int)survivors.size();
+    deleteTexture(old->texture);
+    atlasPages[index].reset();
+    return true;
+  }
+
+  static void compactAtlasPages() {
+    compactPending = false;
+    bool moved = false;
+    size_t count = atlasPages.size();
+    for (size_t i = 0; i < count; i++) {
+      if (atlasPages[i] && needsCompaction(*atlasPages[i])) {
+        moved |= compactAtlasPage((int)i);
+      }
+    }
+    if (moved) atlasGeneration++;
+  }
+
+  static void releaseStorage(TextureInfo& info) {
+    if (info.page >= 0) {
+      releaseAtlasSlot(info.page, info.width, info.height);
+    } else if (info.glTexture != 0) {
+      deleteTexture(info.glTexture);
+    }
+    info.page = -1;
+    info.glTexture = 0;
+  }
+
+  // places an uploaded image: small ones on an atlas page, others in their
+  // own texture. `pixels` may be null when a PBO is bound as the source.
+  static void placeTexture(TextureInfo& info, int w, int h, bool compressed, const void* pixels, size_t dataSize) {
+    int paddedW = align4(w);
+    int paddedH = align4(h);
+
+    if (w <= ATLAS_MAX_IMAGE && h <= ATLAS_MAX_IMAGE) {
+      int x = 0, y = 0;
+      int index = allocateInAtlas(compressed, w, h, x, y);
+      if (index >= 0) {
+        AtlasPage* page = atlasPages[index].get();
+        glBindTexture(GL_TEXTURE_2D, page->texture);
+        if (compressed) {
+          glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, paddedW, paddedH, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, (GLsizei)dataSize, pixels);
+        } else {
+          glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        }
+
+        setAtlasRect(info, index, x, y);
+        return;
+      }
+    }
+
+    glGenTextures(1, &info.glTexture);
+    glBindTexture(GL_TEXTURE_2D, info.glTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    info.page = -1;
+    info.u0 = 0.0f;
+    info.v0 = 0.0f;
+    if (compressed) {
+      glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, paddedW, paddedH, 0, (GLsizei)dataSize, pixels);
+      // the block padding on the right/bottom is not part of the image
+      info.u1 = (float)w / paddedW;
+      info.v1 = (float)h / paddedH;
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+      info.u1 = 1.0f;
+      info.v1 = 1.0f;
+    }
+  }
+
   GLuint GetTexture(const std::string &path) {
     if (path.empty()) return 0;
     auto it = textureCache.find(path);
@@ -88,15 +412,8 @@ namespace TextureRegistry {
     }
 
     if (path.find("http://") == 0 || path.find("https://") == 0 ) {
-      GLuint textureID;
-      glGenTextures(1, &textureID);
-      glBindTexture(GL_TEXTURE_2D, textureID);
-      unsigned char emptyPixel[] = {0, 0, 0, 0};
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, emptyPixel);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      // nothing to bind until the download lands; nodes draw a skeleton
+      GLuint textureID = nextHandle++;
 
       textureCache[path] = {textureID, 1, 0, 0, false};
       idToPath[textureID] = path;
@@ -112,10 +429,17 @@ namespace TextureRegistry {
       // 2. Check if we already downloaded it in a previous session
       bool needsDownload = !fs::exists(cachePath);
 
-      std::thread([textureID, path, cachePathStr, needsDownload]() {
+      Jobs::CancelToken loadToken;
+      loadTokens[textureID] = loadToken;
+
+      Jobs::Submit(Jobs::Pool::IO, Jobs::Priority::Normal, [textureID, path, cachePathStr, needsDownload](const Jobs::CancelToken& token) {
+        if (token.IsCancelled()) return;
+
+        std::string encoded;
         if (needsDownload) {
           cpr::Session session;
           session.SetUrl(cpr::Url{path});
+          session.SetProgressCallback(cpr::ProgressCallback{[token](auto&&...) { return !token.IsCancelled(); }});
 
 #if defined (__linux__)
           const char* certPaths[] = {
@@ -131,47 +455,44 @@ namespace TextureRegistry {
           }
 #endif
           cpr::Response r = session.Get();
+          if (token.IsCancelled()) return;
 
-          if (r.status_code == 200) {
-            std:std::filesystem::create_directories(std::filesystem::path(cachePathStr).parent_path());
-            std::ofstream out(cachePathStr, std::ios::binary);
-
-            if (out) {
-              out.write(r.text.data(), r.text.size());
-            }
-
-            int tw, th, tc;
-            unsigned char* pixels = stbi_load_from_memory(
-              reinterpret_cast<unsigned char*>(r.text.data()),
-              r.text.size(), &tw, &th, &tc, 4);
-
-            if (pixels) {
-              std::lock_guard<std::mutex> lock(queueMutex);
-              uploadQueue.push_back({textureID, 0, tw, th, 0, pixels, false});
-            }
-          } else {
+          if (r.status_code != 200) {
             std::cerr << "[Texture Download Failed] Status: " << r.status_code << " Error: " << r.error.message << std::endl;
+            return;
+          }
+
+          std::filesystem::create_directories(std::filesystem::path(cachePathStr).parent_path());
+          std::ofstream out(cachePathStr, std::ios::binary);
+          if (out) {
+            out.write(r.text.data(), r.text.size());
           }
+          encoded = std::move(r.text);
         } else {
           // Load instantly from the local hard drive cache!
           std::ifstream file(cachePathStr, std::ios::binary | std::ios::ate);
-          if (file) {
-            std::streamsize size = file.tellg();
-            file.seekg(0, std::ios::beg);
-
-            std::vector<unsigned char> buffer(size);
-            if (file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-              int tw, th, tc;
-              unsigned char* pixels = stbi_load_from_memory(buffer.data(), size, &tw, &th, &tc, 4);
-
-              if (pixels) {
-                std::lock_guard<std::mutex> lock(queueMutex);
-                uploadQueue.push_back({textureID, 0, tw, th, 0, pixels, false});
-              }
-            }
-          }
+          if (!file) return;
+          std::streamsize size = file.tellg();
+          file.seekg(0, std::ios::beg);
+
+          encoded.resize(size);
+          if (!file.read(encoded.data(), size)) return;
         }
-      }).detach();
+
+        // decoding is CPU work; hand it over instead of holding an IO worker
+        Jobs::Submit(Jobs::Pool::CPU, Jobs::Priority::Normal, [textureID, encoded = std::move(encoded)](const Jobs::CancelToken& token) {
+          if (token.IsCancelled()) return;
+
+          int tw, th, tc;
+          unsigned char* pixels = stbi_load_from_memory(
+            reinterpret_cast<const unsigned char*>(encoded.data()),
+            (int)encoded.size(), &tw, &th, &tc, 4);
+
+          if (pixels) {
+            queueUpload({textureID, 0, tw, th, 0, pixels, false});
+          }
+        }, token);
+      }, loadToken);
 
       return textureID;
     }
@@ -226,62 +547,64 @@ namespace TextureRegistry {
 
     size_t dataSize = ((w + 3) / 4) * ((h + 3) / 4) * 16;
 
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    unsigned char emptyPixel[] = {0, 0, 0, 0};
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, emptyPixel);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    GLuint textureID = nextHandle++;
 
     textureCache[path] = {textureID, 1, w, h, false};
     idToPath[textureID] = path;
 
-    GLuint pbo;
-    glGenBuffers(1, &pbo);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
-    glBufferData(GL_PIXEL_UNPACK_BUFFER, dataSize, nullptr, GL_STREAM_DRAW);
-    void* mappedPtr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, dataSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    Jobs::CancelToken loadToken;
+    loadTokens[textureID] = loadToken;
+
+    // the PBO has to be mapped where the context lives; the loader job is
+    // submitted from there once the mapping exists
+    RenderThread::RunOnGL([textureID, dataSize, w, h, cachePathStr, origPath, needsBake, loadToken]() {
+      GLuint pbo;
+      glGenBuffers(1, &pbo);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, dataSize, nullptr, GL_STREAM_DRAW);
+      void* mappedPtr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, dataSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+      // baking decodes and compresses; a baked .vtex is only a read
+      Jobs::Pool pool = needsBake ? Jobs::Pool::CPU : Jobs::Pool::IO;
+      Jobs::Submit(pool, Jobs::Priority::Normal, [textureID, pbo, mappedPtr, dataSize, w, h, cachePathStr, origPath, needsBake](const Jobs::CancelToken& token) {
+          // a cancelled load still hands the PBO back so it gets unmapped
+          if (token.IsCancelled() || !mappedPtr) {
+            queueUpload({0, pbo, 0, 0, 0});
+            return;
+          }
 
-    std::thread([textureID, pbo, mappedPtr, dataSize, w, h, cachePathStr, origPath, needsBake]() {
-        if (needsBake) {
-        int tw, th, tc;
-        unsigned char* pixels = stbi_load(origPath.c_str(), &tw, &th, &tc, STBI_rgb_alpha);
-        if (pixels && mappedPtr) {
-        CompressToDXT5(pixels, tw, th, static_cast<unsigned char*>(mappedPtr));
-        stbi_image_free(pixels); 
-
-        std::filesystem::create_directories(std::filesystem::path(cachePathStr).parent_path());
-        std::ofstream out(cachePathStr, std::ios::binary);
-        if (out) {
-        out.write(reinterpret_cast<char*>(&tw), sizeof(int));
-        out.write(reinterpret_cast<char*>(&th), sizeof(int));
-        out.write(reinterpret_cast<const char*>(mappedPtr), dataSize);
-        }
+          if (needsBake) {
+            int tw, th, tc;
+            unsigned char* pixels = stbi_load(origPath.c_str(), &tw, &th, &tc, STBI_rgb_alpha);
+            if (pixels) {
+              CompressToDXT5(pixels, tw, th, static_cast<unsigned char*>(mappedPtr));
+              stbi_image_free(pixels); 
+
+              std::filesystem::create_directories(std::filesystem::path(cachePathStr).parent_path());
+              std::ofstream out(cachePathStr, std::ios::binary);
+              if (out) {
+                out.write(reinterpret_cast<char*>(&tw), sizeof(int));
+                out.write(reinterpret_cast<char*>(&th), sizeof(int));
+                out.write(reinterpret_cast<const char*>(mappedPtr), dataSize);
+              }
 
-        std::lock_guard<std::mutex> lock(queueMutex);
-        uploadQueue.push_back({textureID, pbo, tw, th, dataSize}); 
-        } else {
-        if (pixels) stbi_image_free(pixels);
-        std::lock_guard<std::mutex> lock(queueMutex);
-        uploadQueue.push_back({0, pbo, 0, 0, 0});
-        }
-        } else {
-          std::ifstream t_file(cachePathStr, std::ios::binary);
-          if (t_file && mappedPtr) {
-            t_file.seekg(8);
-            t_file.read(reinterpret_cast<char*>(mappedPtr), dataSize);
-            std::lock_guard<std::mutex> lock(queueMutex);
-            uploadQueue.push_back({textureID, pbo, w, h, dataSize});
+              queueUpload({textureID, pbo, tw, th, dataSize}); 
+            } else {
+              queueUpload({0, pbo, 0, 0, 0});
+            }
           } else {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            uploadQueue.push_back({0, pbo, 0, 0, 0});
+            std::ifstream t_file(cachePathStr, std::ios::binary);
+            if (t_file) {
+              t_file.seekg(8);
+              t_file.read(reinterpret_cast<char*>(mappedPtr), dataSize);
+              queueUpload({textureID, pbo, w, h, dataSize});
+            } else {
+              queueUpload({0, pbo, 0, 0, 0});
+            }
           }
-        }
-    }).detach();
+      }, loadToken);
+    });
 
     return textureID;
   }
@@ -295,7 +618,12 @@ namespace TextureRegistry {
     if (cacheIt != textureCache.end()) {
       cacheIt->second.refCount--;
       if (cacheIt->second.refCount <= 0) {
-        glDeleteTextures(1, &cacheIt->second.id);
+        auto tokenIt = loadTokens.find(textureID);
+        if (tokenIt != loadTokens.end()) {
+          tokenIt->second.Cancel();
+          loadTokens.erase(tokenIt);
+        }
+        releaseStorage(cacheIt->second);
         textureCache.erase(cacheIt);
         idToPath.erase(pathIt);
       }
@@ -303,63 +631,80 @@ namespace TextureRegistry {
   }
 
   bool ProcessUploads() {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    if (uploadQueue.empty()) return false;
-
-    for (const auto& task : uploadQueue ) {
-      if (task.targetID != 0 && idToPath.find(task.targetID) != idToPath.end()) {
-
-        std::string path = idToPath[task.targetID];
-        textureCache[path].width = task.width;
-        textureCache[path].height = task.height;
-        textureCache[path].isLoaded = true;
-
-        glBindTexture(GL_TEXTURE_2D, task.targetID);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
-        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
-
-        if (task.pbo != 0) {
-          glBindBuffer(GL_PIXEL_UNPACK_BUFFER, task.pbo);
-          glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-          int paddedW = ((task.width + 3) / 4) * 4;
-          int paddedH = ((task.height + 3) / 4) * 4;
-          glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, paddedW, paddedH, 0, task.dataSize, nullptr);
-          glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-          glDeleteBuffers(1, &task.pbo);
-        } else if (task.rawPixels != nullptr) {
-          if (task.isCompressed) {
-            int paddedW = ((task.width + 3) / 4) * 4;
-            int paddedH = ((task.height + 3) / 4) * 4;
-            glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, paddedW, paddedH, 0, task.dataSize, task.rawPixels);
-            delete[] task.rawPixels;
-          } else {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, task.width, task.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, task.rawPixels);
-            stbi_image_free(task.rawPixels);
+    std::vector<UploadTask> tasks;
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      tasks.swap(uploadQueue);
+    }
+    if (tasks.empty() && !compactPending) return false;
+
+    for (const auto& task : tasks) {
+      if (task.targetID != 0) loadTokens.erase(task.targetID);
+    }
+
+    // the registry is main-thread state, so the main thread waits while the
+    // uploads run on the GL thread rather than sharing it
+    RenderThread::RunOnGLSync([&tasks] {
+      for (const auto& task : tasks) {
+        if (task.targetID != 0 && idToPath.find(task.targetID) != idToPath.end()) {
+
+          std::string path = idToPath[task.targetID];
+          TextureInfo& info = textureCache[path];
+          releaseStorage(info);
+          info.width = task.width;
+          info.height = task.height;
+          info.isLoaded = true;
+
+          glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+          glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+          glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+          glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+          if (task.pbo != 0) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, task.pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            placeTexture(info, task.width, task.height, true, nullptr, task.dataSize);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &task.pbo);
+          } else if (task.rawPixels != nullptr) {
+            placeTexture(info, task.width, task.height, task.isCompressed, task.rawPixels, task.dataSize);
+            if (task.isCompressed) delete[] task.rawPixels;
+            else stbi_image_free(task.rawPixels);
           }
-        }
-      } else {
-        if (task.pbo != 0) {
-          glBindBuffer(GL_PIXEL_UNPACK_BUFFER, task.pbo);
-          glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-          glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-          glDeleteBuffers(1, &task.pbo);
-        }
-        if (task.rawPixels != nullptr) {
-          if (task.isCompressed) delete [] task.rawPixels; 
-          else stbi_image_free(task.rawPixels);
+        } else {
+          discardUpload(task);
         }
       }
-    }
-    uploadQueue.clear();
+
+      if (compactPending) compactAtlasPages();
+    });
     return true;
   }
 
   void Cleanup() {
-    for (const auto& pair : textureCache) {
-      glDeleteTextures(1, &pair.second.id);
+    // loads cancelled at shutdown still hand back their PBOs and pixels
+    std::vector<UploadTask> tasks;
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      tasks.swap(uploadQueue);
+    }
+    if (!tasks.empty()) {
+      RenderThread::RunOnGL([tasks] {
+        for (const auto& task : tasks) discardUpload(task);
+      });
     }
+
+    for (auto& pair : textureCache) {
+      if (pair.second.page < 0 && pair.second.glTexture != 0) {
+        deleteTexture(pair.second.glTexture);
+      }
+    }
+    for (auto& page : atlasPages) {
+      if (page) deleteTexture(page->texture);
+    }
+    atlasPages.clear();
+    compactPending = false;
+    loadTokens.clear();
     textureCache.clear();
     idToPath.clear();
   }
@@ -421,4 +766,23 @@ namespace TextureRegistry {
     return idToPath.find(textureID) != idToPath.end();
   }
 
+  uint32_t GetAtlasGeneration() {
+    return atlasGeneration;
+  }
+
+  bool GetTextureRegion(GLuint textureID, TextureRegion& out) {
+    auto pathIt = idToPath.find(textureID);
+    if (pathIt == idToPath.end()) return false;
+    auto cacheIt = textureCache.find(pathIt->second);
+    if (cacheIt == textureCache.end() || !cacheIt->second.isLoaded || cacheIt->second.glTexture == 0) return false;
+
+    const TextureInfo& info = cacheIt->second;
+    out.texture = info.glTexture;
+    out.u0 = info.u0;
+    out.v0 = info.v0;
+    out.u1 = info.u1;
+    out.v1 = info.v1;
+    return true;
+  }
+
 }
@@ -1,9 +1,20 @@
 #pragma once
 #include <string>
+#include <cstdint>
 #include <glad/glad.h>
 #include <lua.hpp>
 
 namespace TextureRegistry {
+    // Where a texture handle's pixels live: the GL texture to bind and the
+    // sub-rect it occupies. Small images share atlas pages, so this is only
+    // known once the upload has happened.
+    struct TextureRegion {
+      GLuint texture = 0;
+      float u0 = 0.0f, v0 = 0.0f;
+      float u1 = 1.0f, v1 = 1.0f;
+    };
+
+    // returns a registry handle, not a GL texture name; see GetTextureRegion
     GLuint GetTexture(const std::string& path);
     bool ProcessUploads();
     void Cleanup();
@@ -11,6 +22,10 @@ namespace TextureRegistry {
     void GetTextureDimensions(GLuint textureID, int& w, int& h);
     bool IsTextureLoaded(GLuint textureID);
     bool IsValidTexture(GLuint textureID);
+    bool GetTextureRegion(GLuint textureID, TextureRegion& out);
+    // bumped whenever atlas compaction moves images, so draws that baked a
+    // region can be repainted
+    uint32_t GetAtlasGeneration();
 }
 
 
@@ -6,6 +6,7 @@
 #include <SDL2/SDL_filesystem.h>
 #include <SDL_stdinc.h>
 #include <SDL_timer.h>
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
@@ -17,6 +18,7 @@
 #include "components/network/http_client.h"
 #include "components/renderer/commands.h"
 #include "components/renderer/opengl_renderer.h"
+#include "components/renderer/render_thread.h"
 #include "components/text/font.h"
 #include "components/ui/ui.h"
 #include "components/layout/layout.h"
@@ -32,6 +34,9 @@
 #include "components/database/sqlite_client.h"
 #include "components/database/kv_cache.h"
 #include "components/audio/audio.h"
+#include "components/system/timers.h"
+#include "components/system/worker_pool.h"
+#include "components/system/jobs.h"
 
 #include "tools/stats_logger/stats_logger.h"
 
@@ -43,7 +48,12 @@ int protected_buildNode(lua_State* L) {
 
 int protected_reconcile(lua_State* L) {
   Node* root = (Node*)lua_touserdata(L, 1);
-  VDOM::reconcile(L, root, 2);
+  lua_pushlightuserdata(L, VDOM::reconcile(L, root, 2));
+  return 1;
+}
+
+int protected_renderComponents(lua_State* L) {
+  VDOM::renderDirtyComponents(L);
   return 0;
 }
 
@@ -78,6 +88,8 @@ int main(int argc, char* argv[]) {
   RegisterGlobalFunctions(L, "vulpis");
   AutoRegisterAllFonts();
 
+  WorkerPool::Init();
+  Jobs::Init();
   HttpClient::Init();
   WebSocketClient::Init();
   SqliteClient::Init("vulpis_data.sqlite");
@@ -224,6 +236,11 @@ int main(int argc, char* argv[]) {
 
   LoadFontConfig(L);
 
+  // from here on GL work goes through RenderThread, and frames are drawn on
+  // a thread of their own unless the engine config sets enable_render_thread
+  // to false. Read after LoadFontConfig, which loads the engine config.
+  RenderThread::Start(&renderer, GetEngineConfig().enableRenderThread);
+
   // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
   // ╏ HANDLING APP FUNCTION ╏
   // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
@@ -233,8 +250,11 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  // 2. Call App()
-  if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
+  // 2. Call App(), remembering which state keys it reads
+  StateManager::instance().beginTracking();
+  int appStatus = lua_pcall(L, 0, 1, 0);
+  StateManager::instance().subscribe(nullptr, StateManager::instance().endTracking());
+  if (appStatus != LUA_OK) {
     std::cerr << "Error calling App(): " << lua_tostring(L, -1) << std::endl;
     lua_pop(L, 1);
     return 1;
@@ -268,7 +288,6 @@ int main(int argc, char* argv[]) {
   // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
   Layout::LayoutSolver* solver = Layout::createYogaSolver();
   solver->solve(root, {winW, winH});
-  updateTextLayout(root);
   root->isLayoutDirty = false;
   root->isPaintDirty = false;
 
@@ -298,15 +317,49 @@ int main(int argc, char* argv[]) {
   bool needsRedraw = true;
   uint32_t lastCursorToggle = SDL_GetTicks();
 
+  // nothing is rendered while the window is minimised or hidden
+  bool windowVisible = true;
+  // on_tick runs every frame until it returns false
+  bool wantsTick = true;
+  bool hasCaret = false;
+
+  Timers::Init();
 
   while (running) {
 
-    if (SDL_WaitEventTimeout(&event, 16)) {
+    // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
+    // ╏ SLEEP UNTIL AN EVENT OR A DEADLINE ╏
+    // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
+    // A static screen with no timers sleeps in SDL_WaitEvent until input
+    // arrives or a worker thread pushes an SDL_USEREVENT.
+    int waitTimeout = Timers::NextWaitTimeout();
+    bool hadEvents = false;
+
+    if (waitTimeout < 0 ? SDL_WaitEvent(&event) : SDL_WaitEventTimeout(&event, waitTimeout)) {
+      hadEvents = true;
       do {
         if (event.type == SDL_QUIT) {
           running = false;
         }
 
+        if (event.type == SDL_WINDOWEVENT) {
+          switch (event.window.event) {
+            case SDL_WINDOWEVENT_MINIMIZED:
+            case SDL_WINDOWEVENT_HIDDEN:
+              windowVisible = false;
+              break;
+            case SDL_WINDOWEVENT_SHOWN:
+            case SDL_WINDOWEVENT_RESTORED:
+            case SDL_WINDOWEVENT_MAXIMIZED:
+            case SDL_WINDOWEVENT_EXPOSED:
+              windowVisible = true;
+              g_damageTracker.damageAll();
+              needsRedraw = true;
+              break;
+          }
+          Timers::SetWindowVisible(windowVisible);
+        }
+
         if (event.type == SDL_MOUSEMOTION) {
           SDL_Event nextEvent;
           if (SDL_PeepEvents(&nextEvent, 1, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) > 0) {
@@ -326,15 +379,13 @@ int main(int argc, char* argv[]) {
 
           static uint32_t lastResizeRender = 0;
           uint32_t currentTicks = SDL_GetTicks();
-          if (currentTicks - lastResizeRender > 16) { 
+          if (windowVisible && currentTicks - lastResizeRender > 16) { 
             solver->solve(root, {winW, winH});
-            updateTextLayout(root);
             root->isLayoutDirty = false;
             root->invalidateSubtreePaint();
 
-            renderer.beginFrame(g_damageTracker);
             RenderCommandList cmdList;
-            generateRenderCommands(root, cmdList);
+            generateRenderCommands(root, cmdList, Rect{0.0f, 0.0f, (float)winW, (float)winH});
             UI_SetRenderCommandList(&cmdList);
 
             lua_getglobal(L, "on_render");
@@ -347,8 +398,9 @@ int main(int argc, char* argv[]) {
             }
             UI_SetRenderCommandList(nullptr);
 
-            renderer.submit(cmdList);
-            renderer.endFrame();
+            RenderThread::SubmitFrame({std::move(cmdList), g_damageTracker});
+            g_damageTracker.update();
+            Timers::FrameDone();
 
             lastResizeRender = currentTicks; 
           }
@@ -362,27 +414,36 @@ int main(int argc, char* argv[]) {
     lastTime = currentTime;
 
     // 3. PROCESS BACKGROUND QUEUES (Instantly handles the data that woke us up)
+    // Lua callbacks may have changed the tree; a relayout finds out what
+    // moved without repainting what didn't
     if (HttpClient::ProcessQueue(L)) {
       needsRedraw = true;
-      root->makeLayoutDirty(); 
+      root->isLayoutDirty = true;
     }
 
     if (WebSocketClient::ProcessQueue(L)) {
       needsRedraw = true;
-      root->makeLayoutDirty(); 
+      root->isLayoutDirty = true;
     }
 
+    // an image whose texture arrived or whose atlas page was compacted
+    // repaints itself in UI_UpdateSmoothScrolling; nothing moves
     if (TextureRegistry::ProcessUploads()) {
       needsRedraw = true;
-      root->makeLayoutDirty();
     }
 
     if (SqliteClient::ProcessQueue(L)) {
       needsRedraw = true;
-      root->makeLayoutDirty();
+      root->isLayoutDirty = true;
+    }
+
+    if (Timers::ProcessQueue(L)) {
+      needsRedraw = true;
     }
 
-    UI_UpdateSmoothScrolling(root, dt);
+    // after a long sleep dt covers the whole idle stretch; animations
+    // restart from a single frame step instead of jumping
+    UI_UpdateSmoothScrolling(root, std::min(dt, 1.0f / 30.0f));
 
     UI_FireScrollEvents(L, root);
 
@@ -396,9 +457,15 @@ int main(int argc, char* argv[]) {
     lua_getglobal(L, "on_tick");
     if (lua_isfunction(L, -1)) {
       lua_pushnumber(L, dt);
-      if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+      if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
         std::cerr << "on_tick Error " << lua_tostring(L, -1) << std::endl;
         lua_pop(L, 1);
+      } else {
+        // returning false means "nothing to animate": on_tick then only runs
+        // when something else wakes the loop
+        wantsTick = !(lua_isboolean(L, -1) && !lua_toboolean(L, -1));
+        lua_pop(L, 1);
+        if (wantsTick) Timers::RequestFrame();
       }
     } else {
       lua_pop(L, 1);
@@ -407,36 +474,60 @@ int main(int argc, char* argv[]) {
     // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
     // ╏ RECONCILE TREE IF DIRTY ╏
     // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
-    if (StateManager::instance().isDirty()) {
+    StateManager& stateManager = StateManager::instance();
+    if (stateManager.isDirty()) {
       needsRedraw = true;
-      lua_getglobal(L, "App");
-      if (lua_isfunction(L, -1)) {
-        if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
-          std::cerr << "App Update Error: " << lua_tostring(L, -1) << std::endl;
-          lua_pop(L, 1);
-        } else {
-          // App table is at top of stack (-1)
-
-          if (lua_istable(L, -1)) {
-            // PROTECTED RECONCILE
-            lua_pushcfunction(L, protected_reconcile);
-            lua_pushlightuserdata(L, root); // Arg 1: Root
-            lua_pushvalue(L, -3);           // Arg 2: App Table (copy from -3)
-
-            if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
-              std::cerr << "VDOM Reconcile Error: " << lua_tostring(L, -1) << std::endl;
-              lua_pop(L, 1); // Pop error
-            }
+      if (stateManager.needsFullRender()) {
+        // dirty components stay pending: the reconcile re-renders each one
+        // it reaches, even under an unchanged memo
+        stateManager.clearFullRender();
+
+        lua_getglobal(L, "App");
+        if (lua_isfunction(L, -1)) {
+          stateManager.beginTracking();
+          int appStatus = lua_pcall(L, 0, 1, 0);
+          stateManager.subscribe(nullptr, stateManager.endTracking());
+
+          if (appStatus != LUA_OK) {
+            std::cerr << "App Update Error: " << lua_tostring(L, -1) << std::endl;
+            lua_pop(L, 1);
           } else {
-            std::cerr << "Error: App() returned non-table during update" << std::endl;
+            // App table is at top of stack (-1)
+
+            if (lua_istable(L, -1)) {
+              // PROTECTED RECONCILE
+              lua_pushcfunction(L, protected_reconcile);
+              lua_pushlightuserdata(L, root); // Arg 1: Root
+              lua_pushvalue(L, -3);           // Arg 2: App Table (copy from -3)
+
+              if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
+                std::cerr << "VDOM Reconcile Error: " << lua_tostring(L, -1) << std::endl;
+                lua_pop(L, 1); // Pop error
+              } else {
+                // the root is replaced when App starts returning a component
+                root = (Node*)lua_touserdata(L, -1);
+                lua_pop(L, 1);
+              }
+            } else {
+              std::cerr << "Error: App() returned non-table during update" << std::endl;
+            }
+
+            lua_pop(L, 1); // Pop App table
           }
+        } else {
+          lua_pop(L, 1);
+        }
+      }
 
-          lua_pop(L, 1); // Pop App table
+      if (stateManager.hasDirtyComponents()) {
+        // only components subscribed to the changed keys re-render, along
+        // with any the reconcile skipped inside a memoized subtree
+        lua_pushcfunction(L, protected_renderComponents);
+        if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+          std::cerr << "Component Update Error: " << lua_tostring(L, -1) << std::endl;
+          lua_pop(L, 1);
         }
-      } else {
-        lua_pop(L, 1);
       }
-      StateManager::instance().clearDirty();
     }
 
     Uint64 scriptEnd = SDL_GetPerformanceCounter();
@@ -447,43 +538,55 @@ int main(int argc, char* argv[]) {
     // ┗╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┛
 
     bool currentCursorState = ((currentTime - Input::lastInputTime) % 1000) < 500;
+    bool cursorToggled = currentCursorState != lastCursorToggle;
 
-    if (currentCursorState != lastCursorToggle) {
-      lastCursorToggle = currentCursorState; 
+    // focus only changes through input or a re-render, so the tree is only
+    // searched then or on a blink
+    if (cursorToggled || hadEvents || stateManager.isDirty() || needsRedraw) {
+      lastCursorToggle = currentCursorState;
       Node* focused = Input::findFocusedNode(root);
-      if (focused) {
+      hasCaret = focused != nullptr;
+      if (focused && cursorToggled) {
         focused->makePaintDirty();
         needsRedraw = true;
       }
     }
 
-    if (needsRedraw) {
+    // wake for the next blink
+    if (hasCaret) {
+      Timers::WakeIn(500 - (currentTime - Input::lastInputTime) % 500);
+    }
+
+    if (needsRedraw && windowVisible) {
 
       double currentLayoutTimeMs = 0.0;
       double currentRenderTimeMs = 0.0;
 
-      if (root->isLayoutDirty || root->isPaintDirty) {
-        g_damageTracker.damageAll();
-      }
-
       if (root->isLayoutDirty) {
         Uint64 layoutStart = SDL_GetPerformanceCounter();
 
+        // applyLayout damages and repaints only the nodes whose box changed
         solver->solve(root, {winW, winH});
-        updateTextLayout(root);
         root->isLayoutDirty = false;
-        root->invalidateSubtreePaint();
-        g_damageTracker.damageAll();
 
+        Uint64 layoutEnd = SDL_GetPerformanceCounter();
+        currentLayoutTimeMs = ((layoutEnd - layoutStart) * 1000.0) / perfFreq;
+      } else if (Layout::hasPendingRelayout()) {
+        // only relayout boundaries changed; each re-solves its own subtree
+        // and damages its own box
+        Uint64 layoutStart = SDL_GetPerformanceCounter();
+        solver->solve(root, {winW, winH});
         Uint64 layoutEnd = SDL_GetPerformanceCounter();
         currentLayoutTimeMs = ((layoutEnd - layoutStart) * 1000.0) / perfFreq;
       }
 
       Uint64 renderStart = SDL_GetPerformanceCounter();
 
-      renderer.beginFrame(g_damageTracker);
+      // commands are generated before the frame begins: regenerating a
+      // node records where it is drawn now in the damage region
       RenderCommandList cmdList;
-      generateRenderCommands(root, cmdList);
+      generateRenderCommands(root, cmdList, Rect{0.0f, 0.0f, (float)winW, (float)winH});
+      size_t retainedCommands = cmdList.commands.size();
       UI_SetRenderCommandList(&cmdList);
 
       // ┏╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍╍┓
@@ -501,26 +604,48 @@ int main(int argc, char* argv[]) {
 
       UI_SetRenderCommandList(nullptr);
 
-      renderer.submit(cmdList);
-      renderer.endFrame();
+      // immediate-mode drawing isn't tracked, so a frame that has any
+      // repaints the whole window
+      if (cmdList.commands.size() != retainedCommands) {
+        g_damageTracker.damageAll();
+      }
+
+      // a wake-up that changed nothing on screen (a timer, on_tick, a blink
+      // that moved no caret) presents nothing; the front buffer is current
+      if (g_damageTracker.hasDamage()) {
+        // the packet owns the commands and a copy of the damage; this returns
+        // once the previous frame is presented, so the next one can be built
+        // while this one draws
+        RenderThread::SubmitFrame({std::move(cmdList), g_damageTracker});
+
+        // older back buffers are repaired from the damage history, so one
+        // frame per change is enough
+        g_damageTracker.update();
+      }
 
       Uint64 renderEnd = SDL_GetPerformanceCounter();
       currentRenderTimeMs = ((renderEnd - renderStart) * 1000.0) / perfFreq;
-
-      g_damageTracker.update();
-
-      if (!g_damageTracker.active) {
-        needsRedraw = false;
-      }
+      Timers::FrameDone();
+      needsRedraw = false;
       if (statsLogger) {
         statsLogger->log(currentTime - appStartTime, dt, currentScriptTimeMs, currentLayoutTimeMs, currentRenderTimeMs);
       }
 
     }
 
+    // every system mirroring the tree has caught up with this frame's edits;
+    // a skipped layout falls back to the full child pass later
+    VDOM::clearPatchLog();
+
     Input::updateState();
   }
 
+  // cancels in-flight loads, lets queued ones hand back what they own and
+  // joins the workers, so nothing outlives the systems torn down below
+  Jobs::ShutDown();
+  // brings the context back to this thread for the GL cleanup below
+  RenderThread::Stop();
+  Timers::ShutDown(L);
   UI_ShutdownFonts();
   TextureRegistry::Cleanup();
   HttpClient::ShutDown();
@@ -528,6 +653,7 @@ int main(int argc, char* argv[]) {
   SqliteClient::ShutDown();
   KVCache::ShutDown();
   Audio::ShutDown();
+  WorkerPool::ShutDown();
 
   freeTree(L, root);
   SDL_DestroyWindow(window);
@@ -9,6 +9,7 @@ local elements = {}
 ---@field onMouseLeave? fun()
 ---@field children? VulpisNode[]
 ---@field style? VulpisStyle
+---@field memo? any Dependencies fingerprint; an unchanged memo skips reconciling the subtree
 -- (You can add your native shorthands back to these annotations later!)
 
 function elements.mergeStyles(...)
@@ -217,4 +218,24 @@ function elements.Image(props)
 	return node
 end
 
+---@generic P
+---@param render fun(props: P): VulpisNode
+---@param props? P | { key?: string, memo?: any }
+---@return VulpisNode
+-- Component boundary: `render(props)` runs on its own, and a `setState` on a
+-- key it read through `useState` re-renders only this component.
+function elements.Component(render, props)
+	if type(props) ~= "table" then
+		props = {}
+	end
+
+	return {
+		type = "component",
+		key = props.key,
+		memo = props.memo,
+		render = render,
+		props = props,
+	}
+end
+
 return elements